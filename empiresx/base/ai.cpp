@@ -0,0 +1,271 @@
+/* Copyright 2016-2020 the Age of Empires Free Software Remake authors. See LEGAL for legal info */
+
+#include "ai.hpp"
+
+#include "world.hpp"
+#include "events.hpp"
+
+#include <algorithm>
+#include <limits>
+
+namespace genie {
+
+namespace game {
+
+void World::view(AiView &v) const {
+	v.tick = timers.now();
+	v.units.clear();
+	v.buildings.clear();
+	v.resources.clear();
+	v.ledgers.clear();
+
+	for (const ArenaPtr<Unit> &u : units) {
+		bool idle = !u->victim && !u->job && u->idle();
+		v.units.push_back(AiUnit{u->handle, u->pos.left.floor(), u->pos.top.floor(), (uint8_t)u->type, (uint8_t)u->player, (uint8_t)idle, 0});
+	}
+
+	for (const ArenaPtr<Building> &b : buildings)
+		v.buildings.push_back(AiBuilding{b->handle, b->pos.left.floor(), b->pos.top.floor(), (uint8_t)b->type, (uint8_t)b->player, (uint16_t)std::min<size_t>(b->prod.size(), UINT16_MAX)});
+
+	for (const ArenaPtr<StaticResource> &r : static_res)
+		v.resources.push_back(AiResource{r->handle, r->pos.left.floor(), r->pos.top.floor(), r->left(), (uint8_t)r->what(), {}});
+
+	for (unsigned p = 0; p < economy.players(); ++p)
+		v.ledgers.push_back(economy.ledger(p));
+}
+
+static int64_t dist2(int32_t x0, int32_t y0, int32_t x1, int32_t y1) {
+	int64_t dx = (int64_t)x1 - x0, dy = (int64_t)y1 - y0;
+	return dx * dx + dy * dy;
+}
+
+Computer::Computer(unsigned player) : player(player), step(Step::count), cursor(0), villagers(0), army(0), group() {}
+
+void Computer::reset() noexcept {
+	step = Step::count;
+	cursor = 0;
+}
+
+unsigned Computer::plan(const AiView &view, GameEvents &out, clk::time_point deadline) {
+	unsigned orders = 0;
+
+	if (step == Step::count) {
+		villagers = army = 0;
+
+		for (const AiUnit &u : view.units)
+			if (u.player == player)
+				++((UnitType)u.type == UnitType::villager ? villagers : army);
+
+		for (const AiBuilding &b : view.buildings)
+			if (b.player == player)
+				((BuildingType)b.type == BuildingType::town_center ? villagers : army) += b.queued;
+
+		step = Step::gather;
+		cursor = 0;
+	}
+
+	if (step == Step::gather) {
+		// collect whatever we have the least of
+		ResourceType want = ResourceType::food;
+
+		if (player < view.ledgers.size()) {
+			const Economy::Ledger &l = view.ledgers[player];
+			want = (ResourceType)(std::min_element(l.stock, l.stock + Economy::resource_types) - l.stock);
+		}
+
+		for (; cursor < view.units.size(); ++cursor) {
+			const AiUnit &u = view.units[cursor];
+
+			if (u.player != player || !u.idle || (UnitType)u.type != UnitType::villager)
+				continue;
+
+			// looking for a resource is the expensive part, so check the time here
+			if (clk::now() >= deadline)
+				return orders;
+
+			const AiResource *best = nullptr;
+			int64_t best_d = std::numeric_limits<int64_t>::max();
+			bool best_want = false;
+
+			for (const AiResource &r : view.resources) {
+				bool w = (ResourceType)r.type == want;
+				int64_t d = dist2(u.x, u.y, r.x, r.y);
+
+				if (r.left && (w > best_want || (w == best_want && d < best_d))) {
+					best = &r;
+					best_d = d;
+					best_want = w;
+				}
+			}
+
+			if (best) {
+				out.gather(&u.handle, 1, best->handle);
+				++orders;
+			}
+		}
+
+		step = Step::train;
+		cursor = 0;
+	}
+
+	if (step == Step::train) {
+		for (const AiBuilding &b : view.buildings) {
+			if (b.player != player || b.queued)
+				continue;
+
+			if ((BuildingType)b.type == BuildingType::town_center) {
+				if (villagers < max_villagers) {
+					out.train(b.handle, UnitType::villager);
+					++villagers;
+					++orders;
+				}
+			} else if (army < max_army) {
+				out.train(b.handle, UnitType::clubman);
+				++army;
+				++orders;
+			}
+		}
+
+		step = Step::army;
+	}
+
+	if (step == Step::army) {
+		group.clear();
+
+		for (const AiUnit &u : view.units)
+			if (u.player == player && u.idle && (UnitType)u.type != UnitType::villager)
+				group.push_back(u.handle);
+
+		if (group.size() >= attack_group) {
+			// go for the closest building of anyone else and take on their units once they are all gone
+			const AiUnit *lead = nullptr;
+
+			for (const AiUnit &u : view.units)
+				if (u.handle == group[0])
+					lead = &u;
+
+			Handle target;
+			int64_t best_d = std::numeric_limits<int64_t>::max();
+
+			for (const AiBuilding &b : view.buildings)
+				if (b.player != player && dist2(lead->x, lead->y, b.x, b.y) < best_d) {
+					best_d = dist2(lead->x, lead->y, b.x, b.y);
+					target = b.handle;
+				}
+
+			if (!target)
+				for (const AiUnit &u : view.units)
+					if (u.player != player && dist2(lead->x, lead->y, u.x, u.y) < best_d) {
+						best_d = dist2(lead->x, lead->y, u.x, u.y);
+						target = u.handle;
+					}
+
+			if (target) {
+				out.attack(group.data(), group.size(), target);
+				++orders;
+			}
+		}
+
+		step = Step::done;
+	}
+
+	return orders;
+}
+
+constexpr std::chrono::microseconds AiPool::default_budget;
+
+AiPool::AiPool(GameEvents &out, std::chrono::microseconds budget)
+	: out(out), budget(budget), views(), ready(view_count), unused(view_count), mut(), computers()
+	, running(true), views_published(0), views_skipped(0), plans(0), overruns(0), orders(0), worker()
+{
+	for (std::unique_ptr<AiView> &v : views) {
+		v.reset(new AiView());
+		unused.push(v.get());
+	}
+
+	worker = std::thread(&AiPool::run, this);
+}
+
+AiPool::~AiPool() {
+	running.store(false);
+	worker.join();
+}
+
+void AiPool::add(unsigned player) {
+	std::lock_guard<std::mutex> lock(mut);
+	computers.emplace_back(player);
+}
+
+void AiPool::clear() {
+	std::lock_guard<std::mutex> lock(mut);
+	computers.clear();
+}
+
+size_t AiPool::size() {
+	std::lock_guard<std::mutex> lock(mut);
+	return computers.size();
+}
+
+void AiPool::publish(const World &world) {
+	if (world.timers.now() % view_ticks)
+		return;
+
+	AiView *v;
+
+	if (!unused.pop(v)) {
+		views_skipped.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+
+	world.view(*v);
+	ready.push(v);
+	views_published.fetch_add(1, std::memory_order_relaxed);
+}
+
+AiStats AiPool::stats() const noexcept {
+	return AiStats{
+		views_published.load(std::memory_order_relaxed), views_skipped.load(std::memory_order_relaxed),
+		plans.load(std::memory_order_relaxed), overruns.load(std::memory_order_relaxed), orders.load(std::memory_order_relaxed)
+	};
+}
+
+void AiPool::run() {
+	while (running.load()) {
+		AiView *v = nullptr;
+
+		// only the newest view matters
+		for (AiView *p; ready.pop(p);) {
+			if (v)
+				unused.push(v);
+			v = p;
+		}
+
+		if (!v) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			continue;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(mut);
+
+			for (Computer &c : computers) {
+				// anyone that has not finished the last view continues where it left off
+				if (c.done())
+					c.reset();
+
+				clk::time_point deadline = clk::now() + budget * view_ticks;
+				orders.fetch_add(c.plan(*v, out, deadline), std::memory_order_relaxed);
+
+				if (!c.done())
+					overruns.fetch_add(1, std::memory_order_relaxed);
+			}
+		}
+
+		plans.fetch_add(1, std::memory_order_relaxed);
+		unused.push(v);
+	}
+}
+
+}
+
+}
@@ -0,0 +1,171 @@
+/* Copyright 2016-2020 the Age of Empires Free Software Remake authors. See LEGAL for legal info */
+
+#pragma once
+
+/*
+ * Computer players.
+ *
+ * Every couple of ticks, the game thread copies what computer players need to know
+ * into a compact view of the world. A worker thread lets every computer plan against
+ * the newest view. Orders are pushed into the same GameEvents queue as the orders of
+ * human players, so they are applied at a tick boundary like any other order.
+ *
+ * Every computer has a CPU budget per tick. Planning stops once the budget is used up
+ * and continues where it left off with the next view, so a slow computer only reacts
+ * later and never delays the simulation. Publishing a view costs the same no matter
+ * how many computers there are. Views are recycled through two rings, so they are
+ * not allocated again once they have grown to the size of the world.
+ */
+
+#include "handle.hpp"
+#include "ring.hpp"
+#include "economy.hpp"
+
+#include <cstddef>
+#include <cstdint>
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace genie {
+
+namespace game {
+
+class World;
+class GameEvents;
+
+struct AiUnit final {
+	Handle handle;
+	int32_t x, y; /**< tile */
+	uint8_t type, player;
+	uint8_t idle; /**< no order at all */
+	uint8_t pad;
+};
+
+struct AiBuilding final {
+	Handle handle;
+	int32_t x, y;
+	uint8_t type, player;
+	uint16_t queued; /**< units waiting to be made */
+};
+
+struct AiResource final {
+	Handle handle;
+	int32_t x, y;
+	uint32_t left;
+	uint8_t type;
+	uint8_t pad[3];
+};
+
+/** Everything computer players know about the world at the end of one tick. */
+class AiView final {
+public:
+	uint64_t tick;
+	std::vector<AiUnit> units;
+	std::vector<AiBuilding> buildings;
+	std::vector<AiResource> resources;
+	std::vector<Economy::Ledger> ledgers; /**< indexed by player */
+
+	AiView() : tick(0), units(), buildings(), resources(), ledgers() {}
+};
+
+/** Strategy of one computer player. */
+class Computer final {
+public:
+	typedef std::chrono::steady_clock clk;
+
+	/** Units a computer makes at most for each kind. */
+	static constexpr unsigned max_villagers = 30, max_army = 30;
+	/** Idle military units that are sent off together. */
+	static constexpr unsigned attack_group = 5;
+private:
+	enum class Step {
+		count,
+		gather,
+		train,
+		army,
+		done,
+	};
+
+	unsigned player;
+	Step step;
+	size_t cursor; /**< next record for the current step */
+	unsigned villagers, army;
+	std::vector<Handle> group; /**< scratch */
+public:
+	explicit Computer(unsigned player);
+
+	unsigned owner() const noexcept { return player; }
+
+	/** Start over with a new view. Unfinished steps are picked up again, but with the new view. */
+	void reset() noexcept;
+
+	/**
+	 * Plan against \a view and push orders to \a out until done or \a deadline has passed.
+	 * Returns the number of orders.
+	 */
+	unsigned plan(const AiView &view, GameEvents &out, clk::time_point deadline);
+	bool done() const noexcept { return step == Step::done; }
+};
+
+struct AiStats final {
+	uint64_t views; /**< that have been published */
+	uint64_t skipped; /**< views that have not been published, because the worker was still busy */
+	uint64_t plans; /**< rounds in which all computers have planned */
+	uint64_t overruns; /**< plans that did not finish within the budget */
+	uint64_t orders;
+};
+
+/** All computers of a game and the thread they run on. */
+class AiPool final {
+public:
+	typedef std::chrono::steady_clock clk;
+
+	/** Ticks between views. */
+	static constexpr unsigned view_ticks = 10;
+	/** CPU time for every computer for every tick. */
+	static constexpr std::chrono::microseconds default_budget{100};
+private:
+	static constexpr size_t view_count = 3;
+
+	GameEvents &out;
+	const std::chrono::microseconds budget;
+	std::unique_ptr<AiView> views[view_count];
+	SpscRing<AiView*> ready; /**< game thread to worker */
+	SpscRing<AiView*> unused; /**< worker to game thread */
+
+	std::mutex mut; /**< guards computers */
+	std::vector<Computer> computers;
+
+	std::atomic<bool> running;
+	std::atomic<uint64_t> views_published, views_skipped, plans, overruns, orders;
+	std::thread worker;
+public:
+	explicit AiPool(GameEvents &out, std::chrono::microseconds budget=default_budget);
+	~AiPool();
+
+	AiPool(const AiPool&) = delete;
+	AiPool &operator=(const AiPool&) = delete;
+
+	/** Let a computer play for \a player. */
+	void add(unsigned player);
+	/** Remove all computers, e.g. when a game is loaded. */
+	void clear();
+	size_t size();
+
+	/** Publish a new view if one is due. This must be called by the thread that runs the game after each tick. */
+	void publish(const World &world);
+
+	/** This is safe to call from any thread. */
+	AiStats stats() const noexcept;
+private:
+	void run();
+};
+
+}
+
+}
@@ -0,0 +1,39 @@
+/* Copyright 2016-2020 the Age of Empires Free Software Remake authors. See LEGAL for legal info */
+
+#include "arena.hpp"
+
+#include <algorithm>
+
+namespace genie {
+
+namespace game {
+
+static std::pmr::pool_options pool_options() {
+	std::pmr::pool_options o;
+	o.max_blocks_per_chunk = 0; // let the implementation decide
+	o.largest_required_pool_block = Arena::largest_pool;
+	return o;
+}
+
+Arena::Arena(size_t initial)
+	: blocks(initial, std::pmr::new_delete_resource()), pools(pool_options(), &blocks), used(0), peak(0) {}
+
+void *Arena::do_allocate(size_t bytes, size_t align) {
+	void *p = pools.allocate(bytes, align);
+	used += bytes;
+	peak = std::max(peak, used);
+	return p;
+}
+
+void Arena::do_deallocate(void *p, size_t bytes, size_t align) {
+	pools.deallocate(p, bytes, align);
+	used -= bytes;
+}
+
+bool Arena::do_is_equal(const std::pmr::memory_resource &other) const noexcept {
+	return this == &other;
+}
+
+}
+
+}
@@ -0,0 +1,81 @@
+/* Copyright 2016-2020 the Age of Empires Free Software Remake authors. See LEGAL for legal info */
+
+#pragma once
+
+/*
+ * Memory for everything that lives as long as one match.
+ *
+ * Small objects are taken from pools with one free list per size class. The pools
+ * and anything that is too large for them are carved out of big blocks that are
+ * never returned until the arena is destroyed, at which point all of it is released
+ * at once. This keeps entities that are created and removed all the time from
+ * fragmenting the global heap, which matters for a server that hosts one match after
+ * another.
+ *
+ * The arena is not thread-safe. Only allocate from it while the world is not ticking
+ * in parallel.
+ */
+
+#include <cstddef>
+
+#include <memory>
+#include <memory_resource>
+#include <new>
+#include <utility>
+
+namespace genie {
+
+namespace game {
+
+/** Destroys objects that have been made with Arena::make. */
+struct ArenaDelete final {
+	std::pmr::memory_resource *mem;
+	size_t size, align; /**< of the most derived type */
+
+	template<typename T> void operator()(T *p) const noexcept {
+		p->~T();
+		mem->deallocate(p, size, align);
+	}
+};
+
+template<typename T> using ArenaPtr = std::unique_ptr<T, ArenaDelete>;
+
+class Arena final : public std::pmr::memory_resource {
+	std::pmr::monotonic_buffer_resource blocks;
+	std::pmr::unsynchronized_pool_resource pools;
+	size_t used, peak; /**< bytes that are handed out */
+public:
+	static constexpr size_t initial_size = 256 * 1024;
+	/** Anything larger comes straight from the blocks and is only reclaimed when the arena is destroyed. */
+	static constexpr size_t largest_pool = 64 * 1024;
+
+	explicit Arena(size_t initial=initial_size);
+
+	Arena(const Arena&) = delete;
+	Arena &operator=(const Arena&) = delete;
+
+	/** Construct a T in the arena. The returned pointer can be converted to a pointer to any base of T. */
+	template<typename T, typename... Args> ArenaPtr<T> make(Args&&... args) {
+		void *p = allocate(sizeof(T), alignof(T));
+
+		try {
+			return ArenaPtr<T>(new (p) T(std::forward<Args>(args)...), ArenaDelete{this, sizeof(T), alignof(T)});
+		} catch (...) {
+			deallocate(p, sizeof(T), alignof(T));
+			throw;
+		}
+	}
+
+	/** Number of bytes that are in use right now. */
+	size_t size() const noexcept { return used; }
+	/** Largest number of bytes that has ever been in use at once. */
+	size_t max_size() const noexcept { return peak; }
+private:
+	void *do_allocate(size_t bytes, size_t align) override;
+	void do_deallocate(void *p, size_t bytes, size_t align) override;
+	bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override;
+};
+
+}
+
+}
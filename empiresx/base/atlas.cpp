@@ -0,0 +1,161 @@
+/* Copyright 2016-2020 the Age of Empires Free Software Remake authors. See LEGAL for legal info */
+
+#include "atlas.hpp"
+
+#include <algorithm>
+#include <climits>
+#include <stdexcept>
+
+namespace genie {
+
+SkylinePacker::SkylinePacker(int width, int height, int padding) : width(width), height(height), padding(padding), skyline(), used(0) {
+	if (width <= 0 || height <= 0 || padding < 0)
+		throw std::runtime_error("packer: bad page size");
+
+	clear();
+}
+
+void SkylinePacker::clear() {
+	skyline.assign(1, Segment{0, 0, width});
+	used = 0;
+}
+
+int SkylinePacker::fit(size_t i, int w, int h) const noexcept {
+	int x = skyline[i].x, y = 0;
+
+	if (x + w > width)
+		return -1;
+
+	// the rectangle rests on the highest segment below it
+	for (int left = w; left > 0; left -= skyline[i++].w)
+		y = std::max(y, skyline[i].y);
+
+	return y + h <= height ? y : -1;
+}
+
+bool SkylinePacker::pack(int w, int h, int &x, int &y) {
+	if (w <= 0 || h <= 0)
+		throw std::runtime_error("packer: bad rectangle size");
+
+	if (w > width || h > height)
+		return false;
+
+	int pw = std::min(w + padding, width), ph = std::min(h + padding, height);
+	int best_bottom = INT_MAX, best_w = INT_MAX;
+	size_t best = skyline.size();
+
+	for (size_t i = 0; i < skyline.size(); ++i) {
+		int top = fit(i, pw, ph);
+
+		// prefer the lowest bottom and then the narrowest segment, so wide gaps are kept for wide rectangles
+		if (top >= 0 && (top + ph < best_bottom || (top + ph == best_bottom && skyline[i].w < best_w))) {
+			best = i;
+			best_bottom = top + ph;
+			best_w = skyline[i].w;
+		}
+	}
+
+	if (best == skyline.size())
+		return false;
+
+	x = skyline[best].x;
+	y = best_bottom - ph;
+
+	// raise the skyline and cut off what is now covered by the new segment
+	skyline.insert(skyline.begin() + best, Segment{x, best_bottom, pw});
+
+	for (size_t i = best + 1; i < skyline.size();) {
+		Segment &s = skyline[i];
+		int shrink = x + pw - s.x;
+
+		if (shrink <= 0)
+			break;
+
+		if (shrink < s.w) {
+			s.x += shrink;
+			s.w -= shrink;
+			break;
+		}
+
+		skyline.erase(skyline.begin() + i);
+	}
+
+	// merge neighbours of the same height
+	for (size_t i = 0; i + 1 < skyline.size();) {
+		if (skyline[i].y == skyline[i + 1].y) {
+			skyline[i].w += skyline[i + 1].w;
+			skyline.erase(skyline.begin() + i + 1);
+		} else {
+			++i;
+		}
+	}
+
+	used += (size_t)w * h;
+	return true;
+}
+
+AtlasPages::AtlasPages(int width, int height, int padding) : width(width), height(height), padding(padding), pages(), order() {}
+
+void AtlasPages::clear() {
+	pages.clear();
+}
+
+double AtlasPages::occupancy() const noexcept {
+	double sum = 0;
+
+	for (const SkylinePacker &p : pages)
+		sum += p.occupancy();
+
+	return pages.empty() ? 0 : sum / pages.size();
+}
+
+void AtlasPages::pack(AtlasRect *rects, size_t count) {
+	order.clear();
+
+	for (size_t i = 0; i < count; ++i) {
+		AtlasRect &r = rects[i];
+
+		if (r.w > width || r.h > height) {
+			r.page = AtlasRect::none;
+			continue;
+		}
+
+		order.emplace_back(i);
+	}
+
+	std::stable_sort(order.begin(), order.end(), [rects](size_t lhs, size_t rhs) { return rects[lhs].h > rects[rhs].h; });
+
+	for (size_t p = 0; p < pages.size(); ++p) {
+		SkylinePacker trial(pages[p]);
+		size_t i = 0;
+
+		while (i < order.size() && trial.pack(rects[order[i]].w, rects[order[i]].h, rects[order[i]].x, rects[order[i]].y))
+			++i;
+
+		if (i == order.size()) {
+			pages[p] = trial;
+
+			for (size_t j : order)
+				rects[j].page = (unsigned)p;
+
+			return;
+		}
+	}
+
+	// no page has room for all of them
+	if (!order.empty())
+		pages.emplace_back(width, height, padding);
+
+	for (size_t j : order) {
+		AtlasRect &r = rects[j];
+
+		if (!pages.back().pack(r.w, r.h, r.x, r.y)) {
+			pages.emplace_back(width, height, padding);
+			pages.back().pack(r.w, r.h, r.x, r.y);
+		}
+
+		r.page = (unsigned)pages.size() - 1;
+	}
+}
+
+}
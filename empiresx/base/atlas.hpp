@@ -0,0 +1,81 @@
+/* Copyright 2016-2020 the Age of Empires Free Software Remake authors. See LEGAL for legal info */
+
+#pragma once
+
+/*
+ * Rectangle packing for texture atlases.
+ *
+ * Images are packed into big pages, so a scene can be drawn from a few textures instead
+ * of one per frame of every animation. Each page keeps a skyline: the top edge of what
+ * has been placed so far, as a list of horizontal segments from left to right. A new
+ * rectangle goes where its bottom ends up highest, so the page fills from the top and
+ * only the little space that is hidden below the skyline is wasted. This works best
+ * if rectangles are packed from tall to short.
+ *
+ * Frames that are drawn together, such as all frames of one animation in one player
+ * color, are packed as a group into the first page that has room for all of them. That
+ * way, a scene with a few kinds of units touches only a few pages.
+ */
+
+#include <cstddef>
+#include <cstdint>
+
+#include <vector>
+
+namespace genie {
+
+class SkylinePacker final {
+	struct Segment final {
+		int x, y, w;
+	};
+
+	int width, height, padding;
+	std::vector<Segment> skyline; /**< left to right, covers the whole width */
+	size_t used; /**< area of all packed rectangles without padding */
+public:
+	/** Empty page of \a width by \a height pixels. Rectangles are \a padding pixels apart. */
+	SkylinePacker(int width, int height, int padding=1);
+
+	/** Find a place for a \a w by \a h rectangle and reserve it. Returns false if the page is too full. */
+	bool pack(int w, int h, int &x, int &y);
+	void clear();
+
+	/** Fraction of the page that is covered by rectangles. */
+	double occupancy() const noexcept {
+		return (double)used / ((double)width * height);
+	}
+private:
+	/** Lowest top of a \a w wide rectangle whose left edge is at segment \a i, or -1 if it does not fit. */
+	int fit(size_t i, int w, int h) const noexcept;
+};
+
+struct AtlasRect final {
+	static constexpr unsigned none = UINT32_MAX;
+
+	int w, h;
+	unsigned page; /**< none if it is larger than a page */
+	int x, y;
+};
+
+/** Pages of the same size that are filled one group of rectangles at a time. */
+class AtlasPages final {
+	int width, height, padding;
+	std::vector<SkylinePacker> pages;
+	std::vector<size_t> order; /**< scratch for pack */
+public:
+	AtlasPages(int width, int height, int padding=1);
+
+	/**
+	 * Place all \a count \a rects, of which only w and h have to be set. If no page has
+	 * room for all of them, new pages are started. Rectangles that are larger than a
+	 * page get AtlasRect::none as page.
+	 */
+	void pack(AtlasRect *rects, size_t count);
+	void clear();
+
+	size_t size() const noexcept { return pages.size(); }
+	/** Fraction of all pages that is covered by rectangles. */
+	double occupancy() const noexcept;
+};
+
+}
@@ -0,0 +1,68 @@
+/* Copyright 2016-2020 the Age of Empires Free Software Remake authors. See LEGAL for legal info */
+
+#include "combat.hpp"
+
+#include "world.hpp"
+#include "stats.hpp"
+
+#include <algorithm>
+
+namespace genie {
+
+namespace game {
+
+/** Units always attack with at least this reach, so melee units can hit what they touch. */
+static constexpr Fixed melee_reach = Fixed::from(0.25);
+
+Combat::Combat() : attacks() {}
+
+unsigned Combat::defender(UnitType type) noexcept {
+	return (unsigned)type;
+}
+
+unsigned Combat::defender(BuildingType type) noexcept {
+	return stats::unit_types + (unsigned)type;
+}
+
+unsigned Combat::reload(UnitType type) noexcept {
+	return stats::unit_reload_ticks[(unsigned)type];
+}
+
+Fixed Combat::range(UnitType type) noexcept {
+	return std::max(stats::unit_range[(unsigned)type], melee_reach);
+}
+
+unsigned Combat::damage(UnitType attacker, unsigned defender) const noexcept {
+	return stats::damage[(unsigned)attacker * stats::defender_types + defender];
+}
+
+void Combat::queue(Handle from, UnitType attacker, Handle to, unsigned defender) {
+	attacks.push_back(Attack{from, to, (uint8_t)attacker, (uint8_t)defender});
+}
+
+void Combat::resolve(World &world, std::pmr::vector<Handle> &dead) {
+	for (const Attack &a : attacks) {
+		Alive *from = dynamic_cast<Alive*>(world.get(a.from));
+		Alive *to = dynamic_cast<Alive*>(world.get(a.to));
+
+		// dead units that are not buried yet have no hp left
+		if (!from || !to || !from->hp || !to->hp)
+			continue;
+
+		unsigned acc = stats::unit_accuracy[a.attacker];
+
+		if (acc < 100 && world.lcg.next(99) >= acc)
+			continue;
+
+		*to -= stats::damage[a.attacker * stats::defender_types + a.defender];
+
+		if (!to->hp)
+			dead.push_back(a.to);
+	}
+
+	attacks.clear();
+}
+
+}
+
+}
@@ -0,0 +1,68 @@
+/* Copyright 2016-2020 the Age of Empires Free Software Remake authors. See LEGAL for legal info */
+
+#pragma once
+
+/*
+ * Combat resolution.
+ *
+ * Attacks are not applied when a unit swings, but queued in one flat list that is
+ * resolved in a single pass at the end of the movement phase. Damage only depends on
+ * the attacker and defender type, so it is looked up in a table that is computed at
+ * compile time (see stats.hpp).
+ * Everything that dies is collected, so the world can remove it in bulk afterwards.
+ */
+
+#include "handle.hpp"
+#include "math.hpp"
+
+#include <cstddef>
+#include <cstdint>
+
+#include <memory_resource>
+#include <vector>
+
+namespace genie {
+
+namespace game {
+
+class World;
+
+enum class UnitType;
+enum class BuildingType;
+
+class Combat final {
+public:
+	struct Attack final {
+		Handle from, to;
+		uint8_t attacker, defender; /**< row and column in the damage table */
+	};
+private:
+	std::vector<Attack> attacks; /**< all attacks that land this tick */
+public:
+	Combat();
+
+	/** Column in the damage table for units and buildings. */
+	static unsigned defender(UnitType type) noexcept;
+	static unsigned defender(BuildingType type) noexcept;
+
+	/** Time between attacks in ticks. */
+	static unsigned reload(UnitType type) noexcept;
+	/** Maximum distance in tiles between the edges of the attacker and defender. */
+	static Fixed range(UnitType type) noexcept;
+
+	unsigned damage(UnitType attacker, unsigned defender) const noexcept;
+
+	/** Land an attack this tick. Attacks are resolved in the order they have been queued. */
+	void queue(Handle from, UnitType attacker, Handle to, unsigned defender);
+	size_t pending() const noexcept { return attacks.size(); }
+
+	/**
+	 * Apply all queued attacks. Attacks from or against anything that has died before
+	 * it lands are dropped. Handles to everything that dies are appended to \a dead.
+	 */
+	void resolve(World &world, std::pmr::vector<Handle> &dead);
+};
+
+}
+
+}
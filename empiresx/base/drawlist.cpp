@@ -0,0 +1,156 @@
+/* Copyright 2016-2020 the Age of Empires Free Software Remake authors. See LEGAL for legal info */
+
+#include "drawlist.hpp"
+
+#include "world.hpp"
+
+#include <cmath>
+
+namespace genie {
+
+namespace game {
+
+static bool depth_less(const DrawList::Entry &lhs, const DrawList::Entry &rhs) {
+	return lhs.depth < rhs.depth;
+}
+
+DrawList::DrawList(const Map &map)
+	: left(0), top(0), cols(1), rows(1), bcols(1), blocks(), slots(), epoch(0), revision(0), tick(0)
+	, count(0), changed(0), max_w(0), max_h(0), merged()
+{
+	// corners of the map on screen, plus a cell for anything that sticks out.
+	// tile (0,0) is on the left, (0,h) at the top, (w,0) at the bottom and (w,h) on the right.
+	float x0, y0, x1, y1, x2, y2, x3, y3;
+	tile_to_scr(x0, y0, 0.0f, 0.0f);
+	tile_to_scr(x1, y1, 0.0f, (float)map.h);
+	tile_to_scr(x2, y2, (float)map.w, 0.0f);
+	tile_to_scr(x3, y3, (float)map.w, (float)map.h);
+
+	left = std::floor(x0 / cell_w) * cell_w - cell_w;
+	top = std::floor(y1 / cell_h) * cell_h - cell_h;
+	cols = (unsigned)((x3 - left) / cell_w) + 2;
+	rows = (unsigned)((y2 - top) / cell_h) + 2;
+	bcols = (cols + block_size - 1) >> block_bits;
+	blocks.resize((size_t)((rows + block_size - 1) >> block_bits) * bcols);
+}
+
+std::vector<DrawList::Entry> &DrawList::at(uint32_t cell) {
+	unsigned r = cell / cols, c = cell % cols;
+	std::unique_ptr<Block> &b = blocks[(size_t)(r >> block_bits) * bcols + (c >> block_bits)];
+
+	if (!b)
+		b.reset(new Block());
+
+	return b->cells[(r & (block_size - 1)) * block_size + (c & (block_size - 1))];
+}
+
+unsigned DrawList::col(float x) const noexcept {
+	float c = (x - left) / cell_w;
+	return c <= 0 ? 0 : std::min((unsigned)c, cols - 1);
+}
+
+unsigned DrawList::row(float y) const noexcept {
+	float r = (y - top) / cell_h;
+	return r <= 0 ? 0 : std::min((unsigned)r, rows - 1);
+}
+
+void DrawList::insert(uint32_t cell, const Entry &e) {
+	std::vector<Entry> &v = at(cell);
+	v.insert(std::upper_bound(v.begin(), v.end(), e, depth_less), e);
+}
+
+void DrawList::erase(const Slot &s) {
+	std::vector<Entry> &v = at(s.cell);
+	v.erase(std::find_if(v.begin(), v.end(), [&s](const Entry &e) { return e.handle == s.e.handle; }));
+}
+
+void DrawList::place(const Particle &p, bool dynamic) {
+	Handle h = p.gethandle();
+	Entry e{p.scr.top + p.hotspot_y, p.scr, h, p.pos.left.floor(), p.pos.top.floor(), dynamic};
+
+	if (h.index >= slots.size())
+		slots.resize(h.index + 1, Slot{Entry{0, Box2<float>(), Handle(), 0, 0, false}, 0, 0});
+
+	Slot &s = slots[h.index];
+	s.seen = epoch;
+
+	// most units have not moved at all, so check that before looking at the cell
+	if (s.e.handle == h && s.e.depth == e.depth && s.e.x == e.x && s.e.y == e.y
+		&& s.e.scr.left == e.scr.left && s.e.scr.top == e.scr.top && s.e.scr.w == e.scr.w && s.e.scr.h == e.scr.h)
+		return;
+
+	uint32_t cell = row(e.depth) * cols + col(e.scr.left);
+	max_w = std::max(max_w, e.scr.w);
+	max_h = std::max(max_h, std::max(e.scr.h, std::fabs((float)p.hotspot_y)));
+	++changed;
+
+	if (s.e.handle == h && s.cell == cell) {
+		// still the same cell, so just shift it to its new place
+		std::vector<Entry> &v = at(cell);
+		auto it = std::find_if(v.begin(), v.end(), [h](const Entry &x) { return x.handle == h; });
+		*it = e;
+
+		while (it != v.begin() && depth_less(*it, *(it - 1))) {
+			std::iter_swap(it, it - 1);
+			--it;
+		}
+
+		while (it + 1 != v.end() && depth_less(*(it + 1), *it)) {
+			std::iter_swap(it, it + 1);
+			++it;
+		}
+	} else {
+		// either it has moved to another cell or the slot has been used by something that is gone now
+		if (s.e.handle)
+			erase(s);
+		else
+			++count;
+
+		insert(cell, e);
+		s.cell = cell;
+	}
+
+	s.e = e;
+}
+
+void DrawList::sync(const World &world) {
+	uint64_t now = world.timers.now();
+	bool all = !epoch || revision != world.revision || now - tick > 1;
+
+	revision = world.revision;
+	tick = now;
+	changed = 0;
+
+	if (!all) {
+		for (const Unit *u : world.active)
+			place(*u, true);
+
+		return;
+	}
+
+	++epoch;
+
+	for (const ArenaPtr<StaticResource> &r : world.static_res)
+		place(*r, false);
+
+	for (const ArenaPtr<Building> &b : world.buildings)
+		place(*b, false);
+
+	for (const ArenaPtr<Unit> &u : world.units)
+		place(*u, true);
+
+	if (count == world.static_res.size() + world.buildings.size() + world.units.size())
+		return;
+
+	for (Slot &s : slots)
+		if (s.e.handle && s.seen != epoch) {
+			erase(s);
+			s.e.handle = Handle();
+			--count;
+			++changed;
+		}
+}
+
+}
+
+}
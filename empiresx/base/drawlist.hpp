@@ -0,0 +1,136 @@
+/* Copyright 2016-2020 the Age of Empires Free Software Remake authors. See LEGAL for legal info */
+
+#pragma once
+
+/*
+ * Persistent drawing order for everything on the map.
+ *
+ * Particles are bucketed in screen space: rows of cell_h pixels of depth and columns of
+ * cell_w pixels. Each cell is ordered by depth. Units only move while they are awake and
+ * stay awake for at least one tick after they have moved, so every frame sync only has
+ * to compare the awake units with what has been recorded for them. Since units move by a
+ * few pixels per tick, they mostly stay in the same cell and just shift a bit. Everything
+ * is only looked at again once something has been added or removed or if more than one
+ * tick has passed since the last sync.
+ *
+ * A query only walks the cells that overlap the view. Rows are already in drawing order,
+ * so the cells of one row just have to be merged. Scrolling does not change the buckets
+ * at all; it only changes which cells are walked.
+ *
+ * Cells are allocated in blocks once something is placed in them, so huge maps only
+ * cost memory where there is something to draw.
+ */
+
+#include "handle.hpp"
+#include "geom.hpp"
+
+#include <cstddef>
+#include <cstdint>
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+namespace genie {
+
+namespace game {
+
+class Map;
+class Particle;
+class World;
+
+class DrawList final {
+public:
+	struct Entry final {
+		float depth; /**< smaller is drawn first */
+		Box2<float> scr;
+		Handle handle;
+		int32_t x, y; /**< tile, for the fog of war */
+		bool dynamic; /**< units are hidden once they are out of sight, everything else stays once explored */
+	};
+
+	static constexpr float cell_w = 256, cell_h = 64;
+	static constexpr unsigned block_bits = 4, block_size = 1u << block_bits;
+private:
+	struct Block final {
+		std::vector<Entry> cells[block_size * block_size];
+	};
+
+	struct Slot final {
+		Entry e; /**< that is recorded for this handle index. e.handle is invalid if there is none */
+		uint32_t cell;
+		uint32_t seen; /**< epoch of the last sync that has looked at everything and found it */
+	};
+
+	float left, top; /**< screen position of the first cell */
+	unsigned cols, rows;
+	unsigned bcols; /**< number of blocks per row of blocks */
+	std::vector<std::unique_ptr<Block>> blocks; /**< y,x order. nullptr if nothing has been placed in it yet */
+	std::vector<Slot> slots; /**< indexed by handle index */
+	uint32_t epoch; /**< of the last sync that has looked at everything */
+	uint32_t revision; /**< of the world at the last sync */
+	uint64_t tick; /**< of the world at the last sync */
+	size_t count, changed;
+	float max_w, max_h; /**< largest particle and hotspot so far, so queries know how far entries may reach out of their cell */
+	std::vector<Entry> merged; /**< scratch for query */
+public:
+	explicit DrawList(const Map &map);
+
+	/** Pick up everything that has been added, moved or removed since the last sync. */
+	void sync(const World &world);
+
+	/** Number of particles. */
+	size_t size() const noexcept { return count; }
+	/** Particles that have been added, moved or removed in the last sync. */
+	size_t moved() const noexcept { return changed; }
+
+	/** Call \a fn for every entry that intersects \a bounds, in drawing order. */
+	template<typename F> void query(const Box2<float> &bounds, F fn) {
+		unsigned c0 = col(bounds.left - max_w), c1 = col(bounds.right());
+		unsigned r0 = row(bounds.top - max_h), r1 = row(bounds.bottom() + max_h);
+
+		for (unsigned r = r0; r <= r1; ++r) {
+			merged.clear();
+
+			for (unsigned c = c0; c <= c1; ++c) {
+				const std::vector<Entry> *v = find(r, c);
+
+				if (!v)
+					continue;
+
+				size_t mid = merged.size();
+
+				for (const Entry &e : *v)
+					if (bounds.intersects(e.scr))
+						merged.emplace_back(e);
+
+				std::inplace_merge(merged.begin(), merged.begin() + mid, merged.end(), [](const Entry &lhs, const Entry &rhs) {
+					return lhs.depth < rhs.depth;
+				});
+			}
+
+			for (const Entry &e : merged)
+				fn(e);
+		}
+	}
+private:
+	unsigned col(float x) const noexcept;
+	unsigned row(float y) const noexcept;
+
+	/** Cell at row \a r and column \a c or nullptr if its block has not been allocated. */
+	const std::vector<Entry> *find(unsigned r, unsigned c) const noexcept {
+		const Block *b = blocks[(size_t)(r >> block_bits) * bcols + (c >> block_bits)].get();
+		return b ? &b->cells[(r & (block_size - 1)) * block_size + (c & (block_size - 1))] : nullptr;
+	}
+
+	/** Cell with index \a cell. Its block is allocated if necessary. */
+	std::vector<Entry> &at(uint32_t cell);
+
+	void place(const Particle &p, bool dynamic);
+	void insert(uint32_t cell, const Entry &e);
+	void erase(const Slot &s);
+};
+
+}
+
+}
@@ -0,0 +1,87 @@
+/* Copyright 2016-2020 the Age of Empires Free Software Remake authors. See LEGAL for legal info */
+
+#include "economy.hpp"
+
+#include "world.hpp"
+
+#include <algorithm>
+
+namespace genie {
+
+namespace game {
+
+/** Stockpile for every resource at the start of a random map. */
+static constexpr uint32_t start_stock = 200;
+
+// FIXME verify these
+static const unsigned gather_time[] = {
+	World::ticks_per_second * 5 / 2, // wood
+	World::ticks_per_second * 9 / 4, // food
+	World::ticks_per_second * 5 / 2, // gold
+	World::ticks_per_second * 5 / 2, // stone
+};
+
+/** Ticks between samples in the history. */
+static constexpr unsigned sample_ticks = World::ticks_per_second;
+
+/** Samples per player to make room for up front, so the history does not grow in the first hour. */
+static constexpr size_t reserve_samples = 60 * 60;
+
+Economy::Economy() : ledgers(), trips(), depleted(), series() {}
+
+void Economy::join(unsigned player) {
+	if (player < ledgers.size())
+		return;
+
+	Ledger l{};
+
+	for (unsigned i = 0; i < resource_types; ++i)
+		l.stock[i] = start_stock;
+
+	ledgers.resize(player + 1, l);
+	series.reserve(ledgers.size() * reserve_samples);
+}
+
+void Economy::restore(const Ledger *l, size_t n, const Sample *s, size_t m) {
+	ledgers.assign(l, l + n);
+	trips.clear();
+	depleted.clear();
+	series.reserve(std::max(m, n * reserve_samples));
+	series.assign(s, s + m);
+}
+
+unsigned Economy::gather_ticks(ResourceType type) noexcept {
+	return gather_time[(unsigned)type];
+}
+
+void Economy::drop(Handle who, unsigned player, ResourceType type, unsigned amount) {
+	trips.push_back(Trip{who, (uint16_t)player, (uint8_t)type, amount});
+}
+
+void Economy::deplete(Handle res) {
+	depleted.push_back(res);
+}
+
+void Economy::settle(uint64_t tick, std::pmr::vector<Handle> &gone) {
+	for (const Trip &t : trips) {
+		Ledger &l = ledgers[t.player];
+
+		l.stock[t.type] += t.amount;
+		l.gathered[t.type] += t.amount;
+	}
+
+	trips.clear();
+
+	gone.insert(gone.end(), depleted.begin(), depleted.end());
+	depleted.clear();
+
+	if (tick % sample_ticks)
+		return;
+
+	for (unsigned p = 0; p < ledgers.size(); ++p)
+		series.push_back(Sample{(uint32_t)tick, p, ledgers[p]});
+}
+
+}
+
+}
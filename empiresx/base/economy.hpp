@@ -0,0 +1,91 @@
+/* Copyright 2016-2020 the Age of Empires Free Software Remake authors. See LEGAL for legal info */
+
+#pragma once
+
+/*
+ * Resource accounting for all players.
+ *
+ * Every player has a ledger with its stockpile. Ledgers are stored next to each
+ * other, so scoring and the user interface can look at all of them at once.
+ * Villagers do not add to the stockpile themselves, but record a trip whenever
+ * they drop off what they carry. All trips of a tick are applied in one batch at
+ * the end of the tick, together with removing the resources that have run out.
+ */
+
+#include "handle.hpp"
+
+#include <cstddef>
+#include <cstdint>
+
+#include <memory_resource>
+#include <vector>
+
+namespace genie {
+
+namespace game {
+
+enum class ResourceType;
+
+class Economy final {
+public:
+	static constexpr unsigned resource_types = 4;
+	/** Maximum amount that a villager carries. */
+	static constexpr unsigned capacity = 10;
+
+	struct Ledger final {
+		uint32_t stock[resource_types]; /**< indexed by ResourceType */
+		uint32_t gathered[resource_types]; /**< everything that has been dropped off since the start */
+	};
+
+	/** Resources that have been dropped off by \a who. */
+	struct Trip final {
+		Handle who;
+		uint16_t player;
+		uint8_t type;
+		uint32_t amount;
+	};
+
+	/** Ledger of \a player at the end of \a tick. */
+	struct Sample final {
+		uint32_t tick;
+		uint32_t player;
+		Ledger ledger;
+	};
+private:
+	std::vector<Ledger> ledgers; /**< indexed by player */
+	std::vector<Trip> trips; /**< drop offs that land this tick */
+	std::vector<Handle> depleted; /**< resources that have run out this tick */
+	std::vector<Sample> series; /**< all players for every sample, oldest first */
+public:
+	Economy();
+
+	/** Make sure \a player has a ledger. New players start with the default stockpile. */
+	void join(unsigned player);
+	unsigned players() const noexcept { return (unsigned)ledgers.size(); }
+	const Ledger &ledger(unsigned player) const noexcept { return ledgers[player]; }
+
+	/** Time in ticks it takes to gather one unit of \a type. */
+	static unsigned gather_ticks(ResourceType type) noexcept;
+
+	/** Record that \a who has dropped off \a amount of \a type for \a player. It is added to the stockpile at the end of the tick. */
+	void drop(Handle who, unsigned player, ResourceType type, unsigned amount);
+	/** Remove \a res at the end of the tick. */
+	void deplete(Handle res);
+	size_t pending() const noexcept { return trips.size(); }
+
+	/**
+	 * Apply all trips of this tick and move the depleted resources to \a gone. A sample
+	 * for every player is added to the history once every second.
+	 */
+	void settle(uint64_t tick, std::pmr::vector<Handle> &gone);
+
+	/** Stockpiles of all players over time, ordered by tick and player. */
+	const std::vector<Sample> &history() const noexcept { return series; }
+
+	/** Replace all ledgers and the history, e.g. when a game is loaded. */
+	void restore(const Ledger *l, size_t n, const Sample *s, size_t m);
+};
+
+}
+
+}
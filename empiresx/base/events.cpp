@@ -0,0 +1,94 @@
+/* Copyright 2016-2020 the Age of Empires Free Software Remake authors. See LEGAL for legal info */
+
+#include "events.hpp"
+
+#include "world.hpp"
+
+namespace genie {
+
+namespace game {
+
+void GameEventBatch::reserve(size_t events, size_t units) {
+	this->units.reserve(units);
+	moves.reserve(events);
+	attacks.reserve(events);
+	gathers.reserve(events);
+	trains.reserve(events);
+}
+
+void GameEventBatch::clear() noexcept {
+	units.clear();
+	moves.clear();
+	attacks.clear();
+	gathers.clear();
+	trains.clear();
+}
+
+uint32_t GameEventBatch::add(const Handle *group, size_t n) {
+	uint32_t first = (uint32_t)units.size();
+	units.insert(units.end(), group, group + n);
+	return first;
+}
+
+GameEvents::GameEvents(size_t events, size_t units) : mut(), now(), next(), scratch() {
+	now.reserve(events, units);
+	next.reserve(events, units);
+	scratch.reserve(units);
+}
+
+void GameEvents::move(const Handle *group, size_t n, const Vector2x &to) {
+	std::lock_guard<std::mutex> lock(mut);
+	next.moves.push_back(MoveEvent{next.add(group, n), (uint32_t)n, {to.x.raw, to.y.raw}});
+}
+
+void GameEvents::attack(const Handle *group, size_t n, Handle target) {
+	std::lock_guard<std::mutex> lock(mut);
+	next.attacks.push_back(AttackEvent{next.add(group, n), (uint32_t)n, target});
+}
+
+void GameEvents::gather(const Handle *group, size_t n, Handle res) {
+	std::lock_guard<std::mutex> lock(mut);
+	next.gathers.push_back(GatherEvent{next.add(group, n), (uint32_t)n, res});
+}
+
+void GameEvents::train(Handle building, UnitType what) {
+	std::lock_guard<std::mutex> lock(mut);
+	next.trains.push_back(TrainEvent{building, (uint32_t)what});
+}
+
+void GameEvents::dbuf() {
+	now.clear();
+	std::lock_guard<std::mutex> lock(mut);
+	std::swap(now, next);
+}
+
+void GameEvents::apply(World &world) {
+	for (const MoveEvent &e : now.moves) {
+		scratch.assign(now.group(e.first), now.group(e.first) + e.count);
+		world.move(scratch, Vector2x(Fixed::from_raw(e.to[0]), Fixed::from_raw(e.to[1])));
+	}
+
+	for (const AttackEvent &e : now.attacks) {
+		scratch.assign(now.group(e.first), now.group(e.first) + e.count);
+		world.attack(scratch, e.target);
+	}
+
+	for (const GatherEvent &e : now.gathers) {
+		scratch.assign(now.group(e.first), now.group(e.first) + e.count);
+		world.gather(scratch, e.res);
+	}
+
+	for (const TrainEvent &e : now.trains) {
+		Building *b = dynamic_cast<Building*>(world.get(e.building));
+
+		// the building may have been destroyed since the order has been given
+		if (b)
+			b->train(world, (UnitType)e.what);
+	}
+
+	now.clear();
+}
+
+}
+
+}
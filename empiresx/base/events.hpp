@@ -0,0 +1,148 @@
+/* Copyright 2016-2020 the Age of Empires Free Software Remake authors. See LEGAL for legal info */
+
+#pragma once
+
+/*
+ * Orders that are collected during a frame and applied to the world in one go.
+ *
+ * Events are plain records that are stored per type in flat arrays, so applying them
+ * is a couple of tight loops instead of a virtual call per event. Groups of units are
+ * appended to one shared list and events refer to them by range. There are two
+ * batches: one that is being filled and one that is being applied. They are swapped
+ * rather than cleared, so once both have grown to the usual size of a frame, pushing
+ * events no longer allocates anything.
+ */
+
+#include "geom.hpp"
+#include "handle.hpp"
+
+#include <cstddef>
+#include <cstdint>
+
+#include <mutex>
+#include <type_traits>
+#include <vector>
+
+namespace genie {
+
+namespace game {
+
+class World;
+
+enum class UnitType;
+
+enum class GameEventType {
+	move,
+	attack,
+	gather,
+	train,
+	count,
+};
+
+struct MoveEvent final {
+	uint32_t first, count; /**< range in the units of the batch */
+	int32_t to[2]; /**< fixed point */
+};
+
+struct AttackEvent final {
+	uint32_t first, count;
+	Handle target;
+};
+
+struct GatherEvent final {
+	uint32_t first, count;
+	Handle res;
+};
+
+struct TrainEvent final {
+	Handle building;
+	uint32_t what; /**< UnitType */
+};
+
+static_assert(std::is_trivially_copyable<MoveEvent>::value && std::is_trivially_copyable<AttackEvent>::value
+	&& std::is_trivially_copyable<GatherEvent>::value && std::is_trivially_copyable<TrainEvent>::value, "events must be plain data");
+
+/** All events of one frame. */
+class GameEventBatch final {
+public:
+	std::vector<Handle> units; /**< groups of all events */
+	std::vector<MoveEvent> moves;
+	std::vector<AttackEvent> attacks;
+	std::vector<GatherEvent> gathers;
+	std::vector<TrainEvent> trains;
+
+	GameEventBatch() : units(), moves(), attacks(), gathers(), trains() {}
+
+	void reserve(size_t events, size_t units);
+	void clear() noexcept;
+
+	/** Number of events in all types. */
+	size_t size() const noexcept { return moves.size() + attacks.size() + gathers.size() + trains.size(); }
+
+	const Handle *group(uint32_t first) const noexcept { return units.data() + first; }
+	/** Append \a n units and return where they start. */
+	uint32_t add(const Handle *group, size_t n);
+
+	/**
+	 * Call \a fn for every event. Types are visited in GameEventType order and events of
+	 * the same type in the order they have been pushed. \a fn must be callable with
+	 * (const MoveEvent&, const Handle*) and so on for every type with a group and with
+	 * (const TrainEvent&) for trains.
+	 */
+	template<typename F> void each(F &&fn) const {
+		for (const MoveEvent &e : moves)
+			fn(e, group(e.first));
+		for (const AttackEvent &e : attacks)
+			fn(e, group(e.first));
+		for (const GatherEvent &e : gathers)
+			fn(e, group(e.first));
+		for (const TrainEvent &e : trains)
+			fn(e);
+	}
+};
+
+/**
+ * Double buffered events. Pushing is thread-safe, so the network thread can push orders
+ * while the game is painting or ticking. Everything else must be done by the thread
+ * that owns the world.
+ */
+class GameEvents final {
+	std::mutex mut;
+	GameEventBatch now, next;
+	std::vector<Handle> scratch; /**< group for World::move and friends */
+public:
+	static constexpr size_t default_events = 1024, default_units = 16 * 1024;
+
+	GameEvents(size_t events=default_events, size_t units=default_units);
+
+	/** Order \a n units in \a group to walk to \a to. */
+	void move(const Handle *group, size_t n, const Vector2x &to);
+	void attack(const Handle *group, size_t n, Handle target);
+	void gather(const Handle *group, size_t n, Handle res);
+	void train(Handle building, UnitType what);
+
+	/**
+	 * Make everything that has been pushed so far available. Anything pushed afterwards
+	 * waits for the next dbuf and anything that has not been applied yet is dropped.
+	 */
+	void dbuf();
+
+	/** Events that are made available by the last dbuf. */
+	const GameEventBatch &batch() const noexcept { return now; }
+
+	/**
+	 * Apply all available events to \a world. Since types are applied in GameEventType order,
+	 * a unit that gets multiple orders in one frame ends up with the order that comes last
+	 * in that order rather than the order that has been pushed last.
+	 */
+	void apply(World &world);
+
+	void idle(World &world) {
+		dbuf();
+		apply(world);
+	}
+};
+
+}
+
+}
@@ -0,0 +1,236 @@
+/* Copyright 2016-2020 the Age of Empires Free Software Remake authors. See LEGAL for legal info */
+
+#include "flow.hpp"
+
+#include "world.hpp"
+
+#include <climits>
+
+#include <algorithm>
+#include <functional>
+#include <utility>
+#include <vector>
+
+namespace genie {
+
+namespace game {
+
+// same cost model as the path finder
+static constexpr uint32_t cost_straight = 10, cost_diagonal = 14;
+
+static const int dir_dx[] = {1, 0, -1, 0, 1, -1, -1, 1};
+static const int dir_dy[] = {0, 1, 0, -1, 1, 1, -1, -1};
+
+FlowField::FlowField(const Map &map, const Vector2<int> &dest, const Box2<int> &area)
+	: dest(dest), cost(new uint32_t[(size_t)area.w * area.h]), dir(new uint8_t[(size_t)area.w * area.h])
+	, area(area), dirty(true)
+{
+	compute(map);
+}
+
+FlowField::FlowField(const Vector2<int> &dest, const Box2<int> &area, const uint32_t *cost, const uint8_t *dir, bool dirty)
+	: dest(dest), cost(new uint32_t[(size_t)area.w * area.h]), dir(new uint8_t[(size_t)area.w * area.h])
+	, area(area), dirty(dirty)
+{
+	std::copy(cost, cost + (size_t)area.w * area.h, this->cost.get());
+	std::copy(dir, dir + (size_t)area.w * area.h, this->dir.get());
+}
+
+void FlowField::resize(const Box2<int> &area) {
+	cost.reset(new uint32_t[(size_t)area.w * area.h]);
+	dir.reset(new uint8_t[(size_t)area.w * area.h]);
+	this->area = area;
+	dirty = true;
+}
+
+static bool walkable(const Map &map, const Box2<int> &area, int x, int y, unsigned d) {
+	if (!area.contains(Vector2<int>(x + dir_dx[d], y + dir_dy[d])) || !map.passable(x + dir_dx[d], y + dir_dy[d]))
+		return false;
+
+	// do not cut corners of blocked tiles
+	return d < 4 || (map.passable(x, y + dir_dy[d]) && map.passable(x + dir_dx[d], y));
+}
+
+void FlowField::compute(const Map &map) {
+	unsigned w = (unsigned)area.w, h = (unsigned)area.h;
+	size_t size = (size_t)w * h;
+
+	std::fill(cost.get(), cost.get() + size, UINT32_MAX);
+	std::fill(dir.get(), dir.get() + size, unreachable);
+	dirty = false;
+
+	if (!area.contains(dest) || !map.passable(dest.x, dest.y))
+		return;
+
+	// integration field: dijkstra from the destination
+	typedef std::pair<uint32_t, uint32_t> Item;
+	std::vector<Item> open;
+	uint32_t start = (uint32_t)((dest.y - area.top) * (int)w + dest.x - area.left);
+
+	cost[start] = 0;
+	open.emplace_back(0, start);
+
+	while (!open.empty()) {
+		std::pop_heap(open.begin(), open.end(), std::greater<Item>());
+		Item item = open.back();
+		open.pop_back();
+
+		uint32_t i = item.second;
+		if (item.first != cost[i])
+			continue;
+
+		int x = area.left + (int)(i % w), y = area.top + (int)(i / w);
+
+		for (unsigned d = 0; d < 8; ++d) {
+			if (!walkable(map, area, x, y, d))
+				continue;
+
+			uint32_t n = (uint32_t)(i + dir_dy[d] * (int)w + dir_dx[d]);
+			uint32_t c = item.first + (d >= 4 ? cost_diagonal : cost_straight);
+
+			if (c >= cost[n])
+				continue;
+
+			cost[n] = c;
+			open.emplace_back(c, n);
+			std::push_heap(open.begin(), open.end(), std::greater<Item>());
+		}
+	}
+
+	// direction field: walk to the cheapest neighbour
+	for (unsigned y = 0; y < h; ++y)
+		for (unsigned x = 0; x < w; ++x) {
+			size_t i = y * w + x;
+
+			if (cost[i] == UINT32_MAX)
+				continue;
+
+			if (!cost[i]) {
+				dir[i] = arrived;
+				continue;
+			}
+
+			uint32_t best = cost[i];
+
+			for (unsigned d = 0; d < 8; ++d) {
+				if (!walkable(map, area, area.left + (int)x, area.top + (int)y, d))
+					continue;
+
+				uint32_t c = cost[(y + dir_dy[d]) * w + x + dir_dx[d]];
+
+				if (c < best) {
+					best = c;
+					dir[i] = (uint8_t)d;
+				}
+			}
+		}
+}
+
+bool FlowField::affected(int left, int top, unsigned w, unsigned h) const noexcept {
+	// everything is unreachable while the destination is blocked
+	if (dest.x >= left && dest.y >= top && dest.x < left + (int)w && dest.y < top + (int)h)
+		return true;
+
+	// a blocked tile only matters if it could be reached and a freed one if one of its
+	// neighbours could be reached. this includes the corners that can be cut now.
+	int x0 = std::max(left - 1, area.left), y0 = std::max(top - 1, area.top);
+	int x1 = std::min(left + (int)w + 1, area.right()), y1 = std::min(top + (int)h + 1, area.bottom());
+
+	for (int y = y0; y < y1; ++y)
+		for (int x = x0; x < x1; ++x)
+			if (cost[(size_t)(y - area.top) * area.w + (x - area.left)] != UINT32_MAX)
+				return true;
+
+	return false;
+}
+
+bool FlowField::next(Vector2<int> &to, const Vector2<int> &pos) const noexcept {
+	if (!area.contains(pos))
+		return false;
+
+	uint8_t d = dir[(size_t)(pos.y - area.top) * area.w + (pos.x - area.left)];
+	if (d >= arrived)
+		return false;
+
+	to = Vector2<int>(pos.x + dir_dx[d], pos.y + dir_dy[d]);
+	return true;
+}
+
+bool FlowField::reaches(const Vector2<int> &pos) const noexcept {
+	return area.contains(pos) && dir[(size_t)(pos.y - area.top) * area.w + (pos.x - area.left)] != unreachable;
+}
+
+std::shared_ptr<FlowField> FlowFieldCache::get(const Vector2<int> &dest, const Box2<int> &tiles) {
+	uint32_t key = (uint32_t)dest.y * map.w + (uint32_t)dest.x;
+	auto search = fields.find(key);
+
+	// cover the units, the destination and some room to walk around obstacles
+	int left = std::max(std::min(tiles.left, dest.x) - FlowField::margin, 0);
+	int top = std::max(std::min(tiles.top, dest.y) - FlowField::margin, 0);
+	int right = std::min(std::max(tiles.right(), dest.x + 1) + FlowField::margin, (int)map.w);
+	int bottom = std::min(std::max(tiles.bottom(), dest.y + 1) + FlowField::margin, (int)map.h);
+
+	if (search != fields.end()) {
+		FlowField &f = *search->second;
+		const Box2<int> &a = f.area;
+
+		// grow the field if the units are not covered yet
+		if (left < a.left || top < a.top || right > a.right() || bottom > a.bottom()) {
+			left = std::min(left, a.left);
+			top = std::min(top, a.top);
+			right = std::max(right, a.right());
+			bottom = std::max(bottom, a.bottom());
+
+			if ((size_t)(right - left) * (bottom - top) > FlowField::max_tiles)
+				return nullptr;
+
+			f.resize(Box2<int>(left, top, right - left, bottom - top));
+		}
+
+		if (f.dirty)
+			f.compute(map);
+		return search->second;
+	}
+
+	Box2<int> area(left, top, right - left, bottom - top);
+
+	if ((size_t)area.w * area.h > FlowField::max_tiles)
+		return nullptr;
+
+	return fields.emplace(key, std::make_shared<FlowField>(map, dest, area)).first->second;
+}
+
+void FlowFieldCache::restore(const std::shared_ptr<FlowField> &field) {
+	fields[(uint32_t)field->dest.y * map.w + (uint32_t)field->dest.x] = field;
+}
+
+void FlowFieldCache::invalidate(int left, int top, unsigned w, unsigned h) {
+	Box2<int> tiles(left, top, (int)w, (int)h);
+	invalidate(&tiles, 1);
+}
+
+void FlowFieldCache::invalidate(const Box2<int> *tiles, size_t count) {
+	for (auto &x : fields)
+		for (size_t i = 0; i < count && !x.second->dirty; ++i)
+			if (x.second->affected(tiles[i].left, tiles[i].top, (unsigned)tiles[i].w, (unsigned)tiles[i].h))
+				x.second->dirty = true;
+}
+
+void FlowFieldCache::update() {
+	for (auto it = fields.begin(); it != fields.end();) {
+		// the cache itself holds one reference
+		if (it->second.use_count() == 1) {
+			it = fields.erase(it);
+			continue;
+		}
+
+		if (it->second->dirty)
+			it->second->compute(map);
+
+		++it;
+	}
+}
+
+}
+
+}
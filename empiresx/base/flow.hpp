@@ -0,0 +1,108 @@
+/* Copyright 2016-2020 the Age of Empires Free Software Remake authors. See LEGAL for legal info */
+
+#pragma once
+
+/*
+ * Flow fields for group movement. Instead of searching a path for every unit that
+ * is ordered to the same destination, one field is computed that tells every tile
+ * which way to go. This costs O(area) once instead of one search per unit.
+ *
+ * A field only covers the tiles around the group and its destination, so its size
+ * does not depend on the size of the map. Groups that are too spread out for that
+ * get a path for every unit instead.
+ */
+
+#include "geom.hpp"
+
+#include <cstddef>
+#include <cstdint>
+
+#include <map>
+#include <memory>
+
+namespace genie {
+
+namespace game {
+
+class Map;
+
+class FlowField final {
+public:
+	static constexpr uint8_t arrived = 8; /**< direction for the destination itself */
+	static constexpr uint8_t unreachable = 9;
+	/** Tiles around the group and destination to walk around obstacles. */
+	static constexpr int margin = 32;
+	/** Largest number of tiles a field may cover. */
+	static constexpr size_t max_tiles = 1u << 20;
+
+	const Vector2<int> dest;
+private:
+	std::unique_ptr<uint32_t[]> cost; /**< integration field: walking distance to dest */
+	std::unique_ptr<uint8_t[]> dir; /**< direction field: neighbour that is closest to dest */
+	Box2<int> area; /**< tiles that are covered */
+	bool dirty;
+
+	friend class FlowFieldCache;
+public:
+	FlowField(const Map &map, const Vector2<int> &dest, const Box2<int> &area);
+	/** Field with precomputed values, e.g. from a save game. */
+	FlowField(const Vector2<int> &dest, const Box2<int> &area, const uint32_t *cost, const uint8_t *dir, bool dirty);
+
+	/** Raw fields in y,x order relative to bounds(), e.g. for save games. */
+	const uint32_t *costs() const noexcept { return cost.get(); }
+	const uint8_t *directions() const noexcept { return dir.get(); }
+	const Box2<int> &bounds() const noexcept { return area; }
+	/** Whether the field is waiting to be recomputed at the end of the tick. */
+	bool stale() const noexcept { return dirty; }
+
+	/** Recompute both fields, e.g. after the map has been changed. */
+	void compute(const Map &map);
+	/** Whether (un)blocking the specified tiles can change the field. */
+	bool affected(int left, int top, unsigned w, unsigned h) const noexcept;
+
+	/** Determine next tile to walk to from \a pos. Returns false if \a pos is the destination or cannot reach it. */
+	bool next(Vector2<int> &to, const Vector2<int> &pos) const noexcept;
+	/** Whether \a pos is covered and can reach the destination within the field. */
+	bool reaches(const Vector2<int> &pos) const noexcept;
+private:
+	/** Cover \a area instead and recompute on the next update. */
+	void resize(const Box2<int> &area);
+};
+
+/**
+ * Shared flow fields per destination. Units keep a reference to the field they are
+ * following and the field is dropped once no unit uses it anymore.
+ */
+class FlowFieldCache final {
+	const Map &map;
+	std::map<uint32_t, std::shared_ptr<FlowField>> fields;
+public:
+	FlowFieldCache(const Map &map) : map(map), fields() {}
+
+	/**
+	 * Return the field for \a dest that covers at least \a tiles. It is computed if nobody
+	 * is using it yet or if it has to cover more tiles. Returns nullptr if it would get
+	 * bigger than FlowField::max_tiles.
+	 */
+	std::shared_ptr<FlowField> get(const Vector2<int> &dest, const Box2<int> &tiles);
+	/** Add \a field as is, e.g. when a game is loaded. */
+	void restore(const std::shared_ptr<FlowField> &field);
+	/** Call \a fn for every field in a fixed order. */
+	template<typename F> void each(F fn) const {
+		for (auto &x : fields)
+			fn(x.second);
+	}
+
+	/** Mark the fields stale that depend on the specified tiles, e.g. when a building has been placed. */
+	void invalidate(int left, int top, unsigned w, unsigned h);
+	/** Same as above, but for \a count rectangles at once. */
+	void invalidate(const Box2<int> *tiles, size_t count);
+	/** Recompute stale fields and drop unused ones. */
+	void update();
+
+	size_t size() const noexcept { return fields.size(); }
+};
+
+}
+
+}
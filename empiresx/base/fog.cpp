@@ -0,0 +1,224 @@
+/* Copyright 2016-2020 the Age of Empires Free Software Remake authors. See LEGAL for legal info */
+
+#include "fog.hpp"
+
+#include "math.hpp"
+
+#include <algorithm>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+
+namespace genie {
+
+namespace game {
+
+/** Half width of every row of a circular line of sight for each radius. */
+struct LosMasks final {
+	uint8_t half[FogOfWar::max_los + 1][2 * FogOfWar::max_los + 1];
+};
+
+static constexpr LosMasks make_los_masks() {
+	LosMasks m{};
+
+	for (unsigned r = 0; r <= FogOfWar::max_los; ++r)
+		for (int dy = -(int)r; dy <= (int)r; ++dy)
+			// r * (r + 1) is close to (r + 0.5)^2, which looks rounder than r^2
+			m.half[r][dy + r] = (uint8_t)isqrt((uint64_t)(r * (r + 1) - dy * dy));
+
+	return m;
+}
+
+static constexpr LosMasks los_masks = make_los_masks();
+
+/** Word with bits [x0, x1] set. */
+static constexpr uint64_t span(unsigned x0, unsigned x1) {
+	return (~UINT64_C(0) << x0) & (~UINT64_C(0) >> (63 - x1));
+}
+
+static_assert(FogOfWar::chunk_size == 64, "one word per chunk row");
+static_assert(2 * FogOfWar::max_los + 1 <= 2 * FogOfWar::chunk_size, "line of sight spans at most three chunks");
+
+FogOfWar::FogOfWar(unsigned w, unsigned h)
+	: w(w), h(h), cw((w + chunk_size - 1) >> chunk_bits), ch((h + chunk_size - 1) >> chunk_bits), sources(), layers() {}
+
+FogOfWar::Layer &FogOfWar::layer(unsigned player) {
+	while (layers.size() <= player)
+		layers.push_back(Layer{std::vector<std::unique_ptr<Chunk>>((size_t)cw * ch), {}, false, false});
+
+	return layers[player];
+}
+
+FogOfWar::Chunk &FogOfWar::chunk(Layer &l, unsigned cx, unsigned cy) {
+	std::unique_ptr<Chunk> &c = l.chunks[(size_t)cy * cw + cx];
+
+	if (!c)
+		c.reset(new Chunk{});
+
+	return *c;
+}
+
+size_t FogOfWar::allocated() const noexcept {
+	size_t n = 0;
+
+	for (const Layer &l : layers)
+		n += std::count_if(l.chunks.begin(), l.chunks.end(), [](const std::unique_ptr<Chunk> &c) { return c != nullptr; });
+
+	return n;
+}
+
+FogOfWar::Span FogOfWar::extent(int x, int y, unsigned los) const noexcept {
+	int r = (int)los;
+	int x0 = std::max(x - r, 0), x1 = std::min(x + r, (int)w - 1);
+	int y0 = std::max(y - r, 0), y1 = std::min(y + r, (int)h - 1);
+
+	// nothing to see off the map
+	if (x0 > x1 || y0 > y1)
+		return Span{1, 1, 0, 0};
+
+	return Span{(unsigned)x0 >> chunk_bits, (unsigned)y0 >> chunk_bits, (unsigned)x1 >> chunk_bits, (unsigned)y1 >> chunk_bits};
+}
+
+/** Call \a fn for all chunks in \a s. */
+template<typename S, typename F> static void chunks(const S &s, F fn) {
+	for (unsigned cy = s.cy0; cy <= s.cy1; ++cy)
+		for (unsigned cx = s.cx0; cx <= s.cx1; ++cx)
+			fn(cx, cy);
+}
+
+void FogOfWar::mark(unsigned player, const Span &s) {
+	Layer &l = layer(player);
+
+	chunks(s, [&](unsigned cx, unsigned cy) {
+		Chunk &c = chunk(l, cx, cy);
+
+		if (!c.dirty) {
+			c.dirty = true;
+			l.dirty.emplace_back(cy * cw + cx);
+		}
+	});
+}
+
+void FogOfWar::link(unsigned player, const Span &s, uint32_t index) {
+	Layer &l = layer(player);
+
+	chunks(s, [&](unsigned cx, unsigned cy) {
+		chunk(l, cx, cy).sources.push_back(index);
+	});
+}
+
+void FogOfWar::unlink(unsigned player, const Span &s, uint32_t index) {
+	Layer &l = layer(player);
+
+	chunks(s, [&](unsigned cx, unsigned cy) {
+		std::vector<uint32_t> &v = chunk(l, cx, cy).sources;
+		auto it = std::find(v.begin(), v.end(), index);
+
+		// the order does not matter, since all sources are or'ed together
+		*it = v.back();
+		v.pop_back();
+	});
+}
+
+void FogOfWar::stamp(uint64_t *rows, unsigned cx, unsigned cy, int x, int y, unsigned los) {
+	int r = (int)los;
+	int left = (int)(cx << chunk_bits), top = (int)(cy << chunk_bits);
+	int right = std::min(left + (int)chunk_size, (int)w) - 1;
+
+	for (int ty = std::max(y - r, top), end = std::min({y + r, top + (int)chunk_size - 1, (int)h - 1}); ty <= end; ++ty) {
+		int half = los_masks.half[los][ty - y + r];
+		int x0 = std::max(x - half, left), x1 = std::min(x + half, right);
+
+		if (x0 <= x1)
+			rows[ty - top] |= span((unsigned)(x0 - left), (unsigned)(x1 - left));
+	}
+}
+
+void FogOfWar::see(Handle h, unsigned player, int x, int y, unsigned los) {
+	if (los > max_los)
+		throw std::runtime_error(std::string("fog: line of sight too large: ") + std::to_string(los));
+
+	if (sources.size() <= h.index)
+		sources.resize(h.index + 1, Source{0, 0, 0, 0, 0});
+
+	Source &s = sources[h.index];
+
+	if (s.generation == h.generation && s.player == player && s.x == x && s.y == y && s.los == los)
+		return;
+
+	Span to(extent(x, y, los));
+	bool linked = false;
+
+	if (s.generation) {
+		Span from(extent(s.x, s.y, s.los));
+		mark(s.player, from);
+
+		// most moves stay within the same chunks
+		if (s.player == player && from == to)
+			linked = true;
+		else
+			unlink(s.player, from, h.index);
+	}
+
+	s = Source{h.generation, player, x, y, los};
+	mark(player, to);
+
+	if (!linked)
+		link(player, to, h.index);
+
+	Layer &l = layer(player);
+
+	chunks(to, [&](unsigned cx, unsigned cy) {
+		stamp(chunk(l, cx, cy).explored, cx, cy, x, y, los);
+	});
+}
+
+void FogOfWar::forget(Handle h) {
+	if (h.index >= sources.size() || sources[h.index].generation != h.generation)
+		return;
+
+	Source &s = sources[h.index];
+	Span from(extent(s.x, s.y, s.los));
+
+	mark(s.player, from);
+	unlink(s.player, from, h.index);
+	s.generation = 0;
+}
+
+void FogOfWar::update() {
+	for (unsigned p = 0; p < layers.size(); ++p) {
+		Layer &l = layers[p];
+
+		if (l.dirty.empty())
+			continue;
+
+		// only the sources that overlap a dirty chunk have to be stamped again
+		for (uint32_t i : l.dirty) {
+			Chunk &c = *l.chunks[i];
+			unsigned cx = i % cw, cy = i / cw;
+
+			std::fill(std::begin(c.visible), std::end(c.visible), 0);
+
+			for (uint32_t index : c.sources) {
+				const Source &s = sources[index];
+				stamp(c.visible, cx, cy, s.x, s.y, s.los);
+			}
+
+			c.dirty = false;
+		}
+
+		l.dirty.clear();
+	}
+}
+
+void FogOfWar::reveal(unsigned player) {
+	layer(player).revealed = true;
+}
+
+void FogOfWar::no_fog(unsigned player, bool enable) {
+	layer(player).no_fog = enable;
+}
+
+}
+
+}
@@ -0,0 +1,158 @@
+/* Copyright 2016-2020 the Age of Empires Free Software Remake authors. See LEGAL for legal info */
+
+#pragma once
+
+/*
+ * Fog of war: which tiles each player has explored and can currently see.
+ *
+ * Both are bitsets with one bit per tile, split in chunks of 64x64 tiles so that every
+ * row of a chunk is one word. Chunks are only allocated once a player has seen some
+ * of it, so the memory used scales with the explored area rather than the map size.
+ * Only sources that have moved to another tile or whose line of sight has changed
+ * mark the chunks they cover as dirty, and only those chunks are recomputed in
+ * update(). Every chunk keeps a list of the sources that overlap it, so recomputing a
+ * chunk only looks at the sources nearby.
+ */
+
+#include "handle.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <climits>
+
+#include <memory>
+#include <vector>
+
+namespace genie {
+
+namespace game {
+
+class FogOfWar final {
+public:
+	static constexpr unsigned max_los = 32;
+	static constexpr unsigned chunk_bits = 6, chunk_size = 1 << chunk_bits;
+	/** Player that sees the whole map, e.g. for spectators or while the local player is not known yet. */
+	static constexpr unsigned spectator = UINT_MAX;
+private:
+	/** Last line of sight that has been stamped for an entity. */
+	struct Source final {
+		uint32_t generation; /**< zero if unused */
+		unsigned player;
+		int x, y;
+		unsigned los;
+	};
+
+	struct Chunk final {
+		uint64_t explored[chunk_size], visible[chunk_size]; /**< one word per row */
+		bool dirty;
+		std::vector<uint32_t> sources; /**< index of every source whose line of sight overlaps this chunk */
+	};
+
+	/** Chunks cx0..cx1 by cy0..cy1, both inclusive, that a line of sight overlaps. */
+	struct Span final {
+		unsigned cx0, cy0, cx1, cy1;
+
+		bool operator==(const Span &s) const noexcept {
+			return cx0 == s.cx0 && cy0 == s.cy0 && cx1 == s.cx1 && cy1 == s.cy1;
+		}
+	};
+
+	struct Layer final {
+		std::vector<std::unique_ptr<Chunk>> chunks; /**< nullptr if nothing has been seen yet */
+		std::vector<uint32_t> dirty; /**< chunks to recompute */
+		bool revealed, no_fog;
+	};
+
+	unsigned w, h, cw, ch; /**< cw and ch are the number of chunks in each direction */
+	std::vector<Source> sources; /**< indexed by entity handle */
+	std::vector<Layer> layers; /**< one per player */
+
+	friend class World;
+public:
+	FogOfWar(unsigned w, unsigned h);
+
+	/**
+	 * Tell that entity \a h owned by \a player is at tile (\a x, \a y) and can see \a los
+	 * tiles far. This is cheap if nothing has changed since the last call. Newly
+	 * seen tiles are explored immediately, but visibility lags until update().
+	 */
+	void see(Handle h, unsigned player, int x, int y, unsigned los);
+	/** Stop tracking entity \a h, e.g. when it has died. */
+	void forget(Handle h);
+
+	/** Recompute visibility for all chunks that have changed since the last update. */
+	void update();
+
+	bool visible(unsigned player, int x, int y) const noexcept {
+		if (!inside(x, y))
+			return false;
+		if (player >= layers.size())
+			return player == spectator;
+
+		const Layer &l = layers[player];
+		const Chunk *c = l.chunks[offset(x, y)].get();
+
+		return l.no_fog || (c && test(c->visible, x, y));
+	}
+
+	bool explored(unsigned player, int x, int y) const noexcept {
+		if (!inside(x, y))
+			return false;
+		if (player >= layers.size())
+			return player == spectator;
+
+		const Layer &l = layers[player];
+		const Chunk *c = l.chunks[offset(x, y)].get();
+
+		return l.revealed || (c && test(c->explored, x, y));
+	}
+
+	/**
+	 * Explored bits for row \a y of the chunk that contains tile (\a x, \a y). Bit i is
+	 * set if \a player has explored the i-th tile from the left edge of the chunk.
+	 */
+	uint64_t explored_row(unsigned player, int x, int y) const noexcept {
+		if (!inside(x, y))
+			return 0;
+		if (player >= layers.size())
+			return player == spectator ? ~UINT64_C(0) : 0;
+
+		const Layer &l = layers[player];
+		const Chunk *c = l.chunks[offset(x, y)].get();
+
+		return l.revealed ? ~UINT64_C(0) : c ? c->explored[y % chunk_size] : 0;
+	}
+
+	/** Number of chunks that have been allocated for all players. */
+	size_t allocated() const noexcept;
+
+	/** Mark whole map as explored for \a player (i.e. reveal map cheat). */
+	void reveal(unsigned player);
+	/** Make whole map visible for \a player (i.e. no fog cheat). */
+	void no_fog(unsigned player, bool enable=true);
+private:
+	Layer &layer(unsigned player);
+	Chunk &chunk(Layer &l, unsigned cx, unsigned cy);
+	Span extent(int x, int y, unsigned los) const noexcept;
+	void mark(unsigned player, const Span &s);
+	/** Add or remove source \a index to or from all chunks in \a s. */
+	void link(unsigned player, const Span &s, uint32_t index);
+	void unlink(unsigned player, const Span &s, uint32_t index);
+	void stamp(uint64_t *rows, unsigned cx, unsigned cy, int x, int y, unsigned los);
+
+	constexpr bool inside(int x, int y) const noexcept {
+		return x >= 0 && y >= 0 && (unsigned)x < w && (unsigned)y < h;
+	}
+
+	size_t offset(int x, int y) const noexcept {
+		return (size_t)((unsigned)y >> chunk_bits) * cw + ((unsigned)x >> chunk_bits);
+	}
+
+	static bool test(const uint64_t *rows, int x, int y) noexcept {
+		return (rows[y % chunk_size] >> (x % chunk_size)) & 1;
+	}
+};
+
+}
+
+}
@@ -50,8 +50,11 @@ void MultiplayerClient::set_gcb(game::GameCallback *gcb, uint16_t slave_count, u
 	sock.send(cmd, false);
 }
 
+/** Commands that can be queued for the network or the game without waiting. It only fills up if the other thread hangs. */
+static constexpr size_t ring_size = 256;
+
 MultiplayerHost::MultiplayerHost(MultiplayerCallback &cb, const std::string &name, uint16_t port, bool dedicated)
-	: Multiplayer(cb, name, port), sock(port), slaves(), idmod(1), ready_confirms(0), dedicated(dedicated)
+	: Multiplayer(cb, name, port), sock(port), outbox(ring_size), slaves(), idmod(1), ready_confirms(0), dedicated(dedicated)
 {
 	puts("start host");
 	srand((unsigned)time(NULL));
@@ -145,6 +148,10 @@ void MultiplayerHost::event_process(sockfd fd, Command &cmd) {
 	}
 }
 
+void MultiplayerHost::flush() {
+	outbox.drain([this](Command &cmd) { sock.broadcast(*this, cmd); });
+}
+
 void MultiplayerHost::incoming(pollev &ev) {
 	std::lock_guard<std::recursive_mutex> lock(mut);
 	// disallow id 0 as slave, because this is always the host itself
@@ -181,6 +188,9 @@ void MultiplayerHost::dump() {
 
 	for (auto &x : slaves)
 		printf("%u %s\n", x.id, x.name.c_str());
+
+	RingStats s = outbox.stats();
+	printf("outbox: %" PRIu64 " sent, %" PRIu64 " full, depth %zu, max %zu\n", s.pushed, s.full, s.depth, s.max_depth);
 }
 
 void MultiplayerHost::set_gcb(game::GameCallback *gcb) {
@@ -189,12 +199,13 @@ void MultiplayerHost::set_gcb(game::GameCallback *gcb) {
 }
 
 bool MultiplayerHost::try_start() {
-	std::lock_guard<std::recursive_mutex> lock(mut);
-	if (ready_confirms) {
-		//printf("need %u more confirms\n", ready_confirms);
+	if (ready_confirms.load()) {
+		//printf("need %u more confirms\n", ready_confirms.load());
 		return false;
 	}
 
+	std::lock_guard<std::recursive_mutex> lock(mut);
+
 	assert(gcb);
 
 	// create players
@@ -207,12 +218,12 @@ bool MultiplayerHost::try_start() {
 		// announce player to slaves
 		Command create = Command::create(const_cast<Slave&>(x).pid = pid++, x.name);
 		gcb->new_player(create.data.create);
-		sock.broadcast(*this, create);
+		outbox.push(create);
 
 		// assign slave to player
 		Command assign = Command::assign(x.id, x.pid);
 		gcb->assign_player(assign.data.assign);
-		sock.broadcast(*this, assign);
+		outbox.push(assign);
 	}
 
 	// TODO create random stuff on terrain
@@ -221,8 +232,9 @@ bool MultiplayerHost::try_start() {
 	auto newstate = game::GameState::running;
 	Command do_start = Command::gamestate((unsigned)newstate);
 	gcb->change_state(newstate);
-	sock.broadcast(*this, do_start);
+	outbox.push(do_start);
 
+	sock.wake();
 	return true;
 }
 
@@ -417,15 +429,128 @@ bool MultiplayerClient::chat(const std::string &str, bool send) {
 
 namespace game {
 
-Map::Map(LCG &lcg, const StartMatch &settings) : w(settings.map_w), h(settings.map_h), tiles(new uint8_t[h * w]), heights(new uint8_t[h * w]) {
+static_assert(ChunkLayer::count == Map::chunk_size * Map::chunk_size, "chunk layer does not match chunk size");
+
+uint8_t &ChunkLayer::at(unsigned i) {
+	if (!data) {
+		data.reset(new uint8_t[count]);
+		memset(data.get(), fill, count);
+	}
+
+	return data[i];
+}
+
+void ChunkLayer::assign(const uint8_t *v, uint8_t fill) {
+	if (!v) {
+		data.reset();
+		this->fill = fill;
+		return;
+	}
+
+	if (!data)
+		data.reset(new uint8_t[count]);
+
+	memcpy(data.get(), v, count);
+}
+
+void ChunkLayer::compact() {
+	if (!data)
+		return;
+
+	for (unsigned i = 1; i < count; ++i)
+		if (data[i] != data[0])
+			return;
+
+	fill = data[0];
+	data.reset();
+}
+
+Map::Map(LCG &lcg, const StartMatch &settings)
+	: w(settings.map_w), h(settings.map_h)
+	, cw((w + chunk_size - 1) / chunk_size), ch((h + chunk_size - 1) / chunk_size)
+	, seed(0), chunks((size_t)cw * ch)
+{
 	printf("create %ux%u tiles\n", w, h);
 
-	for (unsigned y = 0; y < h; ++y)
-		for (unsigned x = 0; x < w; ++x)
-			tiles[y * w + x] = lcg.next() % ((unsigned)TileId::FLAT9 + 1);
+	// the generator only yields 15 bits at a time
+	seed = (uint32_t)lcg.next() << 15;
+	seed |= (uint32_t)lcg.next();
+}
+
+MapChunk &Map::chunk(unsigned x, unsigned y) {
+	auto &c = chunks[(y >> chunk_bits) * cw + (x >> chunk_bits)];
+
+	if (!c)
+		c.reset(new MapChunk());
+
+	return *c;
+}
+
+void Map::generate(MapChunk &c, unsigned cx, unsigned cy) {
+	LCG lcg(stream_seed(seed, cx, cy));
+
+	uint32_t values[ChunkLayer::count];
+	lcg.fill(values, ChunkLayer::count);
+
+	for (unsigned i = 0; i < ChunkLayer::count; ++i)
+		c.tiles.at(i) = values[i] % ((unsigned)TileId::FLAT9 + 1);
 
 	// TODO support heightmaps
-	memset(heights.get(), 0, w * h);
+	c.generated = true;
+}
+
+uint8_t Map::tile(unsigned x, unsigned y) {
+	assert(x < w && y < h);
+	MapChunk &c = chunk(x, y);
+
+	if (!c.generated)
+		generate(c, x >> chunk_bits, y >> chunk_bits);
+
+	return c.tiles.get(offset(x, y));
+}
+
+uint8_t Map::height(unsigned x, unsigned y) const noexcept {
+	const MapChunk *c = chunks[(y >> chunk_bits) * cw + (x >> chunk_bits)].get();
+	return c ? c->heights.get(offset(x, y)) : 0;
+}
+
+size_t Map::allocated() const noexcept {
+	size_t n = 0;
+
+	for (auto &c : chunks)
+		if (c)
+			++n;
+
+	return n;
+}
+
+size_t Map::memory() const noexcept {
+	size_t bytes = chunks.size() * sizeof chunks[0];
+
+	for (auto &c : chunks)
+		if (c)
+			bytes += sizeof *c + ChunkLayer::count * (!c->tiles.uniform() + !c->heights.uniform() + !c->blocked.uniform());
+
+	return bytes;
+}
+
+void Map::block(int left, int top, unsigned w, unsigned h, bool occupy) {
+	int right = std::min(left + (int)w, (int)this->w), bottom = std::min(top + (int)h, (int)this->h);
+
+	for (int y = std::max(top, 0); y < bottom; ++y)
+		for (int x = std::max(left, 0); x < right; ++x) {
+			MapChunk &c = chunk((unsigned)x, (unsigned)y);
+			++c.revision;
+
+			// objects may overlap, so keep track of how many are on each tile
+			if (occupy) {
+				uint8_t &v = c.blocked.at(offset(x, y));
+				v = v == UINT8_MAX ? v : v + 1;
+			} else if (c.blocked.get(offset(x, y))) {
+				--c.blocked.at(offset(x, y));
+				c.blocked.compact();
+			}
+		}
 }
 
 Player::Player(player_id id) : Player(id, "") {}
@@ -437,32 +562,85 @@ bool operator<(const Player &lhs, const Player &rhs) {
 	return lhs.id < rhs.id;
 }
 
-static constexpr unsigned timer_anim_ticks = 5;
-
 Game::Game(GameMode mode, MenuLobby *lobby, Multiplayer *mp, const StartMatch &settings)
-	: mp(mp), lobby(lobby), mode(mode), state(GameState::init), lcg(LCG::ansi_c(settings.seed))
-	, settings(settings), players(), usertbl(), mut(), world(lcg, settings, mode != GameMode::multiplayer_client)
-	, ticks_per_second(50), tick_interval(1.0 / ticks_per_second), tick_timer(0), timer_anim(timer_anim_ticks) {}
+	: arena(), mp(mp), lobby(lobby), mode(mode), state(GameState::init), lcg(settings.seed)
+	, settings(settings), players(&arena), usertbl(&arena), inbox(ring_size), world(lcg, settings, mode != GameMode::multiplayer_client, arena)
+	, ticks_per_second(World::ticks_per_second), tick_interval(1.0 / ticks_per_second), tick_timer(0), saver(), events(), computers(events) {}
 
 Game::~Game() {
 	if (lobby)
 		menu_lobby_stop_game(lobby);
 }
 
+void Game::new_player(const CreatePlayer &create) {
+	Command cmd;
+	cmd.type = (uint16_t)CmdType::create;
+	cmd.data.create = create;
+	inbox.push(cmd);
+}
+
+void Game::assign_player(const AssignSlave &assign) {
+	inbox.push(Command::assign(assign.from, assign.to));
+}
+
+void Game::change_state(const GameState &state) {
+	inbox.push(Command::gamestate((uint8_t)state));
+}
+
+void Game::drain() {
+	inbox.drain([this](const Command &cmd) {
+		switch ((CmdType)cmd.type) {
+		case CmdType::create:
+			printf("new player %u: %s\n", cmd.data.create.id, cmd.data.create.str().c_str());
+			players.emplace(cmd.data.create.id, cmd.data.create.str());
+			break;
+		case CmdType::assign:
+			assert(players.find(cmd.data.assign.to) != players.end());
+			usertbl.emplace(cmd.data.assign.from, cmd.data.assign.to);
+			break;
+		case CmdType::gamestate:
+			printf("change gamestate to %u\n", (unsigned)cmd.data.gamestate);
+			state = (GameState)cmd.data.gamestate;
+			break;
+		default:
+			break;
+		}
+	});
+}
+
+void Game::add_computer(player_id id) {
+	auto it = players.find(Player(id));
+
+	if (it != players.end()) {
+		Player p(*it);
+		p.ai = 1;
+		players.erase(it);
+		players.insert(p);
+	}
+
+	computers.add(id);
+}
+
+bool Game::find_player(user_id user, player_id &pid) const {
+	auto it = usertbl.find(user);
+
+	if (it == usertbl.end())
+		return false;
+
+	pid = it->second;
+	return true;
+}
+
 void Game::tick(unsigned n) {
 	for (unsigned i = 0; i < n; ++i) {
-		if (!timer_anim) {
-			timer_anim = timer_anim_ticks;
-			world.imgtick();
-		} else {
-			--timer_anim;
-		}
+		events.idle(world);
 		world.tick();
+		computers.publish(world);
 	}
 }
 
 void Game::step(unsigned ms) {
-	std::lock_guard<std::recursive_mutex> lock(mut);
+	drain();
 
 	if (state != GameState::running)
 		return;
@@ -475,7 +653,7 @@ void Game::step(unsigned ms) {
 }
 
 void Game::step(double sec) {
-	std::lock_guard<std::recursive_mutex> lock(mut);
+	drain();
 
 	if (state != GameState::running)
 		return;
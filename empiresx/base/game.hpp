@@ -6,6 +6,8 @@
 
 #include <thread>
 #include <atomic>
+#include <map>
+#include <memory_resource>
 #include <set>
 #include <string>
 #include <mutex>
@@ -13,7 +15,11 @@
 #include <stack>
 
 #include "random.hpp"
+#include "ring.hpp"
 #include "world.hpp"
+#include "save.hpp"
+#include "events.hpp"
+#include "ai.hpp"
 
 namespace genie {
 
@@ -79,10 +85,11 @@ public:
 
 class MultiplayerHost final : public Multiplayer, protected ServerCallback {
 	ServerSocket sock;
+	SpscRing<Command> outbox; /**< broadcasts from the game thread, which are sent by the network thread */
 	std::set<Slave> slaves;
 	user_id idmod;
 	Ready expected_settings; /**< data that each client has to send that must match */
-	unsigned ready_confirms; /**< pending ready messages from slaves */
+	std::atomic<unsigned> ready_confirms; /**< pending ready messages from slaves. atomic, so try_start can poll it every frame without locking */
 	bool dedicated; /**< whether the server is running headless (i.e. without a GUI) */
 public:
 	MultiplayerHost(MultiplayerCallback &cb, const std::string &name, uint16_t port, bool dedicated=false);
@@ -95,11 +102,13 @@ public:
 	void incoming(pollev &ev) override;
 	void removepeer(sockfd fd) override;
 	void event_process(sockfd fd, Command &cmd) override;
+	void flush() override;
 	void shutdown() override;
 
 	void dump();
 	void set_gcb(game::GameCallback *gcb);
 
+	/** Announce all players and start the game. This must be called by the thread that runs the game. */
 	bool try_start();
 
 	bool chat(const std::string &str, bool send=true) override;
@@ -215,8 +224,10 @@ public:
 	Player(player_id id, const std::string &name);
 
 	friend bool operator<(const Player&, const Player&);
+	friend class Game;
 };
 
+/** Commands from the network for the game. All calls must come from the same thread. */
 class GameCallback {
 public:
 	virtual ~GameCallback() {}
@@ -228,25 +239,62 @@ public:
 
 class Game : public GameCallback {
 protected:
+	Arena arena; /**< everything the match allocates. it goes away with the game */
 	Multiplayer *mp;
 	MenuLobby *lobby;
 	GameMode mode;
 	GameState state;
 	LCG lcg;
 	StartMatch settings;
-	std::set<Player> players;
-	std::map<user_id, player_id> usertbl; /**< Lookuptable for user id using slave player id */
-	std::recursive_mutex mut;
+	std::pmr::set<Player> players;
+	std::pmr::map<user_id, player_id> usertbl; /**< Lookuptable for user id using slave player id */
+	SpscRing<Command> inbox; /**< callbacks that have not been applied yet */
 	unsigned ticks_per_second;
 	double tick_interval;
 	double tick_timer;
-	unsigned timer_anim;
+	SaveWriter saver; /**< kept around, so unchanged map chunks are not copied again */
 public:
 	World world;
+	GameEvents events; /**< orders of human and computer players */
+protected:
+	AiPool computers; /**< after world and events, so its thread stops before they go away */
+public:
 
 	Game(GameMode mode, MenuLobby *lobby, Multiplayer *mp, const StartMatch &settings);
 	~Game();
 
+	/*
+	 * The callbacks only queue the command, so the network thread never waits for the game.
+	 * The game applies them in drain, which step does first. Clients never step, so they have to drain themselves.
+	 */
+
+	void new_player(const CreatePlayer&) override;
+	void assign_player(const AssignSlave&) override;
+	void change_state(const game::GameState&) override;
+
+	/** Counters of commands that have been queued by the network thread. This is safe to call from any thread. */
+	RingStats inbox_stats() const noexcept { return inbox.stats(); }
+	/** This is safe to call from any thread. */
+	AiStats ai_stats() const noexcept { return computers.stats(); }
+
+	/*
+	 * Anything below must be called by the thread that runs the game.
+	 */
+
+	/** Snapshot of the current state, e.g. as keyframe for replays and spectators. It is valid until the next snapshot. */
+	const SaveWriter &snapshot();
+	/** Write snapshot to \a path. Throws std::runtime_error if it cannot be written. */
+	void save(const std::string &path);
+	/** Continue from snapshot \a f. The game must have been created with the settings of \a f. */
+	void load(const SaveFile &f);
+	/** Let the computer play for player \a id. */
+	void add_computer(player_id id);
+	/** Look up which player \a user controls. Returns false if it has not been assigned to one yet. */
+	bool find_player(user_id user, player_id &pid) const;
+
+protected:
+	/** Apply all queued callbacks. Call this every frame, even before the game runs, so the inbox never fills up. */
+	void drain();
 private:
 	void tick(unsigned n=1);
 public:
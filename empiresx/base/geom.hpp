@@ -6,6 +6,11 @@
  * Wrappers for basic geometry in euclidean space
  */
 
+#include "math.hpp"
+
+#include <cassert>
+#include <cstdint>
+
 namespace genie {
 
 /**
@@ -17,6 +22,7 @@ public:
 
 	constexpr Vector2<T>(T x=0, T y=0) noexcept : x(x), y(y) {}
 	constexpr Vector2<T>(const Vector2<T> &other) noexcept : x(other.x), y(other.y) {}
+	constexpr Vector2<T> &operator=(const Vector2<T>&) noexcept = default;
 
 	friend constexpr Vector2<T> operator+(Vector2<T> lhs, const Vector2<T> &rhs) noexcept {
 		lhs += rhs;
@@ -62,6 +68,105 @@ public:
 		y *= v;
 		return *this;
 	}
+
+	friend constexpr bool operator==(const Vector2<T> &lhs, const Vector2<T> &rhs) noexcept {
+		return lhs.x == rhs.x && lhs.y == rhs.y;
+	}
+
+	friend constexpr bool operator!=(const Vector2<T> &lhs, const Vector2<T> &rhs) noexcept {
+		return !(lhs == rhs);
+	}
+};
+
+enum class Quadrant {
+	tr = 0,
+	tl = 1,
+	bl = 2,
+	br = 3,
+	bad = 4,
+};
+
+template<typename T> class Box2 {
+public:
+	T left, top, w, h; /**< width and height must be positive. */
+
+	constexpr Box2(T left=0, T top=0, T w=0, T h=0) noexcept
+		: left(left), top(top), w(w), h(h) { assert(w >= 0 && h >= 0); }
+
+	constexpr Box2(const Vector2<T> &pos, const Vector2<T> &size) noexcept
+		: left(pos.x), top(pos.y), w(size.x), h(size.y) { assert(size.x >= 0 && size.y >= 0); }
+
+	constexpr T right() const noexcept { return left + w; }
+	constexpr T bottom() const noexcept { return top + h; }
+	constexpr Vector2<T> topleft() const noexcept { return Vector2<T>(left, top); }
+	constexpr Vector2<T> rightbottom() const noexcept { return Vector2<T>(right(), bottom()); }
+	constexpr Vector2<T> center() const noexcept { return Vector2<T>(left + w / 2, top + h / 2); }
+
+	constexpr bool contains(const Box2<T> &box) const noexcept {
+		return left <= box.left && top <= box.top && right() <= box.right() && bottom() <= box.bottom();
+	}
+
+	constexpr bool contains(const Vector2<T> &pt) const noexcept {
+		return pt.x >= left && pt.y >= top && pt.x < right() && pt.y < bottom();
+	}
+
+	constexpr bool intersects(const Box2<T> &box) const noexcept {
+		return !(left >= box.right() || top >= box.bottom() || right() <= box.left || bottom() <= box.top);
+	}
+
+	constexpr Quadrant quadrant(const Vector2<T> &pt) const noexcept {
+		if (!contains(pt))
+			return Quadrant::bad;
+
+		if (pt.y < center().y)
+			return pt.x < center().x ? Quadrant::tl : Quadrant::tr;
+
+		return pt.x < center().x ? Quadrant::bl : Quadrant::br;
+	}
 };
 
+/** Fixed-point instantiations for simulation state. */
+typedef Vector2<Fixed> Vector2x;
+typedef Box2<Fixed> Box2x;
+
+/*
+ * Integer-only helpers for simulation state. Coordinates must stay within 2^16 tiles
+ * of the origin, so that squared distances fit in 64 bits.
+ */
+
+/** Euclidean length of \a v, truncated to the fixed-point precision. */
+static constexpr inline Fixed length(const Vector2x &v) noexcept {
+	int64_t x = v.x.raw, y = v.y.raw;
+	return Fixed::from_raw((int32_t)isqrt((uint64_t)(x * x + y * y)));
+}
+
+static constexpr inline Fixed distance(const Vector2x &a, const Vector2x &b) noexcept {
+	return length(b - a);
+}
+
+/** Binary angle of \a v (see fatan2). */
+static constexpr inline uint16_t angle(const Vector2x &v) noexcept {
+	return fatan2(v.y.raw, v.x.raw);
+}
+
+/**
+ * Move \a pos at most \a speed towards \a to. The position snaps to \a to once it is
+ * within reach, so it never overshoots. Returns true if \a to has been reached.
+ */
+static constexpr inline bool step_towards(Vector2x &pos, const Vector2x &to, Fixed speed) noexcept {
+	int64_t dx = (int64_t)to.x.raw - pos.x.raw, dy = (int64_t)to.y.raw - pos.y.raw;
+	uint64_t d2 = (uint64_t)(dx * dx + dy * dy);
+
+	if (d2 <= (uint64_t)((int64_t)speed.raw * speed.raw)) {
+		pos = to;
+		return true;
+	}
+
+	uint16_t a = fatan2(dy, dx);
+
+	pos.x += fcos(a) * speed;
+	pos.y += fsin(a) * speed;
+	return false;
+}
+
 }
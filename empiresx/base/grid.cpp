@@ -0,0 +1,97 @@
+/* Copyright 2016-2020 the Age of Empires Free Software Remake authors. See LEGAL for legal info */
+
+#include "grid.hpp"
+
+#include "world.hpp"
+
+#include <algorithm>
+
+namespace genie {
+
+namespace game {
+
+void UnitGrid::clear() {
+	mask = 63;
+	count = 0;
+	head.assign((size_t)mask + 1, none);
+	items.clear();
+}
+
+void UnitGrid::insert(Unit &u) {
+	uint32_t i = u.gethandle().index;
+
+	if (i >= items.size())
+		items.resize((size_t)i + 1, Entry{Vector2x(), Fixed(), nullptr, none, none});
+
+	assert(!items[i].who);
+	items[i] = Entry{u.pos.topleft(), u.radius(), &u, none, none};
+
+	// about two buckets per unit keeps collisions rare
+	if (2 * ++count > head.size())
+		rehash(head.size() * 2);
+	else
+		link(i);
+}
+
+void UnitGrid::remove(const Unit &u) {
+	uint32_t i = u.gethandle().index;
+
+	assert(i < items.size() && items[i].who == &u);
+	unlink(i);
+	items[i].who = nullptr;
+	--count;
+}
+
+void UnitGrid::move(const Unit &u) {
+	Entry &e = items[u.gethandle().index];
+
+	e.pos = u.pos.topleft();
+
+	if (bucket(e.pos) != e.bucket) {
+		unlink(u.gethandle().index);
+		link(u.gethandle().index);
+	}
+}
+
+void UnitGrid::link(uint32_t i) {
+	Entry &e = items[i];
+	e.bucket = bucket(e.pos);
+
+	uint32_t *p = &head[e.bucket];
+
+	while (*p < i)
+		p = &items[*p].next;
+
+	e.next = *p;
+	*p = i;
+}
+
+void UnitGrid::unlink(uint32_t i) {
+	uint32_t *p = &head[items[i].bucket];
+
+	while (*p != i)
+		p = &items[*p].next;
+
+	*p = items[i].next;
+}
+
+void UnitGrid::rehash(size_t n) {
+	mask = (uint32_t)n - 1;
+	head.assign(n, none);
+
+	// backwards, so every bucket ends up in handle order by just adding to the front
+	for (size_t i = items.size(); i-- > 0;) {
+		Entry &e = items[i];
+
+		if (!e.who)
+			continue;
+
+		e.bucket = bucket(e.pos);
+		e.next = head[e.bucket];
+		head[e.bucket] = (uint32_t)i;
+	}
+}
+
+}
+
+}
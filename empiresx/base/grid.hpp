@@ -0,0 +1,116 @@
+/* Copyright 2016-2020 the Age of Empires Free Software Remake authors. See LEGAL for legal info */
+
+#pragma once
+
+/*
+ * Uniform grid of units for neighbour queries.
+ *
+ * Cells are hashed into a table that is sized by the number of units rather than the
+ * map, so huge maps cost nothing extra. Units are added and removed as they come and
+ * go, and only units that have moved are updated, so sleeping units cost nothing per
+ * tick. Every bucket is a list of units in handle order, so the result does not depend
+ * on the number of threads or on the order in which units have been added.
+ */
+
+#include "geom.hpp"
+#include "arena.hpp"
+
+#include <cstddef>
+#include <cstdint>
+
+#include <vector>
+
+namespace genie {
+
+namespace game {
+
+class Unit;
+
+class UnitGrid final {
+public:
+	/** Size of a cell in tiles. This must be at least the largest distance a query looks at. */
+	static constexpr int cell_size = 1;
+
+	struct Entry final {
+		Vector2x pos;
+		Fixed radius;
+		Unit *who; /**< nullptr if this entry is not in use */
+		uint32_t next; /**< in the same bucket */
+		uint32_t bucket;
+	};
+private:
+	static constexpr uint32_t none = UINT32_MAX;
+
+	uint32_t mask; /**< number of buckets minus one */
+	size_t count; /**< number of units in the grid */
+	std::vector<uint32_t> head; /**< first entry of each bucket */
+	std::vector<Entry> items; /**< indexed by handle index */
+public:
+	UnitGrid() : mask(63), count(0), head(64, none), items() {}
+
+	void clear();
+	void insert(Unit &u);
+	void remove(const Unit &u);
+	/** Update the position of \a u after it has moved. */
+	void move(const Unit &u);
+
+	/**
+	 * Call \a fn for units in the cells within \a range of \a pos, until \a limit units
+	 * have been visited. This bounds the cost of a query in crowded spots. The cell
+	 * that contains \a pos is visited first, since it has the closest units.
+	 */
+	template<typename F> void query(const Vector2x &pos, Fixed range, unsigned limit, F fn) const {
+		assert(range <= cell_size);
+		int x0 = cell(pos.x - range), x1 = cell(pos.x + range);
+		int y0 = cell(pos.y - range), y1 = cell(pos.y + range);
+		int cx = cell(pos.x), cy = cell(pos.y);
+
+		if (!visit(cx, cy, limit, fn))
+			return;
+
+		for (int y = y0; y <= y1; ++y)
+			for (int x = x0; x <= x1; ++x)
+				if ((x != cx || y != cy) && !visit(x, y, limit, fn))
+					return;
+	}
+private:
+	template<typename F> bool visit(int x, int y, unsigned &limit, F &fn) const {
+		for (uint32_t i = head[bucket(x, y)]; i != none; i = items[i].next) {
+			const Entry &e = items[i];
+
+			// skip other cells that ended up in the same bucket
+			if (cell(e.pos.x) != x || cell(e.pos.y) != y)
+				continue;
+
+			if (!limit)
+				return false;
+
+			--limit;
+			fn(e);
+		}
+
+		return true;
+	}
+
+	static int cell(Fixed v) noexcept {
+		return v.floor() / cell_size;
+	}
+
+	uint32_t bucket(int x, int y) const noexcept {
+		return ((uint32_t)x * UINT32_C(73856093) ^ (uint32_t)y * UINT32_C(19349663)) & mask;
+	}
+
+	uint32_t bucket(const Vector2x &pos) const noexcept {
+		return bucket(cell(pos.x), cell(pos.y));
+	}
+
+	/** Insert entry \a i into its bucket, keeping the bucket in handle order. */
+	void link(uint32_t i);
+	void unlink(uint32_t i);
+	/** Resize the table to \a n buckets, which must be a power of two. */
+	void rehash(size_t n);
+};
+
+}
+
+}
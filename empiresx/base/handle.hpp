@@ -0,0 +1,126 @@
+/* Copyright 2016-2020 the Age of Empires Free Software Remake authors. See LEGAL for legal info */
+
+#pragma once
+
+/*
+ * Generational handles to refer to entities without holding pointers to them.
+ *
+ * A handle is an index in a table plus the generation of the slot at that index.
+ * Whenever an entity is removed, the generation of its slot is bumped, so all
+ * handles to it become stale even if the slot is reused for another entity.
+ */
+
+#include <cstddef>
+#include <cstdint>
+
+#include <memory_resource>
+#include <stdexcept>
+#include <vector>
+
+namespace genie {
+
+namespace game {
+
+class Handle final {
+public:
+	uint32_t index;
+	uint32_t generation; /**< zero is never used, so default constructed handles are always invalid */
+
+	constexpr Handle(uint32_t index=0, uint32_t generation=0) noexcept : index(index), generation(generation) {}
+
+	constexpr explicit operator bool() const noexcept { return generation != 0; }
+
+	friend constexpr bool operator==(const Handle &lhs, const Handle &rhs) noexcept {
+		return lhs.index == rhs.index && lhs.generation == rhs.generation;
+	}
+
+	friend constexpr bool operator!=(const Handle &lhs, const Handle &rhs) noexcept {
+		return !(lhs == rhs);
+	}
+};
+
+/** Table that resolves handles in O(1). It does not own the objects. */
+template<typename T> class HandleTable final {
+	struct Slot final {
+		T *ptr;
+		uint32_t generation;
+	};
+
+	std::pmr::vector<Slot> slots;
+	std::pmr::vector<uint32_t> unused; /**< indices of free slots */
+	size_t count;
+public:
+	explicit HandleTable(std::pmr::memory_resource *mem=std::pmr::get_default_resource()) : slots(mem), unused(mem), count(0) {}
+
+	Handle add(T &obj) {
+		++count;
+
+		if (unused.empty()) {
+			slots.push_back(Slot{&obj, 1});
+			return Handle((uint32_t)slots.size() - 1, 1);
+		}
+
+		uint32_t index = unused.back();
+		unused.pop_back();
+
+		Slot &s = slots[index];
+		s.ptr = &obj;
+		return Handle(index, s.generation);
+	}
+
+	/** Invalidate all handles to the object that \a h refers to. Stale handles are ignored. */
+	void remove(Handle h) {
+		if (!get(h))
+			return;
+
+		Slot &s = slots[h.index];
+		s.ptr = nullptr;
+		// skip zero on wrap around, so the slot never accepts the default handle
+		s.generation = s.generation == UINT32_MAX ? 1 : s.generation + 1;
+
+		unused.push_back(h.index);
+		--count;
+	}
+
+	/** Return object that \a h refers to or nullptr if \a h is stale. */
+	T *get(Handle h) const noexcept {
+		return h.index < slots.size() && slots[h.index].generation == h.generation ? slots[h.index].ptr : nullptr;
+	}
+
+	size_t size() const noexcept { return count; }
+
+	/*
+	 * Saving and loading. The generation of every slot and the order of the free slots
+	 * determine which handles are given out next, so both have to be restored exactly.
+	 */
+
+	size_t slot_count() const noexcept { return slots.size(); }
+	uint32_t generation(uint32_t index) const noexcept { return slots[index].generation; }
+	const std::pmr::vector<uint32_t> &free_slots() const noexcept { return unused; }
+
+	/** Recreate table with \a n slots, which are all empty until objects are put back with put. */
+	void reset(const uint32_t *generations, size_t n, const uint32_t *free, size_t nfree) {
+		slots.clear();
+
+		for (size_t i = 0; i < n; ++i)
+			slots.push_back(Slot{nullptr, generations[i]});
+
+		unused.assign(free, free + nfree);
+		count = 0;
+	}
+
+	/** Make \a h refer to \a obj again. */
+	void put(Handle h, T &obj) {
+		Slot &s = slots.at(h.index);
+
+		if (s.ptr || s.generation != h.generation)
+			throw std::runtime_error("bad handle");
+
+		s.ptr = &obj;
+		++count;
+	}
+};
+
+}
+
+}
@@ -0,0 +1,185 @@
+/* Copyright 2016-2020 the Age of Empires Free Software Remake authors. See LEGAL for legal info */
+
+#include "job.hpp"
+
+#include <algorithm>
+
+namespace genie {
+
+static thread_local const Scheduler *owner = nullptr;
+static thread_local unsigned owner_index = Scheduler::external;
+
+Scheduler::Scheduler(unsigned threads)
+	: queues(), workers(), mut(), cv(), queued(0), sleeping(0), tracer(nullptr), stop(false)
+{
+	if (!threads)
+		threads = std::max(std::thread::hardware_concurrency(), 1u);
+
+	for (unsigned i = 0; i < threads; ++i)
+		queues.emplace_back(new Queue());
+
+	// the thread that waits on a group runs tasks as well
+	for (unsigned i = 0; i + 1 < threads; ++i)
+		workers.emplace_back(&Scheduler::run, this, i);
+}
+
+Scheduler::~Scheduler() {
+	{
+		std::lock_guard<std::mutex> lock(mut);
+		stop = true;
+	}
+	cv.notify_all();
+
+	for (auto &t : workers)
+		t.join();
+}
+
+unsigned Scheduler::self() const noexcept {
+	return owner == this ? owner_index : external;
+}
+
+void Scheduler::spawn(TaskGroup &group, std::function<void()> fn, const char *name) {
+	unsigned index = self();
+	Queue &q = *queues[index == external ? queues.size() - 1 : index];
+
+	group.pending.fetch_add(1);
+	{
+		std::lock_guard<std::mutex> lock(q.mut);
+		q.tasks.push_back(Task{std::move(fn), &group, name});
+	}
+	queued.fetch_add(1);
+
+	if (sleeping.load()) {
+		std::lock_guard<std::mutex> lock(mut);
+		cv.notify_one();
+	}
+}
+
+bool Scheduler::pop(unsigned index, Task &task) {
+	unsigned n = (unsigned)queues.size(), own = index == external ? n - 1 : index;
+
+	// own work first, newest task first since it is most likely still in the cache.
+	// this also keeps nested waits depth-first, so they do not blow up the stack
+	{
+		Queue &q = *queues[own];
+		std::lock_guard<std::mutex> lock(q.mut);
+
+		if (!q.tasks.empty()) {
+			task = std::move(q.tasks.back());
+			q.tasks.pop_back();
+			queued.fetch_sub(1);
+			return true;
+		}
+	}
+
+	// steal oldest task, starting with the shared queue
+	for (unsigned i = 0; i < n; ++i) {
+		unsigned victim = (n - 1 + i) % n;
+
+		if (victim == own)
+			continue;
+
+		Queue &q = *queues[victim];
+		std::lock_guard<std::mutex> lock(q.mut);
+
+		if (q.tasks.empty())
+			continue;
+
+		task = std::move(q.tasks.front());
+		q.tasks.pop_front();
+		queued.fetch_sub(1);
+
+		TaskTracer *t = tracer.load();
+		if (t && victim != n - 1)
+			t->steal(index, victim);
+
+		return true;
+	}
+
+	return false;
+}
+
+bool Scheduler::try_run(unsigned index) {
+	Task task;
+
+	if (!pop(index, task))
+		return false;
+
+	TaskTracer *t = tracer.load();
+	if (t)
+		t->begin(index, task.name);
+
+	try {
+		task.fn();
+	} catch (...) {
+		std::lock_guard<std::mutex> lock(task.group->mut);
+		if (!task.group->error)
+			task.group->error = std::current_exception();
+	}
+
+	if (t)
+		t->end(index, task.name);
+
+	// the group may be gone as soon as the last task has finished
+	task.group->pending.fetch_sub(1);
+	return true;
+}
+
+void Scheduler::run(unsigned index) {
+	owner = this;
+	owner_index = index;
+
+	while (1) {
+		if (try_run(index))
+			continue;
+
+		std::unique_lock<std::mutex> lock(mut);
+		sleeping.fetch_add(1);
+		cv.wait(lock, [this]{ return stop || queued.load(); });
+		sleeping.fetch_sub(1);
+
+		if (stop)
+			return;
+	}
+}
+
+void Scheduler::wait(TaskGroup &group) {
+	unsigned index = self();
+
+	while (!group.done())
+		if (!try_run(index))
+			std::this_thread::yield();
+
+	if (group.error) {
+		std::exception_ptr e = group.error;
+		group.error = nullptr;
+		std::rethrow_exception(e);
+	}
+}
+
+void Scheduler::parallel_for(size_t count, size_t grain, const std::function<void(size_t, size_t)> &fn, const char *name) {
+	grain = std::max<size_t>(grain, 1);
+
+	// not worth splitting up
+	if (count <= grain || workers.empty()) {
+		if (count)
+			fn(0, count);
+		return;
+	}
+
+	TaskGroup group;
+
+	for (size_t begin = 0; begin < count; begin += grain) {
+		size_t end = std::min(begin + grain, count);
+		spawn(group, [&fn, begin, end]{ fn(begin, end); }, name);
+	}
+
+	wait(group);
+}
+
+Scheduler &scheduler() {
+	static Scheduler s;
+	return s;
+}
+
+}
@@ -0,0 +1,112 @@
+/* Copyright 2016-2020 the Age of Empires Free Software Remake authors. See LEGAL for legal info */
+
+#pragma once
+
+/*
+ * Work-stealing task scheduler that is shared by all subsystems.
+ *
+ * Every worker has its own deque of tasks: it pushes and pops at the back, while
+ * idle workers steal the oldest tasks from the front. Threads that are not part of
+ * the scheduler (e.g. the main thread) submit tasks through a shared queue and help
+ * running tasks while they are waiting for them.
+ */
+
+#include <cstddef>
+#include <climits>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace genie {
+
+/** Hooks for profiling. All methods may be called concurrently from any worker. */
+class TaskTracer {
+public:
+	virtual ~TaskTracer() {}
+
+	/** Called right before and after task \a name runs on \a worker. */
+	virtual void begin(unsigned worker, const char *name) = 0;
+	virtual void end(unsigned worker, const char *name) = 0;
+	/** Called when \a thief has taken a task from the queue of \a victim. */
+	virtual void steal(unsigned /*thief*/, unsigned /*victim*/) {}
+};
+
+/** Set of tasks that can be waited on as a whole. */
+class TaskGroup final {
+	friend class Scheduler;
+
+	std::atomic<unsigned> pending;
+	std::mutex mut;
+	std::exception_ptr error; /**< first exception that has been thrown by any task */
+public:
+	TaskGroup() : pending(0), mut(), error() {}
+
+	bool done() const noexcept { return !pending.load(); }
+};
+
+class Scheduler final {
+	struct Task final {
+		std::function<void()> fn;
+		TaskGroup *group;
+		const char *name;
+	};
+
+	struct Queue final {
+		std::mutex mut;
+		std::deque<Task> tasks;
+	};
+
+	/** One queue per worker. The last one is shared by all threads outside the scheduler. */
+	std::vector<std::unique_ptr<Queue>> queues;
+	std::vector<std::thread> workers;
+	std::mutex mut;
+	std::condition_variable cv;
+	std::atomic<size_t> queued;
+	std::atomic<unsigned> sleeping;
+	std::atomic<TaskTracer*> tracer;
+	bool stop;
+public:
+	/** Worker index for threads that do not belong to the scheduler. */
+	static constexpr unsigned external = UINT_MAX;
+
+	/** Create scheduler that uses \a threads threads including the one that waits. Zero means one per core. */
+	Scheduler(unsigned threads=0);
+	~Scheduler();
+
+	/** Number of threads that run tasks, including the one that is waiting. */
+	unsigned size() const noexcept { return (unsigned)workers.size() + 1; }
+
+	/** Install profiling hooks. Use nullptr to remove them. */
+	void trace(TaskTracer *t) noexcept { tracer.store(t); }
+
+	void spawn(TaskGroup &group, std::function<void()> fn, const char *name="task");
+	/**
+	 * Run tasks until all tasks in \a group have finished. If any task has thrown an
+	 * exception, the first one is rethrown here.
+	 */
+	void wait(TaskGroup &group);
+
+	/**
+	 * Run \a fn on the ranges [begin, end) that together cover [0, count) and wait
+	 * until all of them have finished. Ranges are at least \a grain long, except for
+	 * the last one.
+	 */
+	void parallel_for(size_t count, size_t grain, const std::function<void(size_t, size_t)> &fn, const char *name="parallel_for");
+private:
+	void run(unsigned index);
+	unsigned self() const noexcept;
+	bool pop(unsigned index, Task &task);
+	bool try_run(unsigned index);
+};
+
+/** The scheduler that all subsystems share. It is created on first use. */
+Scheduler &scheduler();
+
+}
@@ -0,0 +1,268 @@
+/* Copyright 2016-2020 the Age of Empires Free Software Remake authors. See LEGAL for legal info */
+
+#include "mapgen.hpp"
+
+#include "random.hpp"
+
+#include <cmath>
+
+#include <algorithm>
+#include <array>
+#include <iterator>
+
+namespace genie {
+
+namespace game {
+
+/** Tiles of a berry bush cluster within its 3x2 bounding box. */
+static const uint8_t bush_shape[][2] = {
+	{1, 1}, {2, 1}, {2, 0}, {1, 0}, {0, 0},
+};
+
+// FIXME verify these
+static const unsigned mine_spacing = 8; /**< minimum distance between mines and bushes */
+static const unsigned forest_spacing = 6; /**< minimum distance between the first trees of forests */
+static const unsigned forest_size = 16; /**< average number of trees per forest */
+static const unsigned tries = 30; /**< attempts to find a spot before giving up */
+
+struct Spot final {
+	int x, y;
+};
+
+class MapGenerator::Region final {
+public:
+	int left, top; /**< position on the map */
+	unsigned w, h; /**< size, which is smaller than region_size at the right and bottom edge of the map */
+	LCG lcg;
+	uint64_t taken[region_size]; /**< bit x of word y is set if tile (x, y) is occupied or must be kept free */
+	std::vector<Spot> spots; /**< mines and bushes, for Poisson disc sampling */
+	std::vector<Spot> forests; /**< first tree of every forest */
+	size_t placed[4];
+
+	Region(int left, int top, unsigned w, unsigned h, uint32_t seed)
+		: left(left), top(top), w(w), h(h), lcg(seed), taken(), spots(), forests(), placed() {}
+
+	/** Check whether all tiles in [x0, x1] x [y0, y1] are inside the region and not taken. */
+	bool free(int x0, int y0, int x1, int y1) const noexcept {
+		if (x0 < 0 || y0 < 0 || x1 >= (int)w || y1 >= (int)h)
+			return false;
+
+		uint64_t mask = (~UINT64_C(0) << x0) & (~UINT64_C(0) >> (63 - x1));
+
+		for (int y = y0; y <= y1; ++y)
+			if (taken[y] & mask)
+				return false;
+
+		return true;
+	}
+
+	void take(int x0, int y0, int x1, int y1) noexcept {
+		x0 = std::max(x0, 0);
+		y0 = std::max(y0, 0);
+		x1 = std::min(x1, (int)w - 1);
+		y1 = std::min(y1, (int)h - 1);
+
+		if (x0 > x1)
+			return;
+
+		uint64_t mask = (~UINT64_C(0) << x0) & (~UINT64_C(0) >> (63 - x1));
+
+		for (int y = y0; y <= y1; ++y)
+			taken[y] |= mask;
+	}
+
+	/** Check whether (\a x, \a y) is at least \a spacing tiles away from all \a points. */
+	static bool apart(const std::vector<Spot> &points, int x, int y, unsigned spacing) noexcept {
+		for (const Spot &s : points) {
+			int dx = s.x - x, dy = s.y - y;
+
+			if (dx * dx + dy * dy < (int)(spacing * spacing))
+				return false;
+		}
+
+		return true;
+	}
+
+	/**
+	 * Find a spot for an object of \a w by \a h tiles that has a free ring around it
+	 * and is far enough from all other mines and bushes.
+	 */
+	bool find(unsigned w, unsigned h, Spot &at) {
+		if (this->w < w + 2 || this->h < h + 2)
+			return false;
+
+		for (unsigned i = 0; i < tries; ++i) {
+			int x = (int)lcg.next(1, this->w - w - 1);
+			int y = (int)lcg.next(1, this->h - h - 1);
+
+			if (free(x - 1, y - 1, x + w, y + h) && apart(spots, x, y, mine_spacing)) {
+				take(x - 1, y - 1, x + w, y + h);
+				spots.push_back(Spot{x, y});
+				at = Spot{x, y};
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	void add(std::vector<MapObject> &out, int x, int y, ResourceType type, unsigned variant) {
+		out.push_back(MapObject{(uint16_t)(left + x), (uint16_t)(top + y), type, (uint8_t)variant});
+		++placed[(unsigned)type];
+	}
+};
+
+MapGenerator::MapGenerator(unsigned w, unsigned h, uint32_t seed)
+	: w(w), h(h), rw((w + region_size - 1) >> region_bits), rh((h + region_size - 1) >> region_bits), seed(seed), reserved() {}
+
+void MapGenerator::reserve(int left, int top, unsigned w, unsigned h) {
+	reserved.push_back(Reserved{left, top, left + (int)w, top + (int)h});
+}
+
+void MapGenerator::generate(Region &r, const size_t wanted[4], std::vector<MapObject> &out) const {
+	for (const Reserved &res : reserved)
+		r.take(res.left - r.left, res.top - r.top, res.right - 1 - r.left, res.bottom - 1 - r.top);
+
+	Spot at;
+
+	// mines first, since they are the rarest and need the most room
+	for (ResourceType type : {ResourceType::gold, ResourceType::stone})
+		for (size_t i = 0; i < wanted[(unsigned)type]; ++i) {
+			if (!r.find(2, 2, at))
+				break;
+
+			for (int y = 0; y < 2; ++y)
+				for (int x = 0; x < 2; ++x) {
+					unsigned image = (unsigned)r.lcg.next(6);
+					r.add(out, at.x + x, at.y + y, type, image);
+				}
+		}
+
+	for (size_t i = 0; i < wanted[(unsigned)ResourceType::food]; ++i) {
+		if (!r.find(3, 2, at))
+			break;
+
+		for (auto &t : bush_shape)
+			r.add(out, at.x + t[0], at.y + t[1], ResourceType::food, 0);
+	}
+
+	// grow forests from random free spots until all trees have been placed
+	size_t trees = wanted[(unsigned)ResourceType::wood];
+	std::vector<Spot> forest;
+
+	while (trees) {
+		Spot seed{0, 0};
+		bool found = false;
+
+		for (unsigned i = 0; i < tries && !found; ++i) {
+			seed.x = (int)r.lcg.next(r.w - 1);
+			seed.y = (int)r.lcg.next(r.h - 1);
+			found = r.free(seed.x, seed.y, seed.x, seed.y) && Region::apart(r.forests, seed.x, seed.y, forest_spacing);
+		}
+
+		if (!found)
+			break;
+
+		size_t size = std::min<size_t>(trees, forest_size / 2 + r.lcg.next(forest_size));
+
+		r.forests.push_back(seed);
+		forest.assign(1, seed);
+		r.take(seed.x, seed.y, seed.x, seed.y);
+		r.add(out, seed.x, seed.y, ResourceType::wood, (unsigned)(r.lcg.next() % 4));
+
+		for (unsigned i = 0; forest.size() < size && i < tries * size; ++i) {
+			static const int dir[][2] = {{1, 0}, {0, 1}, {-1, 0}, {0, -1}};
+
+			const Spot &from = forest[r.lcg.next(forest.size() - 1)];
+			const int *d = dir[r.lcg.next() % 4];
+			Spot to{from.x + d[0], from.y + d[1]};
+
+			if (!r.free(to.x, to.y, to.x, to.y))
+				continue;
+
+			forest.push_back(to);
+			r.take(to.x, to.y, to.x, to.y);
+			r.add(out, to.x, to.y, ResourceType::wood, (unsigned)(r.lcg.next() % 4));
+		}
+
+		trees -= forest.size();
+	}
+}
+
+/** Part of \a total for an area of \a area tiles that follows \a area_before tiles, such that all parts add up exactly. */
+static size_t share(size_t total, size_t area_before, size_t area, size_t tiles) {
+	return (size_t)((unsigned long long)total * (area_before + area) / tiles - (unsigned long long)total * area_before / tiles);
+}
+
+std::vector<MapObject> MapGenerator::generate(unsigned players, Scheduler &sched, Stats *stats) const {
+	double tiles = (double)w * h;
+	size_t trees = (size_t)round(pow(tiles, 0.6));
+	size_t goldstone = players + (size_t)round(pow(tiles, 0.23)) - 2;
+	size_t bushes = players + (size_t)round(pow(tiles, 0.25)) - 1;
+
+	// the number of groups per type rather than the number of objects
+	const size_t total[] = {trees, bushes, goldstone, goldstone};
+
+	size_t count = (size_t)rw * rh;
+	std::vector<std::vector<MapObject>> out(count);
+	std::vector<std::array<size_t, 4>> placed(count);
+	std::vector<std::array<size_t, 4>> wanted(count);
+
+	// distribute all groups over the regions in proportion to their area
+	for (size_t i = 0, before = 0; i < count; ++i) {
+		unsigned rx = (unsigned)(i % rw), ry = (unsigned)(i / rw);
+		size_t area = (size_t)(std::min(w - (rx << region_bits), region_size) * std::min(h - (ry << region_bits), region_size));
+
+		for (unsigned t = 0; t < 4; ++t)
+			wanted[i][t] = share(total[t], before, area, (size_t)w * h);
+
+		before += area;
+	}
+
+	sched.parallel_for(count, 1, [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; ++i) {
+			// common on huge maps, since the number of objects grows slower than the area
+			if (std::all_of(wanted[i].begin(), wanted[i].end(), [](size_t n) { return n == 0; }))
+				continue;
+
+			unsigned rx = (unsigned)(i % rw), ry = (unsigned)(i / rw);
+			int left = (int)(rx << region_bits), top = (int)(ry << region_bits);
+
+			Region r(left, top, std::min(w - left, region_size), std::min(h - top, region_size), stream_seed(seed, rx, ry));
+			generate(r, wanted[i].data(), out[i]);
+			std::copy(std::begin(r.placed), std::end(r.placed), placed[i].begin());
+		}
+	}, "mapgen");
+
+	std::vector<MapObject> objects;
+	size_t n = 0;
+
+	for (const auto &v : out)
+		n += v.size();
+
+	objects.reserve(n);
+
+	for (const auto &v : out)
+		objects.insert(objects.end(), v.begin(), v.end());
+
+	if (stats) {
+		// objects per group
+		const unsigned group[] = {1, (unsigned)(sizeof bush_shape / sizeof bush_shape[0]), 4, 4};
+
+		for (unsigned t = 0; t < 4; ++t) {
+			stats->wanted[t] = group[t] * total[t];
+			stats->placed[t] = 0;
+
+			for (const auto &p : placed)
+				stats->placed[t] += p[t];
+		}
+
+		stats->regions = count;
+	}
+
+	return objects;
+}
+
+}
+
+}
@@ -0,0 +1,70 @@
+/* Copyright 2016-2020 the Age of Empires Free Software Remake authors. See LEGAL for legal info */
+
+#pragma once
+
+/*
+ * Random map generator for static objects: forests, berry bushes and gold and stone mines.
+ *
+ * The map is split in regions of 64x64 tiles that are generated independently, each
+ * with its own random stream and occupancy bitmap. Objects never extend beyond their
+ * region, so regions can be generated in any order or in parallel and the result is
+ * always the same for a given seed. Mines and bushes are spread out with Poisson disc
+ * sampling and keep a free ring around them, while trees are grown in clusters.
+ */
+
+#include "world.hpp"
+#include "job.hpp"
+
+#include <cstddef>
+#include <cstdint>
+
+#include <vector>
+
+namespace genie {
+
+namespace game {
+
+/** Static object that has been placed by the generator. */
+struct MapObject final {
+	uint16_t x, y;
+	ResourceType type;
+	uint8_t variant; /**< animation offset for trees or image for mines */
+};
+
+class MapGenerator final {
+public:
+	static constexpr unsigned region_bits = 6, region_size = 1 << region_bits;
+
+	/** Number of objects of each type that have been asked for and have been placed. */
+	struct Stats final {
+		size_t wanted[4], placed[4]; /**< indexed by ResourceType */
+		size_t regions;
+	};
+private:
+	struct Reserved final {
+		int left, top, right, bottom; /**< right and bottom are exclusive */
+	};
+
+	unsigned w, h, rw, rh; /**< rw and rh are the number of regions in each direction */
+	uint32_t seed;
+	std::vector<Reserved> reserved;
+public:
+	MapGenerator(unsigned w, unsigned h, uint32_t seed);
+
+	/** Keep objects out of the specified area, e.g. for player bases. */
+	void reserve(int left, int top, unsigned w, unsigned h);
+
+	/**
+	 * Place all objects for a match with \a players players. Objects are returned in
+	 * region order, so the result does not depend on the number of threads in \a sched.
+	 */
+	std::vector<MapObject> generate(unsigned players, Scheduler &sched, Stats *stats=nullptr) const;
+private:
+	class Region;
+
+	void generate(Region &r, const size_t wanted[4], std::vector<MapObject> &out) const;
+};
+
+}
+
+}
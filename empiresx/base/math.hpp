@@ -4,6 +4,9 @@
 
 #include <cstdint>
 
+#include <algorithm>
+#include <type_traits>
+
 namespace genie {
 
 #ifndef M_PI
@@ -31,10 +34,261 @@ static constexpr inline uint64_t makepow2(uint64_t v) noexcept {
 	return ispow2(v) ? v : nextpow2(v);
 }
 
+/**
+ * Signed fixed-point number with 14 fractional bits, which is enough for tile
+ * coordinates on the largest maps with sub-pixel precision. All operations are
+ * plain integer math, so the results are identical on every platform. This is what
+ * the simulation uses, while rendering sticks to floats.
+ *
+ * Integers convert implicitly, but floats have to go through from(), which should
+ * only be used for compile-time constants.
+ */
+class Fixed final {
+public:
+	static constexpr unsigned bits = 14;
+	static constexpr int32_t one = INT32_C(1) << bits;
+
+	int32_t raw;
+
+	constexpr Fixed() noexcept : raw(0) {}
+
+	template<typename I, typename std::enable_if<std::is_integral<I>::value, int>::type = 0>
+	constexpr Fixed(I v) noexcept : raw((int32_t)v * one) {}
+
+	Fixed(float) = delete;
+	Fixed(double) = delete;
+
+	static constexpr Fixed from_raw(int32_t raw) noexcept {
+		Fixed f;
+		f.raw = raw;
+		return f;
+	}
+
+	/** Round \a v to the nearest fixed-point number. */
+	static constexpr Fixed from(double v) noexcept {
+		return from_raw((int32_t)(v * one + (v < 0 ? -0.5 : 0.5)));
+	}
+
+	/** Truncate towards zero just like casting a float does. */
+	explicit constexpr operator int() const noexcept {
+		return raw < 0 ? -(-raw >> bits) : raw >> bits;
+	}
+
+	explicit constexpr operator float() const noexcept {
+		return (float)raw / one;
+	}
+
+	/** Round towards negative infinity. */
+	constexpr int floor() const noexcept {
+		return (int)(raw >= 0 ? raw / one : -((-(int64_t)raw + one - 1) / one));
+	}
+
+	constexpr Fixed operator-() const noexcept { return from_raw(-raw); }
+
+	constexpr Fixed &operator+=(Fixed v) noexcept { raw += v.raw; return *this; }
+	constexpr Fixed &operator-=(Fixed v) noexcept { raw -= v.raw; return *this; }
+	/** Product is truncated towards zero. */
+	constexpr Fixed &operator*=(Fixed v) noexcept { raw = (int32_t)((int64_t)raw * v.raw / one); return *this; }
+	/** Quotient is truncated towards zero. It is undefined to divide by zero. */
+	constexpr Fixed &operator/=(Fixed v) noexcept { raw = (int32_t)((int64_t)raw * one / v.raw); return *this; }
+
+	friend constexpr Fixed operator+(Fixed lhs, Fixed rhs) noexcept { return lhs += rhs; }
+	friend constexpr Fixed operator-(Fixed lhs, Fixed rhs) noexcept { return lhs -= rhs; }
+	friend constexpr Fixed operator*(Fixed lhs, Fixed rhs) noexcept { return lhs *= rhs; }
+	friend constexpr Fixed operator/(Fixed lhs, Fixed rhs) noexcept { return lhs /= rhs; }
+
+	friend constexpr bool operator==(Fixed lhs, Fixed rhs) noexcept { return lhs.raw == rhs.raw; }
+	friend constexpr bool operator!=(Fixed lhs, Fixed rhs) noexcept { return lhs.raw != rhs.raw; }
+	friend constexpr bool operator<(Fixed lhs, Fixed rhs) noexcept { return lhs.raw < rhs.raw; }
+	friend constexpr bool operator<=(Fixed lhs, Fixed rhs) noexcept { return lhs.raw <= rhs.raw; }
+	friend constexpr bool operator>(Fixed lhs, Fixed rhs) noexcept { return lhs.raw > rhs.raw; }
+	friend constexpr bool operator>=(Fixed lhs, Fixed rhs) noexcept { return lhs.raw >= rhs.raw; }
+};
+
+/** Largest integer whose square does not exceed \a v. */
+static constexpr inline uint32_t isqrt(uint64_t v) noexcept {
+	uint64_t res = 0, bit = UINT64_C(1) << 62;
+
+	while (bit > v)
+		bit >>= 2;
+
+	while (bit) {
+		if (v >= res + bit) {
+			v -= res + bit;
+			res = (res >> 1) + bit;
+		} else {
+			res >>= 1;
+		}
+		bit >>= 2;
+	}
+
+	return (uint32_t)res;
+}
+
+/*
+ * Angles are binary: a full turn is 65536, so they wrap around for free when stored
+ * in an uint16_t. Zero points along the positive x-axis and angles increase towards
+ * the positive y-axis.
+ */
+static constexpr uint32_t angle_full = 65536, angle_quarter = angle_full / 4, angle_eighth = angle_full / 8;
+
+namespace detail {
+
+/** Number of steps in the trigonometry tables for a quarter and an eighth of a turn respectively. */
+static constexpr unsigned sin_steps = 1024, atan_steps = 1024;
+
+struct TrigTables final {
+	int32_t sin[sin_steps + 1]; /**< sin over [0, pi/2] in Fixed::raw */
+	uint16_t atan[atan_steps + 1]; /**< atan over [0, 1] in binary angles */
+};
+
+/*
+ * The tables are computed by the compiler, so they do not depend on any libm. The
+ * series converge to well below the precision of the tables.
+ */
+constexpr double sin_series(double x) {
+	double term = x, sum = x;
+
+	for (int i = 1; i < 16; ++i) {
+		term *= -x * x / ((2 * i) * (2 * i + 1));
+		sum += term;
+	}
+
+	return sum;
+}
+
+constexpr double atan_series(double x) {
+	// atan(x) = pi/4 + atan((x - 1) / (x + 1)) keeps the argument small enough to converge quickly
+	double off = 0;
+
+	if (x > 0.41421356237309503) {
+		off = M_PI / 4;
+		x = (x - 1) / (x + 1);
+	}
+
+	double term = x, sum = x;
+
+	for (int i = 1; i < 24; ++i) {
+		term *= -x * x;
+		sum += term / (2 * i + 1);
+	}
+
+	return off + sum;
+}
+
+constexpr TrigTables make_trig_tables() {
+	TrigTables t{};
+
+	for (unsigned i = 0; i <= sin_steps; ++i)
+		t.sin[i] = (int32_t)(sin_series(M_PI / 2 * i / sin_steps) * Fixed::one + 0.5);
+
+	for (unsigned i = 0; i <= atan_steps; ++i)
+		t.atan[i] = (uint16_t)(atan_series((double)i / atan_steps) / (2 * M_PI) * angle_full + 0.5);
+
+	return t;
+}
+
+inline constexpr TrigTables trig = make_trig_tables();
+
+}
+
+namespace detail {
+
+/** Interpolated sin for \a a in [0, angle_quarter]. */
+constexpr int32_t sin_quarter(uint32_t a) {
+	constexpr uint32_t step = angle_quarter / sin_steps;
+	uint32_t i = a / step, frac = a % step;
+
+	if (!frac)
+		return trig.sin[i];
+
+	return trig.sin[i] + (int32_t)((trig.sin[i + 1] - trig.sin[i]) * (int32_t)frac / (int32_t)step);
+}
+
+}
+
+/** Sine of binary angle \a a. */
+static constexpr inline Fixed fsin(uint16_t a) noexcept {
+	uint32_t q = a / angle_quarter, r = a % angle_quarter;
+
+	if (q & 1)
+		r = angle_quarter - r;
+
+	int32_t v = detail::sin_quarter(r);
+	return Fixed::from_raw(q & 2 ? -v : v);
+}
+
+/** Cosine of binary angle \a a. */
+static constexpr inline Fixed fcos(uint16_t a) noexcept {
+	return fsin((uint16_t)(a + angle_quarter));
+}
+
+/** Binary angle of the vector (\a x, \a y). The angle of the zero vector is zero. */
+static constexpr inline uint16_t fatan2(int64_t y, int64_t x) noexcept {
+	if (!x && !y)
+		return 0;
+
+	uint64_t ax = x < 0 ? -x : x, ay = y < 0 ? -y : y;
+	// reduce to the first octant
+	bool swap = ay > ax;
+	uint64_t num = swap ? ax : ay, den = swap ? ay : ax;
+
+	// interpolate between the closest table entries
+	uint64_t pos = num * detail::atan_steps;
+	uint64_t i = pos / den, rem = pos % den;
+	uint32_t a = detail::trig.atan[i];
+
+	if (rem)
+		a += (uint32_t)(((uint64_t)(detail::trig.atan[i + 1] - a) * rem + den / 2) / den);
+
+	if (swap)
+		a = angle_quarter - a;
+	if (x < 0)
+		a = angle_full / 2 - a;
+	if (y < 0)
+		a = angle_full - a;
+
+	return (uint16_t)a;
+}
+
 template<typename T>
 static constexpr void tile_to_scr(T &x, T &y, T tx, T ty) {
 	y = (tx - ty) * th / 2;
 	x = (tx + ty) * tw / 2;
 }
 
+/** Division that rounds towards negative infinity. \a d must be positive. */
+static constexpr int floor_div(int n, int d) noexcept {
+	return n >= 0 ? n / d : -((-n + d - 1) / d);
+}
+
+/**
+ * Call \a fn(tx, ty, x, y) for every cell on a \a w by \a h isometric grid of \a cw by
+ * \a ch pixel diamonds whose screen position x, y lies within \a x0..x1 and \a y0..y1,
+ * both inclusive. Rows of the diamond are visited from top to bottom.
+ *
+ * The ranges are mapped back to u = tx + ty and v = tx - ty, which only leaves the
+ * cells that are on screen. This is much cheaper than testing every cell on big maps.
+ */
+template<typename F>
+static void visible_cells(int w, int h, int cw, int ch, int x0, int y0, int x1, int y1, F fn) {
+	int u0 = -floor_div(-x0, cw / 2), u1 = floor_div(x1, cw / 2);
+	int v0 = std::max(-floor_div(-y0, ch / 2), 1 - h), v1 = std::min(floor_div(y1, ch / 2), w - 1);
+
+	for (int v = v0; v <= v1; ++v) {
+		// both tx = (u + v) / 2 and ty = (u - v) / 2 have to be on the map, so u has the same parity as v
+		int lo = std::max(u0, v < 0 ? -v : v), hi = std::min(u1, std::min(2 * w - 2 - v, 2 * h - 2 + v));
+		lo += (lo ^ v) & 1;
+
+		for (int u = lo; u <= hi; u += 2)
+			fn((u + v) / 2, (u - v) / 2, u * (cw / 2), v * (ch / 2));
+	}
+}
+
+/** Same as visible_cells for the tiles of the map, whose screen position is given by tile_to_scr. */
+template<typename F>
+static void visible_tiles(int w, int h, int x0, int y0, int x1, int y1, F fn) {
+	visible_cells(w, h, tw, th, x0, y0, x1, y1, fn);
+}
+
 }
@@ -266,7 +266,7 @@ void StartMatch::dump() const {
 
 StartMatch StartMatch::random(unsigned slave_count, unsigned player_count) {
 	unsigned size = player_count <= 8 ? map_sizes[player_count] : (player_count + 6) * 12;
-	// maps bigger than 65536*65536 are not supported, since we would need at least 4GB of RAM
+	// the map size is sent as 16 bit. memory is not an issue, since chunks are only allocated when they are used
 	assert(size <= UINT16_MAX);
 	
 	StartMatch m{(uint8_t)rand(), 0, (uint16_t)size, (uint16_t)size, (uint32_t)rand(), (uint8_t)rand(), (uint8_t)rand(), 1, 1, (uint16_t)slave_count};
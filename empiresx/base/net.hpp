@@ -94,6 +94,9 @@ struct StartMatch final {
 	void dump() const;
 };
 
+/** Map size for each number of players up to eight. */
+extern const unsigned map_sizes[9];
+
 struct TextMsg final {
 	user_id from;
 	char text[TEXT_LIMIT];
@@ -189,6 +192,8 @@ public:
 	virtual void removepeer(sockfd fd) = 0;
 	virtual void shutdown() = 0;
 	virtual void event_process(sockfd fd, Command &cmd) = 0;
+	/** Send anything that other threads have queued. This is called by the network thread before it waits for events. */
+	virtual void flush() = 0;
 };
 
 /** ServerSocket errors */
@@ -263,6 +268,7 @@ class ServerSocket final {
 	Socket sock;
 #if linux
 	int efd;
+	int wfd; /**< eventfd to wake up the event loop */
 	std::set<int> peers;
 #elif windows
 	std::vector<pollev> peers, keep;
@@ -283,6 +289,8 @@ public:
 	void accept(bool b) { accepting.store(b); }
 
 	void close();
+	/** Make the event loop call ServerCallback::flush soon. This is safe to call from any thread. */
+	void wake();
 
 	SSErr push(sockfd fd, const Command &cmd, bool net_order=false);
 	void broadcast(ServerCallback &cb, Command &cmd, bool net_order=false, bool ignore_bad=false);
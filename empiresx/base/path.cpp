@@ -0,0 +1,612 @@
+/* Copyright 2016-2020 the Age of Empires Free Software Remake authors. See LEGAL for legal info */
+
+#include "path.hpp"
+
+#include "world.hpp"
+
+#include <cassert>
+#include <cstdlib>
+
+#include <algorithm>
+#include <functional>
+
+namespace genie {
+
+namespace game {
+
+// costs are scaled by 10 to keep diagonal moves in integer arithmetic
+static constexpr unsigned cost_straight = 10, cost_diagonal = 14;
+/** Long entrances get a transition on both ends, short ones only in the middle. */
+static constexpr int entrance_split = 6;
+static constexpr size_t cache_max = 4096;
+
+static const int dir_dx[] = {1, 0, -1, 0, 1, -1, -1, 1};
+static const int dir_dy[] = {0, 1, 0, -1, 1, 1, -1, -1};
+
+static unsigned octile(const Vector2<int> &a, const Vector2<int> &b) {
+	unsigned dx = (unsigned)abs(a.x - b.x), dy = (unsigned)abs(a.y - b.y);
+	return cost_straight * (dx + dy) + (cost_diagonal - 2 * cost_straight) * std::min(dx, dy);
+}
+
+PathFinder::PathFinder(Map &map)
+	: map(map), cw((map.w + cluster_size - 1) / cluster_size), ch((map.h + cluster_size - 1) / cluster_size)
+	, kw((cw + chunk_size - 1) >> chunk_bits), chunks((size_t)kw * ((ch + chunk_size - 1) >> chunk_bits))
+	, nodes(), unused(), cache(), clock(0), pending(), scratch(), graph() {}
+
+void PathFinder::invalidate(int left, int top, unsigned w, unsigned h) {
+	int right = std::min(left + (int)w, (int)map.w) - 1, bottom = std::min(top + (int)h, (int)map.h) - 1;
+	left = std::max(left, 0);
+	top = std::max(top, 0);
+
+	if (left > right || top > bottom)
+		return;
+
+	unsigned cx0 = (unsigned)left / cluster_size, cx1 = (unsigned)right / cluster_size;
+	unsigned cy0 = (unsigned)top / cluster_size, cy1 = (unsigned)bottom / cluster_size;
+
+	// neighbours lose their entrances on the borders and the edges between them as well
+	for (auto it = cache.begin(); it != cache.end();) {
+		bool touched = std::any_of(it->second.nodes.begin(), it->second.nodes.end(), [&](unsigned n) {
+			unsigned cx = nodes[n].cluster % cw, cy = nodes[n].cluster / cw;
+			return cx + 1 >= cx0 && cx <= cx1 + 1 && cy + 1 >= cy0 && cy <= cy1 + 1;
+		});
+
+		if (touched)
+			it = cache.erase(it);
+		else
+			++it;
+	}
+
+	// the entrances of a cluster depend on the tiles on both sides of its borders, which
+	// all belong to the cluster or its neighbours, so those are all that need to change.
+	for (unsigned ky = cy0 >> chunk_bits; ky <= cy1 >> chunk_bits; ++ky)
+		for (unsigned kx = cx0 >> chunk_bits; kx <= cx1 >> chunk_bits; ++kx) {
+			if (!chunks[(size_t)ky * kw + kx])
+				continue;
+
+			unsigned y0 = std::max(cy0, ky << chunk_bits), y1 = std::min(cy1, ((ky + 1) << chunk_bits) - 1);
+			unsigned x0 = std::max(cx0, kx << chunk_bits), x1 = std::min(cx1, ((kx + 1) << chunk_bits) - 1);
+
+			for (unsigned cy = y0; cy <= y1; ++cy)
+				for (unsigned cx = x0; cx <= x1; ++cx) {
+					unsigned c = cy * cw + cx;
+
+					unlink(c);
+
+					for (unsigned side = 0; side < 4; ++side)
+						disconnect(c, side);
+				}
+		}
+}
+
+PathFinder::Area PathFinder::cluster_area(unsigned c) const noexcept {
+	int left = (int)(c % cw) * cluster_size, top = (int)(c / cw) * cluster_size;
+	return Area{left, top, std::min(left + cluster_size, (int)map.w) - 1, std::min(top + cluster_size, (int)map.h) - 1};
+}
+
+unsigned PathFinder::cluster(const Vector2<int> &pos) const noexcept {
+	return (unsigned)(pos.y / cluster_size) * cw + (unsigned)(pos.x / cluster_size);
+}
+
+PathFinder::Cluster &PathFinder::at(unsigned c) {
+	unsigned cx = c % cw, cy = c / cw;
+	auto &k = chunks[(size_t)(cy >> chunk_bits) * kw + (cx >> chunk_bits)];
+
+	if (!k)
+		k.reset(new ClusterChunk());
+
+	return k->clusters[(cy & (chunk_size - 1)) * chunk_size + (cx & (chunk_size - 1))];
+}
+
+PathFinder::Cluster *PathFinder::find_cluster(unsigned c) const noexcept {
+	unsigned cx = c % cw, cy = c / cw;
+	ClusterChunk *k = chunks[(size_t)(cy >> chunk_bits) * kw + (cx >> chunk_bits)].get();
+
+	return k ? &k->clusters[(cy & (chunk_size - 1)) * chunk_size + (cx & (chunk_size - 1))] : nullptr;
+}
+
+unsigned PathFinder::neighbour(unsigned c, unsigned side) const noexcept {
+	unsigned cx = c % cw, cy = c / cw;
+
+	switch (side) {
+	case side_right: return cx + 1 < cw ? c + 1 : none;
+	case side_bottom: return cy + 1 < ch ? c + cw : none;
+	case side_left: return cx ? c - 1 : none;
+	default: return cy ? c - cw : none;
+	}
+}
+
+void PathFinder::ensure(unsigned c) {
+	Cluster &cl = at(c);
+
+	if (cl.linked)
+		return;
+
+	for (unsigned side = 0; side < 4; ++side) {
+		if (cl.borders & (1u << side))
+			continue;
+
+		unsigned n = neighbour(c, side);
+
+		// borders are connected by the cluster on the left or top
+		if (n == none)
+			cl.borders |= 1u << side;
+		else if (side == side_right || side == side_bottom)
+			connect(c, side == side_bottom);
+		else
+			connect(n, side == side_top);
+	}
+
+	// link in the same order no matter in which order the borders have been connected
+	std::sort(cl.entrances.begin(), cl.entrances.end(), [this](unsigned a, unsigned b) { return nodes[a].key < nodes[b].key; });
+	link_cluster(scratch, c);
+	cl.linked = true;
+}
+
+void PathFinder::connect(unsigned c, bool vertical) {
+	Area a = cluster_area(c);
+	int first = vertical ? a.left : a.top, last = vertical ? a.right : a.bottom;
+	int start = -1;
+
+	at(c).borders |= 1u << (vertical ? side_bottom : side_right);
+	at(neighbour(c, vertical ? side_bottom : side_right)).borders |= 1u << (vertical ? side_top : side_left);
+
+	for (int i = first; i <= last + 1; ++i) {
+		bool pass = false;
+
+		if (i <= last)
+			pass = vertical ? map.passable(i, a.bottom) && map.passable(i, a.bottom + 1)
+				: map.passable(a.right, i) && map.passable(a.right + 1, i);
+
+		if (pass) {
+			if (start < 0)
+				start = i;
+			continue;
+		}
+
+		if (start < 0)
+			continue;
+
+		int len = i - start;
+		int picks[2] = {start + len / 2, i - 1};
+		unsigned count = 1;
+
+		if (len >= entrance_split) {
+			picks[0] = start;
+			count = 2;
+		}
+
+		for (unsigned j = 0; j < count; ++j) {
+			if (vertical)
+				link(Vector2<int>(picks[j], a.bottom), Vector2<int>(picks[j], a.bottom + 1), true);
+			else
+				link(Vector2<int>(a.right, picks[j]), Vector2<int>(a.right + 1, picks[j]), false);
+		}
+
+		start = -1;
+	}
+}
+
+void PathFinder::disconnect(unsigned c, unsigned side) {
+	Cluster &cl = at(c);
+
+	if (!(cl.borders & (1u << side)))
+		return;
+
+	cl.borders &= ~(1u << side);
+
+	unsigned n = neighbour(c, side);
+
+	if (n == none)
+		return;
+
+	// the neighbour loses entrances, so its paths between them are gone as well
+	unlink(n);
+
+	Cluster &other = at(n);
+	other.borders &= ~(1u << (side ^ 2));
+
+	auto across = [&](unsigned e) { return nodes[nodes[e].edges[0].to].cluster == n; };
+	auto mid = std::stable_partition(cl.entrances.begin(), cl.entrances.end(), [&](unsigned e) { return !across(e); });
+
+	for (auto it = mid; it != cl.entrances.end(); ++it) {
+		unsigned e = *it, partner = nodes[e].edges[0].to;
+
+		other.entrances.erase(std::find(other.entrances.begin(), other.entrances.end(), partner));
+		remove_node(partner);
+		remove_node(e);
+	}
+
+	cl.entrances.erase(mid, cl.entrances.end());
+}
+
+unsigned PathFinder::add_node(const Vector2<int> &pos, unsigned side) {
+	unsigned n;
+
+	if (unused.empty()) {
+		n = (unsigned)nodes.size();
+		nodes.emplace_back();
+	} else {
+		n = unused.back();
+		unused.pop_back();
+	}
+
+	Node &node = nodes[n];
+	node.pos = pos;
+	node.cluster = cluster(pos);
+	node.key = ((uint64_t)(unsigned)pos.y * map.w + (unsigned)pos.x) << 2 | side;
+	node.edges.clear();
+
+	at(node.cluster).entrances.push_back(n);
+	return n;
+}
+
+unsigned PathFinder::find_node(uint64_t key) {
+	uint64_t tile = key >> 2;
+
+	if (tile >= (uint64_t)map.w * map.h)
+		return none;
+
+	unsigned c = cluster(Vector2<int>((int)(tile % map.w), (int)(tile / map.w)));
+	ensure(c);
+
+	for (unsigned n : at(c).entrances)
+		if (nodes[n].key == key)
+			return n;
+
+	return none;
+}
+
+void PathFinder::remove_node(unsigned n) {
+	nodes[n].cluster = none;
+	nodes[n].edges.clear();
+	unused.push_back(n);
+}
+
+void PathFinder::link(const Vector2<int> &a, const Vector2<int> &b, bool vertical) {
+	unsigned na = add_node(a, vertical ? side_bottom : side_right);
+	unsigned nb = add_node(b, vertical ? side_top : side_left);
+
+	nodes[na].edges.push_back(Edge{nb, cost_straight, TilePath()});
+	nodes[nb].edges.push_back(Edge{na, cost_straight, TilePath()});
+}
+
+void PathFinder::unlink(unsigned c) {
+	Cluster *cl = find_cluster(c);
+
+	if (!cl || !cl->linked)
+		return;
+
+	// keep the edge to the neighbouring cluster
+	for (unsigned e : cl->entrances)
+		nodes[e].edges.erase(nodes[e].edges.begin() + 1, nodes[e].edges.end());
+
+	cl->linked = false;
+}
+
+void PathFinder::link_cluster(Search &s, unsigned c) {
+	const std::vector<unsigned> &list = at(c).entrances;
+	Area area = cluster_area(c);
+	TilePath p;
+
+	for (size_t i = 0; i < list.size(); ++i)
+		for (size_t j = i + 1; j < list.size(); ++j) {
+			unsigned ni = list[i], nj = list[j];
+			unsigned cost = search(s, &p, nodes[ni].pos, nodes[nj].pos, area);
+
+			if (cost == no_path)
+				continue;
+
+			// walking back visits the same tiles, but ends at the other entrance
+			TilePath back;
+			back.reserve(p.size());
+			back.push_back(nodes[ni].pos);
+			for (size_t k = p.size(); k-- > 1;)
+				back.push_back(p[k]);
+
+			nodes[ni].edges.push_back(Edge{nj, cost, std::move(p)});
+			nodes[nj].edges.push_back(Edge{ni, cost, std::move(back)});
+
+			p.clear();
+		}
+}
+
+unsigned PathFinder::search(Search &s, TilePath *path, const Vector2<int> &from, const Vector2<int> &to, const Area &area) const {
+	if (from == to)
+		return 0;
+
+	int aw = area.right - area.left + 1, ah = area.bottom - area.top + 1;
+	size_t size = (size_t)aw * ah;
+	auto &g = s.g, &parent = s.parent, &stamp = s.stamp;
+	auto &open = s.open;
+
+	if (stamp.size() < size) {
+		g.resize(size);
+		parent.resize(size);
+		stamp.resize(size, 0);
+	}
+
+	unsigned generation = ++s.generation;
+
+	if (!generation) {
+		std::fill(stamp.begin(), stamp.end(), 0);
+		generation = s.generation = 1;
+	}
+
+	auto index = [&](int x, int y) { return (unsigned)((y - area.top) * aw + (x - area.left)); };
+
+	unsigned start = index(from.x, from.y), goal = index(to.x, to.y);
+
+	open.clear();
+	stamp[start] = generation;
+	g[start] = 0;
+	parent[start] = start;
+	open.emplace_back(octile(from, to), start);
+
+	while (!open.empty()) {
+		std::pop_heap(open.begin(), open.end(), std::greater<std::pair<unsigned, unsigned>>());
+		auto item = open.back();
+		open.pop_back();
+
+		unsigned i = item.second;
+		Vector2<int> pos(area.left + (int)(i % aw), area.top + (int)(i / aw));
+
+		// skip stale entries that have been superseded by a cheaper path
+		if (item.first != g[i] + octile(pos, to))
+			continue;
+
+		++s.expanded;
+
+		if (i == goal) {
+			if (path)
+				for (unsigned j = goal; j != start; j = parent[j])
+					path->emplace_back(area.left + (int)(j % aw), area.top + (int)(j / aw));
+			return g[goal];
+		}
+
+		for (unsigned d = 0; d < 8; ++d) {
+			int x = pos.x + dir_dx[d], y = pos.y + dir_dy[d];
+
+			if (x < area.left || x > area.right || y < area.top || y > area.bottom || !map.passable(x, y))
+				continue;
+
+			// do not cut corners of blocked tiles
+			if (d >= 4 && (!map.passable(pos.x, y) || !map.passable(x, pos.y)))
+				continue;
+
+			unsigned n = index(x, y), cost = g[i] + (d >= 4 ? cost_diagonal : cost_straight);
+
+			if (stamp[n] == generation && g[n] <= cost)
+				continue;
+
+			stamp[n] = generation;
+			g[n] = cost;
+			parent[n] = i;
+
+			open.emplace_back(cost + octile(Vector2<int>(x, y), to), n);
+			std::push_heap(open.begin(), open.end(), std::greater<std::pair<unsigned, unsigned>>());
+		}
+	}
+
+	return no_path;
+}
+
+bool PathFinder::search_abstract(std::vector<unsigned> &route, const Vector2<int> &from, const Vector2<int> &to) {
+	unsigned cs = cluster(from), cg = cluster(to);
+	Area as = cluster_area(cs), ag = cluster_area(cg);
+
+	ensure(cs);
+	ensure(cg);
+
+	std::vector<std::pair<unsigned, unsigned>> start_edges, goal_edges;
+
+	for (unsigned e : at(cs).entrances) {
+		unsigned cost = search(scratch, nullptr, from, nodes[e].pos, as);
+		if (cost != no_path)
+			start_edges.emplace_back(e, cost);
+	}
+
+	for (unsigned e : at(cg).entrances) {
+		unsigned cost = search(scratch, nullptr, nodes[e].pos, to, ag);
+		if (cost != no_path)
+			goal_edges.emplace_back(e, cost);
+	}
+
+	if (start_edges.empty() || goal_edges.empty())
+		return false;
+
+	typedef std::tuple<unsigned, uint64_t, unsigned> Item;
+	GraphSearch &s = graph;
+	auto &g = s.g, &parent = s.parent, &stamp = s.stamp;
+	auto &open = s.open;
+	unsigned generation = ++s.generation;
+
+	if (!generation) {
+		std::fill(stamp.begin(), stamp.end(), 0);
+		generation = s.generation = 1;
+	}
+
+	// the goal is not a node, so it gets its own cost and the highest key
+	unsigned goal_g = UINT_MAX, goal_parent = none;
+
+	auto relax = [&](unsigned n, unsigned from_node, unsigned cost) {
+		if (n == none) {
+			if (goal_g <= cost)
+				return;
+
+			goal_g = cost;
+			goal_parent = from_node;
+			open.emplace_back(cost, UINT64_MAX, none);
+		} else {
+			if (stamp.size() <= n) {
+				g.resize(nodes.size());
+				parent.resize(nodes.size());
+				stamp.resize(nodes.size(), 0);
+			}
+
+			if (stamp[n] == generation && g[n] <= cost)
+				return;
+
+			stamp[n] = generation;
+			g[n] = cost;
+			parent[n] = from_node;
+			open.emplace_back(cost + octile(nodes[n].pos, to), nodes[n].key, n);
+		}
+
+		std::push_heap(open.begin(), open.end(), std::greater<Item>());
+	};
+
+	open.clear();
+
+	for (auto &e : start_edges)
+		relax(e.first, none, e.second);
+
+	while (!open.empty()) {
+		std::pop_heap(open.begin(), open.end(), std::greater<Item>());
+		Item item = open.back();
+		open.pop_back();
+
+		unsigned n = std::get<2>(item);
+
+		if (n == none) {
+			if (std::get<0>(item) != goal_g)
+				continue;
+
+			route.clear();
+			for (unsigned j = goal_parent; j != none; j = parent[j])
+				route.push_back(j);
+			std::reverse(route.begin(), route.end());
+			return true;
+		}
+
+		if (std::get<0>(item) != g[n] + octile(nodes[n].pos, to))
+			continue;
+
+		// this may add nodes to the neighbours, but never removes any
+		ensure(nodes[n].cluster);
+
+		for (auto &e : nodes[n].edges)
+			relax(e.to, n, g[n] + e.cost);
+
+		if (nodes[n].cluster == cg)
+			for (auto &e : goal_edges)
+				if (e.first == n)
+					relax(none, n, g[n] + e.second);
+	}
+
+	return false;
+}
+
+bool PathFinder::refine(TilePath &path, const Vector2<int> &from, const Vector2<int> &to, const std::vector<unsigned> &route) {
+	assert(!route.empty());
+	TilePath seg;
+
+	path.clear();
+
+	// build the path backwards, since the next tile has to end up at the back
+	if (search(scratch, &seg, nodes[route.back()].pos, to, cluster_area(cluster(to))) == no_path)
+		return false;
+	path.insert(path.end(), seg.begin(), seg.end());
+
+	for (size_t i = route.size() - 1; i > 0; --i) {
+		const Node &a = nodes[route[i - 1]];
+		auto e = std::find_if(a.edges.begin(), a.edges.end(), [&](const Edge &e) { return e.to == route[i]; });
+
+		if (e == a.edges.end())
+			return false;
+
+		if (e->tiles.empty())
+			path.push_back(nodes[route[i]].pos);
+		else
+			path.insert(path.end(), e->tiles.begin(), e->tiles.end());
+	}
+
+	seg.clear();
+	if (search(scratch, &seg, from, nodes[route.front()].pos, cluster_area(cluster(from))) == no_path)
+		return false;
+	path.insert(path.end(), seg.begin(), seg.end());
+
+	return true;
+}
+
+bool PathFinder::find(TilePath &path, const Vector2<int> &from, const Vector2<int> &to) {
+	path.clear();
+
+	if (!map.passable(to.x, to.y))
+		return false;
+
+	if (from == to)
+		return true;
+
+	unsigned cs = cluster(from), cg = cluster(to);
+
+	// nearby targets are found directly, which also gives the best paths for short walks
+	if (abs((int)(cs % cw) - (int)(cg % cw)) <= 1 && abs((int)(cs / cw) - (int)(cg / cw)) <= 1) {
+		Area a0 = cluster_area(cs), a1 = cluster_area(cg);
+		Area area{std::min(a0.left, a1.left), std::min(a0.top, a1.top), std::max(a0.right, a1.right), std::max(a0.bottom, a1.bottom)};
+
+		if (search(scratch, &path, from, to, area) != no_path)
+			return true;
+
+		path.clear();
+	}
+
+	uint64_t key = (uint64_t)cs << 32 | cg;
+	auto hit = cache.find(key);
+
+	if (hit != cache.end()) {
+		hit->second.used = ++clock;
+
+		if (refine(path, from, to, hit->second.nodes))
+			return true;
+
+		// the start or goal is in a part of its cluster that the route does not lead to
+		path.clear();
+	}
+
+	std::vector<unsigned> route;
+
+	if (!search_abstract(route, from, to) || !refine(path, from, to, route)) {
+		path.clear();
+		return false;
+	}
+
+	if (hit == cache.end()) {
+		if (cache.size() >= cache_max)
+			cache.erase(std::min_element(cache.begin(), cache.end(), [](const auto &a, const auto &b) { return a.second.used < b.second.used; }));
+
+		hit = cache.emplace(key, Route()).first;
+	}
+
+	hit->second.nodes = std::move(route);
+	hit->second.used = ++clock;
+	return true;
+}
+
+void PathFinder::request(Unit &who, const Vector2<int> &from, const Vector2<int> &to) {
+	cancel(who);
+	pending.push_back(Request{&who, from, to});
+}
+
+void PathFinder::cancel(const Unit &who) {
+	pending.erase(std::remove_if(pending.begin(), pending.end(), [&](const Request &r) { return r.who == &who; }), pending.end());
+}
+
+void PathFinder::step(unsigned budget) {
+	TilePath path;
+
+	// the request that exceeds the budget is still finished, so every tick makes progress
+	for (scratch.expanded = 0; !pending.empty() && scratch.expanded < budget;) {
+		Request r = pending.front();
+		pending.pop_front();
+
+		if (!find(path, r.from, r.to))
+			path.clear();
+
+		r.who->follow(path);
+	}
+}
+
+}
+
+}
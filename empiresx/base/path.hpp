@@ -0,0 +1,188 @@
+/* Copyright 2016-2020 the Age of Empires Free Software Remake authors. See LEGAL for legal info */
+
+#pragma once
+
+/*
+ * Hierarchical path finding on the tile grid (see also HPA*).
+ *
+ * The map is divided into square clusters that are connected through entrances on
+ * their borders. Long paths are found on the small graph of entrances and refined to
+ * tiles with A* searches that never leave the clusters involved, so the cost of a
+ * query barely depends on the size of the map.
+ *
+ * Clusters are only connected once a search gets there and only the clusters that
+ * have been changed are disconnected again, so neither time nor memory depend on the
+ * size of the map until it has been explored. Searches order entrances by their tile
+ * instead of by the order they have been found in, so the graph does not depend on the
+ * order in which clusters have been connected.
+ *
+ * Routes over the entrances are cached by start and goal cluster, so units that walk
+ * from one area to another reuse the route that the first one has found. Connecting
+ * clusters and searching tiles are charged to the budget of step(). Both depend on
+ * what has been searched before, so the connected clusters and cached routes are part
+ * of save games. Requests share the graph and the cache, so they are processed one
+ * after another on the simulation thread rather than on the scheduler.
+ */
+
+#include "geom.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <climits>
+
+#include <deque>
+#include <memory>
+#include <tuple>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace genie {
+
+namespace game {
+
+class Map;
+class Unit;
+
+/** Tiles to visit in reverse order: the next tile to go to is always at the back. */
+typedef std::vector<Vector2<int>> TilePath;
+
+class PathFinder final {
+public:
+	static constexpr int cluster_size = 16;
+	/** Clusters are allocated in chunks of chunk_size by chunk_size clusters. */
+	static constexpr unsigned chunk_bits = 2, chunk_size = 1u << chunk_bits;
+	/** Default number of tile expansions per tick for pending requests. */
+	static constexpr unsigned default_budget = 4096;
+	static constexpr unsigned no_path = UINT_MAX;
+
+private:
+	static constexpr unsigned none = UINT_MAX;
+	static constexpr unsigned side_right = 0, side_bottom = 1, side_left = 2, side_top = 3;
+
+	/** Inclusive tile rectangle that restricts a search. */
+	struct Area final {
+		int left, top, right, bottom;
+	};
+
+	struct Edge final {
+		unsigned to, cost;
+		TilePath tiles; /**< tiles to walk for intra-cluster edges. empty if the entrances are adjacent */
+	};
+
+	/** Entrance tile on the border of a cluster. */
+	struct Node final {
+		Vector2<int> pos;
+		unsigned cluster; /**< none if the node is unused */
+		uint64_t key; /**< tile and side of the cluster. unique and independent of when the node has been made */
+		std::vector<Edge> edges; /**< the first one leads to the neighbouring cluster */
+	};
+
+	struct Cluster final {
+		std::vector<unsigned> entrances; /**< node ids */
+		uint8_t borders = 0; /**< bit per side that has been connected to the neighbouring cluster */
+		bool linked = false; /**< whether all borders are connected and entrances have been connected to each other */
+	};
+
+	struct ClusterChunk final {
+		Cluster clusters[chunk_size * chunk_size];
+	};
+
+	/** Entrances to visit from a start to a goal cluster. */
+	struct Route final {
+		std::vector<unsigned> nodes;
+		uint64_t used; /**< when the route has been used last. the least recently used one is dropped first */
+	};
+
+	struct Request final {
+		Unit *who;
+		Vector2<int> from, to;
+	};
+
+	/** Scratch space for tile searches. Reused to prevent allocating on every query. */
+	struct Search final {
+		std::vector<unsigned> g, parent, stamp;
+		std::vector<std::pair<unsigned, unsigned>> open; /**< binary heap of (estimated cost, tile) */
+		unsigned generation = 0;
+		unsigned expanded = 0; /**< tiles expanded since the last reset */
+	};
+
+	/** Scratch space for searches over the entrances. */
+	struct GraphSearch final {
+		std::vector<unsigned> g, parent, stamp;
+		std::vector<std::tuple<unsigned, uint64_t, unsigned>> open; /**< binary heap of (estimated cost, node key, node) */
+		unsigned generation = 0;
+	};
+
+	Map &map;
+	unsigned cw, ch; /**< number of clusters horizontally and vertically */
+	unsigned kw; /**< number of chunks horizontally */
+	std::vector<std::unique_ptr<ClusterChunk>> chunks; /**< y,x order. nullptr if no search has got there */
+	std::vector<Node> nodes;
+	std::vector<unsigned> unused; /**< node ids that can be reused */
+	std::unordered_map<uint64_t, Route> cache; /**< by start and goal cluster */
+	uint64_t clock; /**< for Route::used */
+	std::deque<Request> pending;
+	Search scratch;
+	GraphSearch graph;
+
+	friend class World;
+public:
+	PathFinder(Map &map);
+
+	/**
+	 * Disconnect the clusters that contain the specified tiles, e.g. when a building has
+	 * been placed. They are connected again once a search gets there. Only cached routes
+	 * that pass through these clusters or their neighbours are dropped.
+	 */
+	void invalidate(int left, int top, unsigned w, unsigned h);
+
+	/**
+	 * Find a path from \a from to \a to immediately. Returns false if \a to cannot be reached.
+	 * The start tile is not included in \a path.
+	 */
+	bool find(TilePath &path, const Vector2<int> &from, const Vector2<int> &to);
+
+	/** Queue path request. The unit is notified once the path has been computed in step(). */
+	void request(Unit &who, const Vector2<int> &from, const Vector2<int> &to);
+	/** Drop all pending requests for \a who. */
+	void cancel(const Unit &who);
+	/** Process pending requests until \a budget tiles have been expanded. */
+	void step(unsigned budget=default_budget);
+
+	size_t queued() const noexcept { return pending.size(); }
+private:
+	/** Cluster \a c. Its chunk is allocated if necessary. */
+	Cluster &at(unsigned c);
+	/** Cluster \a c or nullptr if its chunk has not been allocated. */
+	Cluster *find_cluster(unsigned c) const noexcept;
+	/** Neighbour of cluster \a c on \a side or none if \a c is at the edge of the map. */
+	unsigned neighbour(unsigned c, unsigned side) const noexcept;
+
+	/** Make sure cluster \a c is connected to its neighbours and its entrances to each other. */
+	void ensure(unsigned c);
+	/** Find the entrances between cluster \a c and the one on its right or below it. */
+	void connect(unsigned c, bool vertical);
+	void disconnect(unsigned c, unsigned side);
+	void link(const Vector2<int> &a, const Vector2<int> &b, bool vertical);
+	void link_cluster(Search &s, unsigned c);
+	/** Drop all edges within cluster \a c. */
+	void unlink(unsigned c);
+	unsigned add_node(const Vector2<int> &pos, unsigned side);
+	void remove_node(unsigned n);
+	/** Node with \a key, connecting its cluster if necessary, or none if there is no such node. */
+	unsigned find_node(uint64_t key);
+
+	Area cluster_area(unsigned c) const noexcept;
+	unsigned cluster(const Vector2<int> &pos) const noexcept;
+
+	/** Tile level A* restricted to \a area. Returns the path cost or no_path. */
+	unsigned search(Search &s, TilePath *path, const Vector2<int> &from, const Vector2<int> &to, const Area &area) const;
+	/** A* over the entrances, where \a from and \a to are temporarily connected to the entrances of their clusters. */
+	bool search_abstract(std::vector<unsigned> &route, const Vector2<int> &from, const Vector2<int> &to);
+	bool refine(TilePath &path, const Vector2<int> &from, const Vector2<int> &to, const std::vector<unsigned> &route);
+};
+
+}
+
+}
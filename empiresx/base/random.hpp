@@ -8,8 +8,10 @@
  */
 
 #include <cassert>
+#include <cstddef>
 #include <cstdint>
-#include <cmath>
+
+#include <type_traits>
 
 namespace genie {
 
@@ -17,51 +19,161 @@ namespace genie {
  * Linear Congruent Generator
  * Generic interface for non-cryptographically secure pseudo random number generators (PRNGs)
  * See also https://en.wikipedia.org/wiki/Linear_congruential_generator
+ *
+ * All parameters are known at compile time, so the modulo is just a mask if \a M is a
+ * power of two. Only bits in range [Start, End) of the state are returned, since the
+ * low bits of an LCG have short periods.
  */
-class LCG {
-	const uint64_t m, a, c;
-	uint64_t v, mask;
-	/** Range of bits [start, end) that is provided from the seed when next() is called */
-	unsigned start, end;
-public:
-	/**
-	 * Construct linear congruent generator that yields bits form range [start, end) starting with \a seed.
-	 * It is undefined if modulo is 0.
-	 */
-	LCG(uint64_t modulo, uint64_t multiplier, uint64_t increment, unsigned start, unsigned end, uint64_t seed=1)
-		: m(modulo), a(multiplier), c(increment), start(start), end(end), v(seed), mask(0)
-	{
-		for (unsigned i = 0; i < end - start; ++i)
-			mask = (mask << 1) | 1;
+template<uint64_t M, uint64_t A, uint64_t C, unsigned Start, unsigned End>
+class BasicLCG final {
+	static_assert(M > 1 && M <= UINT64_C(1) << 32, "modulo must fit in 32 bits, so products of two states cannot overflow");
+	static_assert(A < M && C < M, "multiplier and increment must be smaller than modulo");
+	static_assert(Start < End && (UINT64_C(1) << End) <= M, "bit range must be inside the state");
+
+	static constexpr uint64_t mask = (UINT64_C(1) << (End - Start)) - 1;
+
+	uint64_t v;
+
+	/** The affine map v -> a * v + c mod M, which advances the state by some number of steps. */
+	struct Step final {
+		uint64_t a, c;
+	};
+
+	/** Compute map that advances the state by \a n steps in O(log n). */
+	static constexpr Step step(uint64_t n) noexcept {
+		Step acc{1, 0}, cur{A, C};
+
+		for (; n; n >>= 1) {
+			if (n & 1)
+				acc = Step{cur.a * acc.a % M, (cur.a * acc.c + cur.c) % M};
+
+			cur = Step{cur.a * cur.a % M, (cur.a * cur.c + cur.c) % M};
+		}
+
+		return acc;
 	}
+public:
+	constexpr BasicLCG(uint64_t seed=1) noexcept : v(seed % M) {}
 
-	void seed(uint64_t v) noexcept { this->v = v; }
+	void seed(uint64_t v) noexcept { this->v = v % M; }
+	/** Current state. Seeding another generator with it makes it continue with the same sequence. */
+	uint64_t state() const noexcept { return v; }
 
 	// somewhere, stdlib.h gets included, but i have no clue where
 #undef max
 
-	constexpr uint64_t max() noexcept { return mask; }
+	static constexpr uint64_t max() noexcept { return mask; }
+	static constexpr unsigned bits() noexcept { return End - Start; }
 
 	uint64_t next() noexcept {
-		v = (a * v + c) % m;
-		return (v >> start) & mask;
+		v = (A * v + C) % M;
+		return (v >> Start) & mask;
 	}
 
 	uint64_t next(uint64_t high) noexcept { return next(0, high); }
 
 	/** Return a number in range [low, high]. high is inclusive such that we can always specify the upper bound. */
 	uint64_t next(uint64_t low, uint64_t high) noexcept {
-		double f = next() / static_cast<double>(mask);
-		uint64_t v = low + static_cast<uint64_t>(round((high - low) * f));
-		assert(v >= low && v <= high);
-		return v;
+		assert(low <= high);
+		return low + below(high - low + 1);
 	}
 
-	constexpr unsigned bits() const noexcept { return end - start; }
+	/**
+	 * Return a number in range [0, \a n) where every number is equally likely. This uses
+	 * Lemire's multiply and shift, so it only divides when a number has to be rejected.
+	 * \a n must fit in the largest multiple of bits() that does not exceed 32 bits, which
+	 * is 2^30 for LCG.
+	 */
+	uint64_t below(uint64_t n) noexcept {
+		unsigned w = bits();
+
+		while ((UINT64_C(1) << w) < n)
+			w += bits();
+
+		assert(n && w <= 32);
+
+		uint64_t low = (UINT64_C(1) << w) - 1;
+		uint64_t m = draw(w) * n;
 
-	static LCG ansi_c(uint64_t seed=1) {
-		return LCG(1UL << 31, 0x41C64E6D, 0x3039, 16, 31, seed);
+		if ((m & low) < n) {
+			uint64_t t = ((UINT64_C(1) << w) - n) % n;
+
+			while ((m & low) < t)
+				m = draw(w) * n;
+		}
+
+		return m >> w;
+	}
+
+	/** Skip the next \a n numbers in O(log n). */
+	void discard(uint64_t n) noexcept {
+		Step s = step(n);
+		v = (s.a * v + s.c) % M;
+	}
+
+	/**
+	 * Copy that starts \a index * \a length numbers ahead. Substreams do not overlap as long
+	 * as none of them yields more than \a length numbers and all of them fit in the period.
+	 */
+	BasicLCG substream(uint64_t index, uint64_t length) const noexcept {
+		BasicLCG s(*this);
+		s.discard(index * length);
+		return s;
+	}
+
+	/**
+	 * Same as calling next() \a n times. Interleaved lanes are advanced independently, so
+	 * the compiler can vectorize the main loop.
+	 */
+	void fill(uint32_t *out, size_t n) noexcept {
+		constexpr unsigned lanes = 8;
+		constexpr Step jump = step(lanes);
+		// arithmetic modulo 2^32 is exact if M divides it, which allows 32 bit lanes
+		typedef typename std::conditional<(UINT64_C(1) << 32) % M == 0, uint32_t, uint64_t>::type lane;
+
+		size_t end = n - n % lanes;
+
+		if (end) {
+			lane s[lanes];
+
+			for (unsigned k = 0; k < lanes; ++k) {
+				out[k] = (uint32_t)next();
+				s[k] = (lane)v;
+			}
+
+			for (size_t i = lanes; i < end; i += lanes)
+				for (unsigned k = 0; k < lanes; ++k) {
+					s[k] = (lane)(((lane)jump.a * s[k] + (lane)jump.c) % M);
+					out[i + k] = (uint32_t)((s[k] >> Start) & mask);
+				}
+
+			v = s[lanes - 1];
+		}
+
+		for (size_t i = end; i < n; ++i)
+			out[i] = (uint32_t)next();
+	}
+private:
+	/** Concatenate numbers until there are at least \a w bits. */
+	uint64_t draw(unsigned w) noexcept {
+		uint64_t x = next();
+
+		for (unsigned b = bits(); b < w; b += bits())
+			x = x << bits() | next();
+
+		return x;
 	}
 };
 
+/** Same parameters as rand() in the ANSI C standard. */
+typedef BasicLCG<UINT64_C(1) << 31, 0x41C64E6D, 0x3039, 16, 31> LCG;
+
+/**
+ * Seed for an independent stream at (\a x, \a y) that is derived from \a seed, e.g. for
+ * parts of the map that are generated separately. The result fits in 31 bits.
+ */
+constexpr uint32_t stream_seed(uint32_t seed, unsigned x, unsigned y) noexcept {
+	return (seed ^ x * UINT32_C(73856093) ^ y * UINT32_C(19349663)) & 0x7fffffff;
+}
+
 }
@@ -0,0 +1,122 @@
+/* Copyright 2016-2020 the Age of Empires Free Software Remake authors. See LEGAL for legal info */
+
+#pragma once
+
+/*
+ * Lock-free ring buffer for exactly one producer and one consumer thread.
+ *
+ * This is used to hand commands between the network thread and the thread that runs
+ * the game, so neither of them ever waits on a lock held by the other. Both indices
+ * only ever grow and live on their own cache line. Each side also keeps a cached copy
+ * of the other index, so it only touches the other cache line when the ring looks
+ * full or empty.
+ */
+
+#include "math.hpp"
+
+#include <cstddef>
+#include <cstdint>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+namespace genie {
+
+struct RingStats final {
+	uint64_t pushed; /**< items that have gone in so far */
+	uint64_t full; /**< pushes that had to wait, because the consumer did not keep up */
+	size_t depth; /**< items that are waiting right now */
+	size_t max_depth; /**< most items that have been waiting at once */
+};
+
+template<typename T> class SpscRing final {
+	std::vector<T> items;
+	size_t mask;
+
+	// producer side
+	alignas(64) std::atomic<size_t> tail; /**< next slot to fill */
+	size_t head_cache;
+	std::atomic<uint64_t> waits;
+	std::atomic<size_t> peak;
+
+	// consumer side
+	alignas(64) std::atomic<size_t> head; /**< next slot to take */
+	size_t tail_cache;
+public:
+	/** Ring that can hold at least \a capacity items. */
+	explicit SpscRing(size_t capacity)
+		: items((size_t)makepow2(capacity < 2 ? 2 : capacity)), mask(items.size() - 1)
+		, tail(0), head_cache(0), waits(0), peak(0), head(0), tail_cache(0) {}
+
+	SpscRing(const SpscRing&) = delete;
+	SpscRing &operator=(const SpscRing&) = delete;
+
+	/** Add \a v unless the ring is full. Only the producer may call this. */
+	bool try_push(const T &v) {
+		size_t t = tail.load(std::memory_order_relaxed);
+
+		if (t - head_cache > mask) {
+			head_cache = head.load(std::memory_order_acquire);
+
+			if (t - head_cache > mask)
+				return false;
+		}
+
+		items[t & mask] = v;
+		tail.store(t + 1, std::memory_order_release);
+
+		size_t depth = t + 1 - head_cache;
+		if (depth > peak.load(std::memory_order_relaxed))
+			peak.store(depth, std::memory_order_relaxed);
+
+		return true;
+	}
+
+	/** Add \a v and wait for the consumer if the ring is full. Only the producer may call this. */
+	void push(const T &v) {
+		if (try_push(v))
+			return;
+
+		waits.fetch_add(1, std::memory_order_relaxed);
+
+		while (!try_push(v))
+			std::this_thread::yield();
+	}
+
+	/** Take the oldest item if there is one. Only the consumer may call this. */
+	bool pop(T &v) {
+		size_t h = head.load(std::memory_order_relaxed);
+
+		if (h == tail_cache) {
+			tail_cache = tail.load(std::memory_order_acquire);
+
+			if (h == tail_cache)
+				return false;
+		}
+
+		v = items[h & mask];
+		head.store(h + 1, std::memory_order_release);
+		return true;
+	}
+
+	/** Call \a fn for every item that is waiting. Only the consumer may call this. Returns the number of items. */
+	template<typename F> size_t drain(F &&fn) {
+		size_t n = 0;
+
+		for (T v; pop(v); ++n)
+			fn(v);
+
+		return n;
+	}
+
+	size_t capacity() const noexcept { return items.size(); }
+
+	/** Counters for monitoring. They are exact once both threads are idle and an estimate otherwise. */
+	RingStats stats() const noexcept {
+		size_t t = tail.load(std::memory_order_acquire), h = head.load(std::memory_order_acquire);
+		return RingStats{t, waits.load(std::memory_order_relaxed), t >= h ? t - h : 0, peak.load(std::memory_order_relaxed)};
+	}
+};
+
+}
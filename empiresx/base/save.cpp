@@ -0,0 +1,832 @@
+/* Copyright 2016-2020 the Age of Empires Free Software Remake authors. See LEGAL for legal info */
+
+#include "save.hpp"
+
+#include "../os_macros.hpp"
+#include "world.hpp"
+#include "game.hpp"
+#include "net.hpp"
+
+#include <cstring>
+
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <stdexcept>
+
+#if windows
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace genie {
+
+namespace game {
+
+static const char save_magic[8] = {'A', 'O', 'E', 'X', 'S', 'A', 'V', 'E'};
+static constexpr uint32_t save_endian = 0x01020304;
+
+/** The header has a page for itself, so map pages are aligned as well. */
+static constexpr size_t header_size = SaveWriter::page_size;
+static constexpr size_t section_align = 64;
+
+static_assert(sizeof(SaveHeader) <= header_size, "save header does not fit");
+static_assert(ChunkLayer::count == SaveWriter::page_size, "chunk layer does not fit in one page");
+
+static constexpr size_t align(size_t v, size_t a) noexcept {
+	return (v + a - 1) / a * a;
+}
+
+SaveWriter::SaveWriter()
+	: image(header_size), slots(), free_pages(), dirty(), pages(0), staged(), section()
+	, chunk_records(), last_path(), copied(0) {}
+
+void SaveWriter::begin() {
+	for (auto &s : staged)
+		s.clear();
+
+	for (SaveSection &s : section)
+		s = SaveSection{};
+
+	chunk_records.clear();
+	copied = 0;
+}
+
+uint32_t SaveWriter::alloc_page() {
+	if (!free_pages.empty()) {
+		uint32_t p = free_pages.back();
+		free_pages.pop_back();
+		return p;
+	}
+
+	image.resize(std::max(image.size(), header_size + (pages + 1) * page_size));
+	dirty.push_back(true);
+	return pages++;
+}
+
+void SaveWriter::release_page(uint32_t &page) {
+	if (page == no_page)
+		return;
+
+	free_pages.push_back(page);
+	page = no_page;
+}
+
+void SaveWriter::chunk(uint32_t index, const MapChunk &c) {
+	if (index >= slots.size())
+		slots.resize(index + 1, Slot{0, {no_page, no_page}, false});
+
+	Slot &s = slots[index];
+	bool changed = !s.valid || s.revision != c.revision;
+	const ChunkLayer *layers[] = {&c.heights, &c.blocked};
+	SaveChunk rec{index, {no_page, no_page}, {0, 0}, {0, 0}};
+
+	for (unsigned l = 0; l < 2; ++l) {
+		const uint8_t *v = layers[l]->values();
+
+		if (!v) {
+			release_page(s.page[l]);
+			rec.fill[l] = layers[l]->get(0);
+			continue;
+		}
+
+		bool fresh = s.page[l] == no_page;
+
+		if (fresh)
+			s.page[l] = alloc_page();
+
+		if (fresh || changed) {
+			memcpy(image.data() + header_size + (size_t)s.page[l] * page_size, v, page_size);
+			dirty[s.page[l]] = true;
+			++copied;
+		}
+
+		rec.page[l] = s.page[l];
+	}
+
+	s.revision = c.revision;
+	s.valid = true;
+	chunk_records.push_back(rec);
+}
+
+void SaveWriter::put(SaveSectionType type, const void *data, size_t count, size_t stride) {
+	std::vector<uint8_t> &s = staged[(unsigned)type];
+	const uint8_t *p = static_cast<const uint8_t*>(data);
+
+	s.assign(p, p + count * stride);
+	section[(unsigned)type].count = (uint32_t)count;
+	section[(unsigned)type].stride = (uint32_t)stride;
+}
+
+void SaveWriter::end() {
+	put(SaveSectionType::chunks, chunk_records);
+
+	size_t tail = header_size + (size_t)pages * page_size, off = tail;
+
+	for (unsigned i = 0; i < (unsigned)SaveSectionType::count; ++i) {
+		off = align(off, section_align);
+		section[i].offset = off;
+		section[i].size = staged[i].size();
+		off += staged[i].size();
+	}
+
+	image.resize(off);
+	// zero the padding, so snapshots of the same state are identical
+	memset(image.data() + tail, 0, off - tail);
+
+	for (unsigned i = 0; i < (unsigned)SaveSectionType::count; ++i)
+		if (!staged[i].empty())
+			memcpy(image.data() + section[i].offset, staged[i].data(), staged[i].size());
+
+	SaveHeader hdr{};
+	memcpy(hdr.magic, save_magic, sizeof hdr.magic);
+	hdr.version = save_version;
+	hdr.endian = save_endian;
+	hdr.size = off;
+	hdr.pages = pages;
+	hdr.sections = (uint32_t)SaveSectionType::count;
+	memcpy(hdr.section, section, sizeof hdr.section);
+
+	memset(image.data(), 0, header_size);
+	memcpy(image.data(), &hdr, sizeof hdr);
+}
+
+void SaveWriter::write(const std::string &path) {
+	bool partial = path == last_path && std::filesystem::exists(path);
+	std::fstream out(path, partial ? std::ios::in | std::ios::out | std::ios::binary : std::ios::out | std::ios::binary | std::ios::trunc);
+
+	if (!out)
+		throw std::runtime_error(std::string("Could not write save game: ") + path);
+
+	auto put = [&](size_t offset, size_t n) {
+		out.seekp((std::streamoff)offset);
+		out.write((const char*)image.data() + offset, (std::streamsize)n);
+	};
+
+	if (partial) {
+		size_t tail = header_size + (size_t)pages * page_size;
+
+		put(0, header_size);
+
+		for (uint32_t p = 0; p < pages; ++p)
+			if (dirty[p])
+				put(header_size + (size_t)p * page_size, page_size);
+
+		put(tail, image.size() - tail);
+	} else {
+		put(0, image.size());
+	}
+
+	out.close();
+
+	if (!out)
+		throw std::runtime_error(std::string("Could not write save game: ") + path);
+
+	// the sections may have shrunk since the last time
+	if (partial)
+		std::filesystem::resize_file(path, image.size());
+
+	dirty.assign(pages, false);
+	last_path = path;
+}
+
+static void unmap(const uint8_t *base, size_t len) {
+#if windows
+	(void)len;
+	UnmapViewOfFile(base);
+#else
+	munmap(const_cast<uint8_t*>(base), len);
+#endif
+}
+
+SaveFile::SaveFile(const std::string &path) : base(nullptr), len(0), mapped(false), hdr(nullptr) {
+#if windows
+	HANDLE f = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	LARGE_INTEGER size;
+
+	if (f == INVALID_HANDLE_VALUE)
+		throw std::runtime_error(std::string("Could not open save game: ") + path);
+
+	if (!GetFileSizeEx(f, &size) || !size.QuadPart) {
+		CloseHandle(f);
+		throw std::runtime_error(std::string("Bad save game: ") + path);
+	}
+
+	HANDLE m = CreateFileMappingA(f, NULL, PAGE_READONLY, 0, 0, NULL);
+	void *p = m ? MapViewOfFile(m, FILE_MAP_READ, 0, 0, 0) : NULL;
+
+	// the view keeps the file open
+	if (m)
+		CloseHandle(m);
+	CloseHandle(f);
+
+	if (!p)
+		throw std::runtime_error(std::string("Could not map save game: ") + path);
+
+	len = (size_t)size.QuadPart;
+#else
+	int fd = open(path.c_str(), O_RDONLY);
+	struct stat st;
+
+	if (fd == -1)
+		throw std::runtime_error(std::string("Could not open save game: ") + path);
+
+	if (fstat(fd, &st) || !st.st_size) {
+		close(fd);
+		throw std::runtime_error(std::string("Bad save game: ") + path);
+	}
+
+	void *p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	if (p == MAP_FAILED)
+		throw std::runtime_error(std::string("Could not map save game: ") + path);
+
+	len = (size_t)st.st_size;
+#endif
+	base = static_cast<const uint8_t*>(p);
+	mapped = true;
+
+	try {
+		validate();
+	} catch (...) {
+		unmap(base, len);
+		throw;
+	}
+}
+
+SaveFile::SaveFile(const void *data, size_t size)
+	: base(static_cast<const uint8_t*>(data)), len(size), mapped(false), hdr(nullptr)
+{
+	if ((uintptr_t)base % alignof(uint64_t))
+		throw std::runtime_error("Snapshot is not aligned");
+
+	validate();
+}
+
+SaveFile::~SaveFile() {
+	if (mapped)
+		unmap(base, len);
+}
+
+void SaveFile::validate() {
+	if (len < header_size)
+		throw std::runtime_error("Bad save game: too small");
+
+	hdr = reinterpret_cast<const SaveHeader*>(base);
+
+	if (memcmp(hdr->magic, save_magic, sizeof save_magic))
+		throw std::runtime_error("Bad save game: not a save game");
+
+	if (hdr->endian != save_endian)
+		throw std::runtime_error("Bad save game: wrong byte order");
+
+	if (hdr->version != save_version)
+		throw std::runtime_error("Bad save game: unsupported version " + std::to_string(hdr->version));
+
+	if (hdr->size > len || hdr->sections != (uint32_t)SaveSectionType::count || header_size + (uint64_t)hdr->pages * SaveWriter::page_size > hdr->size)
+		throw std::runtime_error("Bad save game: truncated");
+
+	for (const SaveSection &s : hdr->section)
+		if (s.offset % section_align || s.offset + s.size > hdr->size || (uint64_t)s.count * s.stride != s.size)
+			throw std::runtime_error("Bad save game: bad section");
+}
+
+const void *SaveFile::get(SaveSectionType type, size_t &count, size_t stride) const {
+	const SaveSection &s = hdr->section[(unsigned)type];
+
+	if (s.stride != stride)
+		throw std::runtime_error("Bad save game: unexpected record size");
+
+	count = s.count;
+	return base + s.offset;
+}
+
+const uint8_t *SaveFile::page(uint32_t index) const {
+	if (index >= hdr->pages)
+		throw std::runtime_error("Bad save game: bad map page");
+
+	return base + header_size + (size_t)index * SaveWriter::page_size;
+}
+
+const StartMatch &SaveFile::settings() const {
+	size_t n;
+	const StartMatch *sm = get<StartMatch>(SaveSectionType::settings, n);
+
+	if (n != 1)
+		throw std::runtime_error("Bad save game: no settings");
+
+	return *sm;
+}
+
+const SaveWorld &SaveFile::world() const {
+	size_t n;
+	const SaveWorld *w = get<SaveWorld>(SaveSectionType::world, n);
+
+	if (n != 1)
+		throw std::runtime_error("Bad save game: no world");
+
+	return *w;
+}
+
+static void save_pos(int32_t *dst, const Box2x &pos) {
+	dst[0] = pos.left.raw;
+	dst[1] = pos.top.raw;
+	dst[2] = pos.w.raw;
+	dst[3] = pos.h.raw;
+}
+
+static Box2x load_pos(const int32_t *src) {
+	return Box2x(Fixed::from_raw(src[0]), Fixed::from_raw(src[1]), Fixed::from_raw(src[2]), Fixed::from_raw(src[3]));
+}
+
+void World::save(SaveWriter &w) const {
+	for (size_t i = 0; i < map.chunks.size(); ++i)
+		if (map.chunks[i])
+			w.chunk((uint32_t)i, *map.chunks[i]);
+
+	SaveWorld sw{lcg.state(), timers.now(), timers.sequence(), map.w, map.h, map.seed, particle_id_counter};
+	w.put(SaveSectionType::world, &sw, 1);
+
+	std::vector<uint32_t> generations(entities.slot_count());
+
+	for (uint32_t i = 0; i < generations.size(); ++i)
+		generations[i] = entities.generation(i);
+
+	w.put(SaveSectionType::slots, generations);
+	w.put(SaveSectionType::free_slots, entities.free_slots());
+
+	std::vector<SaveResource> res;
+	res.reserve(static_res.size());
+
+	for (const ArenaPtr<StaticResource> &r : static_res) {
+		SaveResource s{r->handle, r->id, {}, r->left(), (uint16_t)r->anim_index, (uint16_t)r->image_index, (uint8_t)r->what(), {}};
+		save_pos(s.pos, r->pos);
+		res.push_back(s);
+	}
+
+	w.put(SaveSectionType::resources, res);
+
+	std::vector<SaveBuilding> blds;
+	std::vector<SaveProduction> prod;
+
+	for (const ArenaPtr<Building> &b : buildings) {
+		SaveBuilding s{b->handle, b->id, {}, b->hp, (uint32_t)prod.size(), (uint32_t)b->prod.size(), (uint8_t)b->type, (uint8_t)b->player, {}};
+		save_pos(s.pos, b->pos);
+		blds.push_back(s);
+
+		for (const Production &p : b->prod)
+			prod.push_back(SaveProduction{(uint32_t)p.what});
+	}
+
+	w.put(SaveSectionType::buildings, blds);
+	w.put(SaveSectionType::production, prod);
+
+	// flow fields take a while to compute, so they are saved as well
+	std::vector<SaveFlowField> fields;
+	std::vector<uint32_t> costs;
+	std::vector<uint8_t> dirs;
+	std::map<const FlowField*, uint32_t> field_index;
+
+	flows.each([&](const std::shared_ptr<FlowField> &ff) {
+		const Box2<int> &a = ff->bounds();
+		size_t area = (size_t)a.w * a.h;
+
+		field_index[ff.get()] = (uint32_t)fields.size();
+		fields.push_back(SaveFlowField{{ff->dest.x, ff->dest.y}, {a.left, a.top, a.w, a.h}, ff->stale()});
+		costs.insert(costs.end(), ff->costs(), ff->costs() + area);
+		dirs.insert(dirs.end(), ff->directions(), ff->directions() + area);
+	});
+
+	w.put(SaveSectionType::flow_fields, fields);
+	w.put(SaveSectionType::flow_costs, costs);
+	w.put(SaveSectionType::flow_dirs, dirs);
+
+	std::vector<SaveUnit> us;
+	std::vector<SaveTile> tiles;
+	us.reserve(units.size());
+
+	for (const ArenaPtr<Unit> &u : units) {
+		SaveUnit s{};
+
+		s.handle = u->handle;
+		s.victim = u->victim;
+		s.job = u->job;
+		s.id = u->id;
+		save_pos(s.pos, u->pos);
+		s.target[0] = u->target.x.raw;
+		s.target[1] = u->target.y.raw;
+		s.dest[0] = u->dest.x;
+		s.dest[1] = u->dest.y;
+
+		if (u->flow) {
+			s.flow = field_index.at(u->flow.get());
+			s.flags |= SaveUnit::has_flow;
+		}
+
+		s.path = (uint32_t)tiles.size();
+		s.path_count = (uint32_t)u->path.size();
+
+		for (const Vector2<int> &t : u->path)
+			tiles.push_back(SaveTile{t.x, t.y});
+
+		s.hp = u->hp;
+		s.carry = u->carry.left();
+		s.anim = (uint16_t)u->anim_index;
+		s.image = (uint16_t)u->image_index;
+		s.type = (uint8_t)u->type;
+		s.player = (uint8_t)u->player;
+		s.dir = (uint8_t)u->dir;
+		s.carry_type = (uint8_t)u->carry.what();
+		s.flags |= (u->awake ? SaveUnit::awake : 0) | (u->waiting ? SaveUnit::waiting : 0) | (u->reloading ? SaveUnit::reloading : 0) | (u->hflip ? SaveUnit::hflip : 0);
+
+		us.push_back(s);
+	}
+
+	w.put(SaveSectionType::units, us);
+	w.put(SaveSectionType::paths, tiles);
+
+	std::vector<SaveTimer> tms;
+	tms.reserve(timers.size());
+	timers.each([&](uint64_t due, uint64_t seq, const TimerEvent &ev) { tms.push_back(SaveTimer{due, seq, ev.who, (uint32_t)ev.type, 0}); });
+	// the wheel has no particular order, but the same state should give the same snapshot
+	std::sort(tms.begin(), tms.end(), [](const SaveTimer &lhs, const SaveTimer &rhs) { return lhs.seq < rhs.seq; });
+	w.put(SaveSectionType::timers, tms);
+
+	std::vector<SavePathRequest> reqs;
+
+	for (const PathFinder::Request &r : paths.pending)
+		reqs.push_back(SavePathRequest{r.who->handle, {r.from.x, r.from.y}, {r.to.x, r.to.y}});
+
+	w.put(SaveSectionType::path_requests, reqs);
+
+	// what the path finder has connected and cached changes what searches cost and find
+	std::vector<uint32_t> clusters;
+
+	for (size_t k = 0; k < paths.chunks.size(); ++k) {
+		if (!paths.chunks[k])
+			continue;
+
+		unsigned kx = (unsigned)(k % paths.kw), ky = (unsigned)(k / paths.kw);
+
+		for (unsigned i = 0; i < PathFinder::chunk_size * PathFinder::chunk_size; ++i) {
+			unsigned cx = (kx << PathFinder::chunk_bits) + i % PathFinder::chunk_size, cy = (ky << PathFinder::chunk_bits) + i / PathFinder::chunk_size;
+
+			if (cx < paths.cw && cy < paths.ch && paths.chunks[k]->clusters[i].linked)
+				clusters.push_back(cy * paths.cw + cx);
+		}
+	}
+
+	std::vector<std::pair<uint64_t, const std::pair<const uint64_t, PathFinder::Route>*>> lru;
+
+	for (const auto &kv : paths.cache)
+		lru.emplace_back(kv.second.used, &kv);
+
+	std::sort(lru.begin(), lru.end());
+
+	std::vector<SavePathRoute> routes;
+	std::vector<uint64_t> keys;
+
+	for (const auto &r : lru) {
+		const std::vector<unsigned> &route = r.second->second.nodes;
+		routes.push_back(SavePathRoute{(uint32_t)(r.second->first >> 32), (uint32_t)r.second->first, (uint32_t)keys.size(), (uint32_t)route.size()});
+
+		for (unsigned n : route)
+			keys.push_back(paths.nodes[n].key);
+	}
+
+	w.put(SaveSectionType::path_clusters, clusters);
+	w.put(SaveSectionType::path_routes, routes);
+	w.put(SaveSectionType::path_route_nodes, keys);
+
+	std::vector<SaveFogLayer> layers;
+	std::vector<SaveFogChunk> explored;
+
+	for (uint32_t p = 0; p < fog.layers.size(); ++p) {
+		const FogOfWar::Layer &l = fog.layers[p];
+		layers.push_back(SaveFogLayer{l.revealed, l.no_fog});
+
+		for (uint32_t i = 0; i < l.chunks.size(); ++i)
+			if (l.chunks[i]) {
+				SaveFogChunk c{p, i, {}};
+				memcpy(c.explored, l.chunks[i]->explored, sizeof c.explored);
+				explored.push_back(c);
+			}
+	}
+
+	w.put(SaveSectionType::fog_layers, layers);
+	w.put(SaveSectionType::fog_chunks, explored);
+
+	std::vector<Economy::Ledger> ledgers;
+
+	for (unsigned p = 0; p < economy.players(); ++p)
+		ledgers.push_back(economy.ledger(p));
+
+	w.put(SaveSectionType::ledgers, ledgers);
+	w.put(SaveSectionType::history, economy.history());
+}
+
+void World::load(const SaveFile &f) {
+	const SaveWorld &sw = f.world();
+
+	if (sw.map_w != map.w || sw.map_h != map.h)
+		throw std::runtime_error("Bad save game: map size does not match");
+
+	size_t n, m;
+
+	// start from scratch, so nothing of the current state is left
+	paths.pending.clear();
+	active.clear();
+	woken.clear();
+	crowded.clear();
+	dead.clear();
+	units.clear();
+	grid.clear();
+	buildings.clear();
+	static_res.clear();
+	++revision;
+
+	for (auto &c : map.chunks)
+		c.reset();
+
+	fog = FogOfWar(map.w, map.h);
+	lcg.seed(sw.lcg);
+	map.seed = sw.map_seed;
+
+	const uint32_t *generations = f.get<uint32_t>(SaveSectionType::slots, n);
+	const uint32_t *free = f.get<uint32_t>(SaveSectionType::free_slots, m);
+	entities.reset(generations, n, free, m);
+
+	// entities block the map when they are created, but the saved map is restored over it afterwards anyway
+	const SaveResource *res = f.get<SaveResource>(SaveSectionType::resources, n);
+	static_res.reserve(n);
+
+	for (size_t i = 0; i < n; ++i) {
+		const SaveResource &s = res[i];
+		ArenaPtr<StaticResource> r(arena.make<StaticResource>(map, load_pos(s.pos), (ResourceType)s.type, s.anim, s.image));
+
+		static_cast<Resource&>(*r) = Resource((ResourceType)s.type, s.amount);
+		r->id = s.id;
+		adopt(static_res, std::move(r), s.handle);
+	}
+
+	const SaveBuilding *blds = f.get<SaveBuilding>(SaveSectionType::buildings, n);
+	const SaveProduction *prod = f.get<SaveProduction>(SaveSectionType::production, m);
+
+	for (size_t i = 0; i < n; ++i) {
+		const SaveBuilding &s = blds[i];
+		ArenaPtr<Building> b(arena.make<Building>(map, load_pos(s.pos), (BuildingType)s.type, s.player, &arena));
+
+		if (s.prod + (uint64_t)s.prod_count > m)
+			throw std::runtime_error("Bad save game: bad production queue");
+
+		b->hp = s.hp;
+		b->id = s.id;
+
+		for (uint32_t j = 0; j < s.prod_count; ++j)
+			b->prod.emplace_back((UnitType)prod[s.prod + j].what);
+
+		adopt(buildings, std::move(b), s.handle);
+		economy.join(s.player);
+	}
+
+	size_t nunits;
+	const SaveUnit *us = f.get<SaveUnit>(SaveSectionType::units, nunits);
+	const SaveTile *tiles = f.get<SaveTile>(SaveSectionType::paths, m);
+	units.reserve(nunits);
+
+	for (size_t i = 0; i < nunits; ++i) {
+		const SaveUnit &s = us[i];
+		Box2x pos(load_pos(s.pos));
+		ArenaPtr<Unit> u((UnitType)s.type == UnitType::villager ? arena.make<Villager>(map, pos, s.player) : arena.make<Unit>(map, pos, (UnitType)s.type, s.player));
+
+		if (s.path + (uint64_t)s.path_count > m)
+			throw std::runtime_error("Bad save game: bad path");
+
+		u->id = s.id;
+		u->hp = s.hp;
+		u->victim = s.victim;
+		u->job = s.job;
+		u->target = Vector2x(Fixed::from_raw(s.target[0]), Fixed::from_raw(s.target[1]));
+		u->dest = Vector2<int>(s.dest[0], s.dest[1]);
+
+		for (uint32_t j = 0; j < s.path_count; ++j)
+			u->path.emplace_back(tiles[s.path + j].x, tiles[s.path + j].y);
+
+		u->carry = Resource((ResourceType)s.carry_type, s.carry);
+		u->dir = (UnitDirection)s.dir;
+		u->anim_index = s.anim;
+		u->image_index = s.image;
+		u->hflip = !!(s.flags & SaveUnit::hflip);
+		u->waiting = !!(s.flags & SaveUnit::waiting);
+		u->reloading = !!(s.flags & SaveUnit::reloading);
+		u->scr = map.tile_to_scr(u->pos.topleft(), u->hotspot_x, u->hotspot_y, u->anim_index, u->image_index);
+
+		Unit &v = adopt(units, std::move(u), s.handle);
+		economy.join(s.player);
+
+		if (s.flags & SaveUnit::awake)
+			wake(v);
+	}
+
+	const SaveChunk *chunks = f.get<SaveChunk>(SaveSectionType::chunks, n);
+
+	for (size_t i = 0; i < n; ++i) {
+		const SaveChunk &s = chunks[i];
+
+		if (s.index >= map.chunks.size())
+			throw std::runtime_error("Bad save game: bad map chunk");
+
+		auto &c = map.chunks[s.index];
+
+		if (!c)
+			c.reset(new MapChunk());
+
+		c->heights.assign(s.page[0] == SaveWriter::no_page ? nullptr : f.page(s.page[0]), s.fill[0]);
+		c->blocked.assign(s.page[1] == SaveWriter::no_page ? nullptr : f.page(s.page[1]), s.fill[1]);
+	}
+
+	// the abstract graph is rebuilt from the restored map
+	paths.invalidate(0, 0, map.w, map.h);
+
+	const SaveFlowField *fields = f.get<SaveFlowField>(SaveSectionType::flow_fields, n);
+	const uint32_t *costs = f.get<uint32_t>(SaveSectionType::flow_costs, m);
+	const uint8_t *dirs = f.get<uint8_t>(SaveSectionType::flow_dirs, m);
+	std::vector<std::shared_ptr<FlowField>> restored;
+	size_t offset = 0;
+
+	for (size_t i = 0; i < n; ++i) {
+		const SaveFlowField &s = fields[i];
+
+		if (s.area[0] < 0 || s.area[1] < 0 || s.area[2] <= 0 || s.area[3] <= 0 || s.area[0] + s.area[2] > (int)map.w || s.area[1] + s.area[3] > (int)map.h)
+			throw std::runtime_error("Bad save game: bad flow fields");
+
+		Box2<int> a(s.area[0], s.area[1], s.area[2], s.area[3]);
+		size_t area = (size_t)a.w * a.h;
+
+		if (m - offset < area)
+			throw std::runtime_error("Bad save game: bad flow fields");
+
+		auto ff = std::make_shared<FlowField>(Vector2<int>(s.dest[0], s.dest[1]), a, costs + offset, dirs + offset, !!s.stale);
+		flows.restore(ff);
+		restored.push_back(ff);
+		offset += area;
+	}
+
+	if (offset != m)
+		throw std::runtime_error("Bad save game: bad flow fields");
+
+	for (size_t i = 0; i < nunits; ++i) {
+		const SaveUnit &s = us[i];
+
+		if (s.flags & SaveUnit::has_flow)
+			static_cast<Unit&>(*get(s.handle)).flow = restored.at(s.flow);
+	}
+
+	timers.reset(sw.now, sw.seq);
+
+	const SaveTimer *tms = f.get<SaveTimer>(SaveSectionType::timers, n);
+
+	for (size_t i = 0; i < n; ++i)
+		timers.restore(tms[i].due, tms[i].seq, TimerEvent{(TimerType)tms[i].type, tms[i].who});
+
+	const SavePathRequest *reqs = f.get<SavePathRequest>(SaveSectionType::path_requests, n);
+
+	for (size_t i = 0; i < n; ++i) {
+		Unit *u = dynamic_cast<Unit*>(get(reqs[i].who));
+
+		if (!u)
+			throw std::runtime_error("Bad save game: path request for unknown unit");
+
+		paths.pending.push_back(PathFinder::Request{u, Vector2<int>(reqs[i].from[0], reqs[i].from[1]), Vector2<int>(reqs[i].to[0], reqs[i].to[1])});
+	}
+
+	const uint32_t *clusters = f.get<uint32_t>(SaveSectionType::path_clusters, n);
+
+	for (size_t i = 0; i < n; ++i) {
+		if (clusters[i] >= paths.cw * paths.ch)
+			throw std::runtime_error("Bad save game: bad path cluster");
+
+		paths.ensure(clusters[i]);
+	}
+
+	const SavePathRoute *routes = f.get<SavePathRoute>(SaveSectionType::path_routes, n);
+	const uint64_t *keys = f.get<uint64_t>(SaveSectionType::path_route_nodes, m);
+
+	// routes are saved from least to most recently used
+	for (size_t i = 0; i < n; ++i) {
+		const SavePathRoute &s = routes[i];
+
+		if (s.from >= paths.cw * paths.ch || s.to >= paths.cw * paths.ch || !s.count || s.first + (uint64_t)s.count > m)
+			throw std::runtime_error("Bad save game: bad path route");
+
+		PathFinder::Route r{std::vector<unsigned>(), ++paths.clock};
+
+		for (uint32_t j = 0; j < s.count; ++j) {
+			unsigned node = paths.find_node(keys[s.first + j]);
+
+			if (node == PathFinder::none)
+				throw std::runtime_error("Bad save game: bad path route");
+
+			r.nodes.push_back(node);
+		}
+
+		paths.cache[(uint64_t)s.from << 32 | s.to] = std::move(r);
+	}
+
+	const SaveFogLayer *layers = f.get<SaveFogLayer>(SaveSectionType::fog_layers, n);
+
+	for (uint32_t p = 0; p < n; ++p) {
+		FogOfWar::Layer &l = fog.layer(p);
+		l.revealed = !!layers[p].revealed;
+		l.no_fog = !!layers[p].no_fog;
+	}
+
+	const SaveFogChunk *explored = f.get<SaveFogChunk>(SaveSectionType::fog_chunks, n);
+
+	for (size_t i = 0; i < n; ++i) {
+		const SaveFogChunk &s = explored[i];
+
+		if (s.index >= (size_t)fog.cw * fog.ch)
+			throw std::runtime_error("Bad save game: bad fog of war chunk");
+
+		FogOfWar::Chunk &c = fog.chunk(fog.layer(s.player), s.index % fog.cw, s.index / fog.cw);
+		memcpy(c.explored, s.explored, sizeof c.explored);
+	}
+
+	// what is visible right now follows from where everything is
+	for (const ArenaPtr<Building> &b : buildings) {
+		int half = (int)b->size() / 2;
+		fog.see(b->handle, b->player, b->pos.left.floor() + half, b->pos.top.floor() + half, b->los());
+	}
+
+	for (const ArenaPtr<Unit> &u : units)
+		fog.see(u->handle, u->player, u->pos.left.floor(), u->pos.top.floor(), u->los());
+
+	fog.update();
+
+	const Economy::Ledger *ledgers = f.get<Economy::Ledger>(SaveSectionType::ledgers, n);
+	const Economy::Sample *history = f.get<Economy::Sample>(SaveSectionType::history, m);
+	economy.restore(ledgers, n, history, m);
+
+	particle_id_counter = sw.particle_ids;
+}
+
+const SaveWriter &Game::snapshot() {
+	saver.begin();
+	saver.put(SaveSectionType::settings, &settings, 1);
+
+	std::vector<SavePlayer> ps;
+
+	for (const Player &p : players) {
+		SavePlayer s{p.id, (uint32_t)p.state, (uint32_t)p.cheats, p.ai, {}};
+		strncpy(s.name, p.name.c_str(), sizeof s.name - 1);
+		ps.push_back(s);
+	}
+
+	saver.put(SaveSectionType::players, ps);
+	world.save(saver);
+	saver.end();
+
+	return saver;
+}
+
+void Game::save(const std::string &path) {
+	snapshot();
+	saver.write(path);
+}
+
+void Game::load(const SaveFile &f) {
+	world.load(f);
+	settings = f.settings();
+
+	size_t n;
+	const SavePlayer *ps = f.get<SavePlayer>(SaveSectionType::players, n);
+	players.clear();
+
+	for (size_t i = 0; i < n; ++i) {
+		Player p((player_id)ps[i].id, std::string(ps[i].name, strnlen(ps[i].name, sizeof ps[i].name)));
+
+		p.state = (PlayerState)ps[i].state;
+		p.cheats = (PlayerCheat)ps[i].cheats;
+		p.ai = ps[i].ai;
+		players.insert(p);
+	}
+
+	computers.clear();
+
+	for (const Player &p : players)
+		if (p.ai)
+			computers.add(p.id);
+
+	// pages of the old game do not match the new one
+	saver = SaveWriter();
+}
+
+}
+
+}
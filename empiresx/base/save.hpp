@@ -0,0 +1,275 @@
+/* Copyright 2016-2020 the Age of Empires Free Software Remake authors. See LEGAL for legal info */
+
+#pragma once
+
+/*
+ * Binary snapshots of a game, used for save games, replay keyframes and for
+ * spectators that join late.
+ *
+ * A snapshot is a header followed by map pages and sections. Every section is an
+ * array of fixed size records that are aligned to 64 bytes, so a mapped file can
+ * be read in place without parsing anything. Map chunks are stored in 4 KiB pages.
+ * The writer keeps its image around and only copies chunks that have changed
+ * since the last snapshot. Writing the same file again only touches the changed
+ * pages and the sections.
+ *
+ * Terrain tiles are not stored, because they are generated from the map seed.
+ * Records are little endian and loading refuses anything else.
+ */
+
+#include "handle.hpp"
+
+#include <cstddef>
+#include <cstdint>
+
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace genie {
+
+struct StartMatch;
+
+namespace game {
+
+class MapChunk;
+
+static constexpr uint32_t save_version = 3;
+
+enum class SaveSectionType : uint32_t {
+	settings,
+	world,
+	chunks,
+	slots, /**< generation of every handle slot */
+	free_slots,
+	resources,
+	buildings,
+	production,
+	units,
+	paths,
+	timers,
+	path_requests,
+	fog_layers,
+	fog_chunks,
+	ledgers,
+	history,
+	players,
+	flow_fields,
+	flow_costs, /**< one per tile that every flow field covers */
+	flow_dirs,
+	path_clusters, /**< clusters that have been connected */
+	path_routes,
+	path_route_nodes, /**< key of every entrance that a cached route visits */
+	count,
+};
+
+struct SaveSection final {
+	uint64_t offset, size; /**< in bytes from the start of the snapshot */
+	uint32_t count, stride; /**< number of records and size of each record */
+};
+
+struct SaveHeader final {
+	char magic[8];
+	uint32_t version;
+	uint32_t endian; /**< save_endian in native byte order */
+	uint64_t size; /**< of the whole snapshot */
+	uint32_t pages; /**< number of map pages after the header */
+	uint32_t sections;
+	SaveSection section[(unsigned)SaveSectionType::count];
+};
+
+/** State that only exists once per world. */
+struct SaveWorld final {
+	uint64_t lcg;
+	uint64_t now, seq; /**< timer wheel */
+	uint32_t map_w, map_h, map_seed;
+	uint32_t particle_ids; /**< next particle id */
+};
+
+struct SaveChunk final {
+	uint32_t index; /**< y,x order */
+	uint32_t page[2]; /**< heights and blocked. no_page if the layer is uniform */
+	uint8_t fill[2]; /**< value of uniform layers */
+	uint8_t pad[2];
+};
+
+struct SaveResource final {
+	Handle handle;
+	uint32_t id;
+	int32_t pos[4]; /**< left, top, w and h in fixed point */
+	uint32_t amount;
+	uint16_t anim, image;
+	uint8_t type;
+	uint8_t pad[3];
+};
+
+struct SaveBuilding final {
+	Handle handle;
+	uint32_t id;
+	int32_t pos[4];
+	uint32_t hp;
+	uint32_t prod, prod_count; /**< range in the production section */
+	uint8_t type, player;
+	uint8_t pad[2];
+};
+
+struct SaveProduction final {
+	uint32_t what;
+};
+
+struct SaveTile final {
+	int32_t x, y;
+};
+
+struct SaveUnit final {
+	Handle handle, victim, job;
+	uint32_t id;
+	int32_t pos[4];
+	int32_t target[2]; /**< fixed point */
+	int32_t dest[2]; /**< tile */
+	uint32_t flow; /**< index in the flow fields. only used if has_flow is set */
+	uint32_t path, path_count; /**< range in the paths section */
+	uint32_t hp, carry;
+	uint16_t anim, image;
+	uint8_t type, player, dir, carry_type;
+	uint8_t flags;
+	uint8_t pad[3];
+
+	static constexpr uint8_t awake = 0x01, waiting = 0x02, reloading = 0x04, has_flow = 0x08, hflip = 0x10;
+};
+
+struct SaveTimer final {
+	uint64_t due, seq;
+	Handle who;
+	uint32_t type;
+	uint32_t pad;
+};
+
+struct SavePathRequest final {
+	Handle who;
+	int32_t from[2], to[2];
+};
+
+/** Cached route of the path finder. */
+struct SavePathRoute final {
+	uint32_t from, to; /**< cluster */
+	uint32_t first, count; /**< range in the path route nodes section */
+};
+
+struct SaveFlowField final {
+	int32_t dest[2];
+	int32_t area[4]; /**< left, top, width and height of the tiles that are covered */
+	uint32_t stale;
+};
+
+struct SaveFogLayer final {
+	uint8_t revealed, no_fog;
+};
+
+struct SaveFogChunk final {
+	uint32_t player, index;
+	uint64_t explored[64];
+};
+
+struct SavePlayer final {
+	uint32_t id, state, cheats, ai;
+	char name[48]; /**< zero terminated */
+};
+
+/**
+ * Builds snapshots in memory. Keep the same writer around for the whole game, so map
+ * chunks that have not changed are neither copied nor written again.
+ */
+class SaveWriter final {
+public:
+	static constexpr size_t page_size = 4096;
+	static constexpr uint32_t no_page = UINT32_MAX;
+private:
+	struct Slot final {
+		uint32_t revision;
+		uint32_t page[2];
+		bool valid;
+	};
+
+	std::vector<uint8_t> image; /**< header, pages and sections */
+	std::vector<Slot> slots; /**< indexed by chunk */
+	std::vector<uint32_t> free_pages;
+	std::vector<bool> dirty; /**< pages that have to be written to disk */
+	uint32_t pages;
+	std::vector<uint8_t> staged[(unsigned)SaveSectionType::count];
+	SaveSection section[(unsigned)SaveSectionType::count];
+	std::vector<SaveChunk> chunk_records;
+	std::string last_path; /**< file that has been written last time */
+	size_t copied; /**< pages that have been copied in the last snapshot */
+public:
+	SaveWriter();
+
+	/** Start a new snapshot. Use a new writer for another game, since pages are only matched by chunk index. */
+	void begin();
+
+	/** Add chunk \a index. Its layers are only copied if they have changed since the last snapshot. */
+	void chunk(uint32_t index, const MapChunk &c);
+
+	template<typename T> void put(SaveSectionType type, const T *data, size_t count) {
+		static_assert(std::is_trivially_copyable<T>::value, "records must be plain data");
+		put(type, data, count, sizeof(T));
+	}
+
+	template<typename T, typename A> void put(SaveSectionType type, const std::vector<T, A> &v) {
+		put(type, v.data(), v.size());
+	}
+
+	/** Lay out the snapshot. data() is valid until the next call to begin. */
+	void end();
+
+	const uint8_t *data() const noexcept { return image.data(); }
+	size_t size() const noexcept { return image.size(); }
+	/** Map pages that have been copied in the last snapshot. */
+	size_t changed() const noexcept { return copied; }
+
+	/**
+	 * Write the last snapshot to \a path. If the last file that has been written is
+	 * \a path, only changed pages and the sections are written. Throws std::runtime_error
+	 * if the file cannot be written.
+	 */
+	void write(const std::string &path);
+private:
+	void put(SaveSectionType type, const void *data, size_t count, size_t stride);
+	uint32_t alloc_page();
+	void release_page(uint32_t &page);
+};
+
+/** Read-only view of a snapshot, which is either a memory mapped file or a buffer. */
+class SaveFile final {
+	const uint8_t *base;
+	size_t len;
+	bool mapped; /**< whether base has to be unmapped */
+	const SaveHeader *hdr;
+public:
+	/** Map \a path read-only. Throws std::runtime_error if it cannot be read or is not a valid snapshot. */
+	explicit SaveFile(const std::string &path);
+	/** Use \a size bytes at \a data in place, e.g. a keyframe from the server. \a data must outlive this object. */
+	SaveFile(const void *data, size_t size);
+	~SaveFile();
+
+	SaveFile(const SaveFile&) = delete;
+	SaveFile &operator=(const SaveFile&) = delete;
+
+	/** Records in section \a type. Throws std::runtime_error if they are not of type T. */
+	template<typename T> const T *get(SaveSectionType type, size_t &count) const {
+		return static_cast<const T*>(get(type, count, sizeof(T)));
+	}
+
+	/** Map page \a index. */
+	const uint8_t *page(uint32_t index) const;
+
+	const StartMatch &settings() const;
+	const SaveWorld &world() const;
+private:
+	void validate();
+	const void *get(SaveSectionType type, size_t &count, size_t stride) const;
+};
+
+}
+
+}
@@ -0,0 +1,209 @@
+/* Copyright 2016-2020 the Age of Empires Free Software Remake authors. See LEGAL for legal info */
+
+#pragma once
+
+/*
+ * Unit, building and resource definitions.
+ *
+ * Anything that is in doc/reverse_engineering/unit_stats_aoe.csv comes from rows the
+ * build generates from it (see cmake/stats.cmake). Everything else is filled in by
+ * hand below. All of it is resolved at compile time into one dense table per property,
+ * indexed by UnitType, BuildingType or ResourceType. Derived values, such as times in
+ * ticks and the damage for every attacker and defender, are computed here as well.
+ */
+
+#include "drs.hpp"
+#include "world.hpp"
+
+#include <cstddef>
+#include <cstdint>
+
+#include <array>
+#include <stdexcept>
+#include <string_view>
+
+namespace genie {
+
+namespace game {
+
+namespace stats {
+
+/** One row of the stats table. */
+struct UnitRow final {
+	std::string_view name;
+	unsigned age, hp, attack;
+	char attack_type; /**< M(elee), P(ierce) or blank if it cannot attack */
+	unsigned reload; /**< in ms */
+	unsigned armor[2]; /**< melee and pierce */
+	unsigned los, range, accuracy;
+	char speed; /**< S(low), M(edium) or F(ast) */
+	unsigned train_time; /**< in seconds */
+	unsigned cost[4]; /**< indexed by ResourceType */
+};
+
+static constexpr UnitRow unit_rows[] = {
+#define STATS_UNIT(name, age, hp, attack, type, reload, melee_armor, pierce_armor, los, range, accuracy, speed, train_time, food, wood, stone, gold) \
+	{name, age, hp, attack, type, reload, {melee_armor, pierce_armor}, los, range, accuracy, speed, train_time, {wood, food, gold, stone}},
+#include "unit_stats.inc"
+#undef STATS_UNIT
+};
+
+constexpr bool has_unit_row(std::string_view name) {
+	for (const UnitRow &r : unit_rows)
+		if (r.name == name)
+			return true;
+
+	return false;
+}
+
+constexpr const UnitRow &unit_row(std::string_view name) {
+	for (const UnitRow &r : unit_rows)
+		if (r.name == name)
+			return r;
+
+	throw std::runtime_error("unknown unit");
+}
+
+/** What the stats table does not have. */
+struct UnitDef final {
+	std::string_view name; /**< row in the stats table */
+	DrsId anim;
+	unsigned dir_images;
+	Fixed radius;
+};
+
+// FIXME verify radius
+static constexpr UnitDef unit_defs[] = {
+	{"Villager", DrsId::villager_idle, 6, Fixed::from(0.2)},
+	{"Clubman", DrsId::clubman_stand, 6, Fixed::from(0.2)},
+};
+
+static constexpr unsigned unit_types = (unsigned)std::size(unit_defs);
+static_assert(unit_types == (unsigned)UnitType::clubman + 1, "unit definitions out of sync");
+static_assert([] {
+	for (const UnitDef &d : unit_defs)
+		if (!has_unit_row(d.name))
+			return false;
+
+	return true;
+}(), "unit definitions without a row in the stats table");
+
+/** Movement speed in tiles per tick for the speed column of the stats table. */
+constexpr Fixed unit_speed(char speed) {
+	// FIXME verify these
+	switch (speed) {
+	case 'S': return Fixed::from(0.4);
+	case 'M': return Fixed::from(0.5);
+	case 'F': return Fixed::from(0.8);
+	}
+
+	throw std::runtime_error("unknown speed");
+}
+
+struct BuildingDef final {
+	DrsId anim_base, anim_player;
+	unsigned hp, size, los;
+};
+
+// FIXME verify size and los
+static constexpr BuildingDef building_defs[] = {
+	{DrsId::barracks_base, DrsId::empty3x3, 350, 3, 5},
+	{DrsId::town_center_base, DrsId::town_center_player, 600, 3, 7},
+};
+
+static constexpr unsigned building_types = (unsigned)std::size(building_defs);
+static_assert(building_types == (unsigned)BuildingType::town_center + 1, "building definitions out of sync");
+
+struct ResourceDef final {
+	unsigned hp, size, anim, amount;
+};
+
+// FIXME verify size and amount
+static constexpr ResourceDef resource_defs[] = {
+	{40, 14, 463, 40}, // wood
+	{1, 16, 240, 150}, // food
+	{1, 40, 481, 400}, // gold
+	{1, 40, 622, 250}, // stone
+};
+
+static_assert(std::size(resource_defs) == (unsigned)ResourceType::stone + 1, "resource definitions out of sync");
+
+/** Units are followed by buildings. */
+static constexpr unsigned defender_types = unit_types + building_types;
+
+template<typename T, typename F> constexpr std::array<T, unit_types> per_unit(F f) {
+	std::array<T, unit_types> a{};
+
+	for (unsigned i = 0; i < unit_types; ++i)
+		a[i] = f(unit_defs[i], unit_row(unit_defs[i].name));
+
+	return a;
+}
+
+template<typename T, typename F> constexpr std::array<T, building_types> per_building(F f) {
+	std::array<T, building_types> a{};
+
+	for (unsigned i = 0; i < building_types; ++i)
+		a[i] = f(building_defs[i]);
+
+	return a;
+}
+
+static constexpr std::array<DrsId, unit_types> unit_anim = per_unit<DrsId>([](const UnitDef &d, const UnitRow&) { return d.anim; });
+static constexpr std::array<unsigned, unit_types> unit_hp = per_unit<unsigned>([](const UnitDef&, const UnitRow &r) { return r.hp; });
+static constexpr std::array<unsigned, unit_types> unit_dir_images = per_unit<unsigned>([](const UnitDef &d, const UnitRow&) { return d.dir_images; });
+static constexpr std::array<Fixed, unit_types> unit_movespeed = per_unit<Fixed>([](const UnitDef&, const UnitRow &r) { return unit_speed(r.speed); });
+static constexpr std::array<Fixed, unit_types> unit_radius = per_unit<Fixed>([](const UnitDef &d, const UnitRow&) { return d.radius; });
+static constexpr std::array<unsigned, unit_types> unit_los = per_unit<unsigned>([](const UnitDef&, const UnitRow &r) { return r.los; });
+
+static constexpr std::array<unsigned, unit_types> unit_train_ticks = per_unit<unsigned>([](const UnitDef&, const UnitRow &r) {
+	return r.train_time * World::ticks_per_second;
+});
+
+static constexpr std::array<unsigned, unit_types> unit_reload_ticks = per_unit<unsigned>([](const UnitDef&, const UnitRow &r) {
+	return r.reload * World::ticks_per_second / 1000;
+});
+
+static constexpr std::array<Fixed, unit_types> unit_range = per_unit<Fixed>([](const UnitDef&, const UnitRow &r) { return Fixed((int)r.range); });
+
+/** Chance to hit in percent. The table has no accuracy for melee units, since they always hit. */
+static constexpr std::array<unsigned, unit_types> unit_accuracy = per_unit<unsigned>([](const UnitDef&, const UnitRow &r) {
+	return r.attack_type == 'M' ? 100u : r.accuracy;
+});
+
+static constexpr std::array<DrsId, building_types> building_anim_base = per_building<DrsId>([](const BuildingDef &d) { return d.anim_base; });
+static constexpr std::array<DrsId, building_types> building_anim_player = per_building<DrsId>([](const BuildingDef &d) { return d.anim_player; });
+static constexpr std::array<unsigned, building_types> building_hp = per_building<unsigned>([](const BuildingDef &d) { return d.hp; });
+static constexpr std::array<unsigned, building_types> building_size = per_building<unsigned>([](const BuildingDef &d) { return d.size; });
+static constexpr std::array<unsigned, building_types> building_los = per_building<unsigned>([](const BuildingDef &d) { return d.los; });
+
+/** Melee and pierce armor of buildings. */
+static constexpr unsigned building_armor[building_types][2] = {
+	// FIXME verify these
+	{0, 0}, // barracks
+	{0, 0}, // town center
+};
+
+/** Damage for each attacker and defender, indexed by attacker * defender_types + defender. */
+static constexpr std::array<uint16_t, unit_types * defender_types> damage = [] {
+	std::array<uint16_t, unit_types * defender_types> table{};
+
+	for (unsigned a = 0; a < unit_types; ++a) {
+		const UnitRow &att = unit_row(unit_defs[a].name);
+		unsigned type = att.attack_type == 'P';
+
+		for (unsigned d = 0; d < defender_types; ++d) {
+			unsigned ar = d < unit_types ? unit_row(unit_defs[d].name).armor[type] : building_armor[d - unit_types][type];
+			// every hit does at least one damage, no matter how strong the armor is
+			table[a * defender_types + d] = (uint16_t)(att.attack > ar ? att.attack - ar : 1);
+		}
+	}
+
+	return table;
+}();
+
+}
+
+}
+
+}
@@ -0,0 +1,198 @@
+/* Copyright 2016-2020 the Age of Empires Free Software Remake authors. See LEGAL for legal info */
+
+#pragma once
+
+/*
+ * Cache of pre-rendered terrain.
+ *
+ * The map is split in blocks of block_size by block_size tiles. Every block that is on
+ * screen gets its own texture, into which all its tiles are drawn once. A frame then
+ * only blits the textures of the blocks on screen instead of every single tile.
+ *
+ * A texture depends on the terrain and on which tiles have been explored, so for every
+ * block the revision of its map chunk and a copy of its explored bits are kept. If
+ * either has changed by the time the block is drawn, its texture is redrawn. Only
+ * blocks that are on screen are looked at, so this is a few dozen compares per frame.
+ *
+ * Textures use a lot of memory, so the ones that have not been drawn for the longest
+ * time are dropped once the budget is exceeded. Blocks that are on screen are never
+ * dropped, so the budget may be exceeded if the screen is huge.
+ */
+
+#include "math.hpp"
+#include "world.hpp"
+
+#include <cstddef>
+#include <cstdint>
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+namespace genie {
+
+namespace game {
+
+/**
+ * Terrain blocks that are drawn into textures of type T. How textures are made and
+ * drawn is up to the caller, so this does not depend on the renderer.
+ */
+template<typename T> class TerrainCache final {
+public:
+	static constexpr unsigned block_bits = 4, block_size = 1u << block_bits;
+	/** Size of the texture for one block, which is just big enough for its diamond of tiles. */
+	static constexpr int block_w = block_size * tw, block_h = block_size * th;
+	static constexpr size_t block_bytes = (size_t)block_w * block_h * 4;
+	static constexpr size_t default_budget = 64u << 20;
+
+	static_assert(block_size <= Map::chunk_size && block_size <= FogOfWar::chunk_size, "blocks must not cross chunks");
+private:
+	static constexpr unsigned none = ~0u;
+
+	struct Block final {
+		std::unique_ptr<T> texture; /**< nullptr if dropped or if nothing has been explored */
+		uint32_t revision; /**< of the map chunk when the texture was drawn */
+		uint16_t explored[block_size]; /**< one row of bits per row of tiles when the texture was drawn */
+		bool valid; /**< whether texture matches revision and explored */
+		unsigned prev, next; /**< in lru, if there is a texture */
+		uint64_t frame; /**< that has drawn this block last */
+	};
+
+	unsigned bw, bh; /**< number of blocks in both directions */
+	size_t budget, used;
+	uint64_t frame;
+	std::vector<Block> blocks; /**< y,x order */
+	unsigned head, tail; /**< of all blocks with a texture, most recently drawn first */
+	size_t built, dropped;
+public:
+	TerrainCache(const Map &map, size_t budget=default_budget)
+		: bw((map.w + block_size - 1) >> block_bits), bh((map.h + block_size - 1) >> block_bits)
+		, budget(budget), used(0), frame(0), blocks((size_t)bw * bh), head(none), tail(none), built(0), dropped(0) {}
+
+	/** Number of bytes in use by all textures. */
+	size_t memory() const noexcept { return used; }
+	/** Number of textures that have been drawn and dropped so far. */
+	size_t builds() const noexcept { return built; }
+	size_t drops() const noexcept { return dropped; }
+
+	/** Drop all textures, e.g. because the renderer has lost them. */
+	void clear() {
+		while (tail != none)
+			drop(tail);
+	}
+
+	/**
+	 * Call \a fn(tx, ty, x, y) for every tile of block (\a bx, \a by) that is on \a map,
+	 * where x, y is the position of the tile relative to the top left of the texture.
+	 */
+	template<typename F> static void tiles(const Map &map, unsigned bx, unsigned by, F fn) {
+		unsigned tx0 = bx << block_bits, ty0 = by << block_bits;
+
+		for (unsigned dy = 0; dy < block_size && ty0 + dy < map.h; ++dy)
+			for (unsigned dx = 0; dx < block_size && tx0 + dx < map.w; ++dx)
+				fn(tx0 + dx, ty0 + dy, (int)(dx + dy) * (tw / 2), (int)(dx - dy + block_size - 1) * (th / 2));
+	}
+
+	/**
+	 * Draw all terrain that \a player has explored and that lies within \a x0..x1 and \a
+	 * y0..y1 on screen, both exclusive, if the top left of the map is at (\a left, \a top).
+	 *
+	 * \a build(std::unique_ptr<T> &texture, unsigned bx, unsigned by) has to draw block (bx,
+	 * by) into texture, which it has to create first if it is nullptr.
+	 * \a draw(T &texture, int x, int y) has to draw texture at screen position x, y.
+	 */
+	template<typename B, typename D>
+	void paint(const Map &map, const FogOfWar &fog, unsigned player, int left, int top, int x0, int y0, int x1, int y1, B build, D draw) {
+		++frame;
+
+		// the texture of block (bx, by) starts block_h / 2 - th / 2 above the screen position of the block
+		int dy = block_h / 2 - th / 2;
+
+		visible_cells((int)bw, (int)bh, block_w, block_h, x0 - left - block_w, y0 - top - block_h + dy, x1 - left - 1, y1 - top + dy - 1, [&](int bx, int by, int x, int y) {
+			Block &b = blocks[(size_t)by * bw + bx];
+			unsigned tx0 = (unsigned)bx << block_bits, ty0 = (unsigned)by << block_bits;
+			uint32_t revision = map.revision(tx0, ty0);
+			uint16_t explored[block_size];
+			bool any = false;
+
+			for (unsigned i = 0; i < block_size; ++i)
+				any |= (explored[i] = (uint16_t)(fog.explored_row(player, (int)tx0, (int)(ty0 + i)) >> (tx0 % FogOfWar::chunk_size))) != 0;
+
+			if (!b.valid || b.revision != revision || !std::equal(explored, explored + block_size, b.explored)) {
+				if (b.texture)
+					unlink(b);
+
+				if (any) {
+					bool fresh = !b.texture;
+
+					build(b.texture, (unsigned)bx, (unsigned)by);
+					++built;
+
+					if (fresh)
+						used += block_bytes;
+				} else if (b.texture) {
+					// nothing to draw, so keep the memory for blocks that need it
+					b.texture.reset();
+					used -= block_bytes;
+				}
+
+				b.revision = revision;
+				std::copy(explored, explored + block_size, b.explored);
+				b.valid = true;
+
+				if (b.texture)
+					link(b, (unsigned)(&b - blocks.data()));
+			} else if (b.texture) {
+				unlink(b);
+				link(b, (unsigned)(&b - blocks.data()));
+			}
+
+			if (!b.texture)
+				return;
+
+			b.frame = frame;
+			draw(*b.texture, left + x, top + y - dy);
+		});
+
+		while (used > budget && tail != none && blocks[tail].frame != frame)
+			drop(tail);
+	}
+private:
+	void link(Block &b, unsigned index) noexcept {
+		b.prev = none;
+		b.next = head;
+
+		if (head != none)
+			blocks[head].prev = index;
+		else
+			tail = index;
+
+		head = index;
+	}
+
+	void unlink(Block &b) noexcept {
+		if (b.prev != none)
+			blocks[b.prev].next = b.next;
+		else
+			head = b.next;
+
+		if (b.next != none)
+			blocks[b.next].prev = b.prev;
+		else
+			tail = b.prev;
+	}
+
+	void drop(unsigned index) {
+		Block &b = blocks[index];
+
+		unlink(b);
+		b.texture.reset();
+		b.valid = false;
+		used -= block_bytes;
+		++dropped;
+	}
+};
+
+}
+
+}
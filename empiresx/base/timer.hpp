@@ -0,0 +1,132 @@
+/* Copyright 2016-2020 the Age of Empires Free Software Remake authors. See LEGAL for legal info */
+
+#pragma once
+
+/*
+ * Hierarchical timer wheel for things that happen in some future simulation tick.
+ *
+ * Level 0 has one slot for each of the next 64 ticks, level 1 one slot for every 64
+ * ticks after that and so on. Whenever a level wraps around, the next slot of the
+ * level above is moved down. Scheduling and firing a timer are O(1), so ticks
+ * without anything due cost next to nothing.
+ */
+
+#include <cstddef>
+#include <cstdint>
+
+#include <algorithm>
+#include <vector>
+
+namespace genie {
+
+template<typename T> class TimerWheel final {
+public:
+	static constexpr unsigned slot_bits = 6, slots = 1 << slot_bits, levels = 4;
+private:
+	struct Timer final {
+		uint64_t due;
+		uint64_t seq; /**< timers that are due in the same tick fire in the order they have been scheduled */
+		T data;
+	};
+
+	std::vector<Timer> wheel[levels][slots];
+	std::vector<Timer> later; /**< too far ahead for the top level */
+	std::vector<Timer> firing; /**< scratch for advance */
+	uint64_t next; /**< tick that advance processes next */
+	uint64_t seq;
+	size_t count;
+public:
+	TimerWheel() : wheel(), later(), firing(), next(1), seq(0), count(0) {}
+
+	/** Last tick that has been processed. */
+	uint64_t now() const noexcept { return next - 1; }
+	/** Number of pending timers. */
+	size_t size() const noexcept { return count; }
+
+	/** Fire \a data in \a delay ticks. Zero is the same as one, i.e. the next tick. */
+	void schedule(uint64_t delay, const T &data) {
+		insert(Timer{next + (delay ? delay - 1 : 0), seq++, data});
+		++count;
+	}
+
+	/** Sequence number for the next timer. */
+	uint64_t sequence() const noexcept { return seq; }
+
+	/** Call \a fn(due, seq, data) for every pending timer in no particular order. */
+	template<typename F> void each(F fn) const {
+		for (unsigned l = 0; l < levels; ++l)
+			for (unsigned s = 0; s < slots; ++s)
+				for (const Timer &tm : wheel[l][s])
+					fn(tm.due, tm.seq, tm.data);
+
+		for (const Timer &tm : later)
+			fn(tm.due, tm.seq, tm.data);
+	}
+
+	/** Drop all timers and continue after tick \a now with sequence number \a seq, e.g. when a game is loaded. */
+	void reset(uint64_t now, uint64_t seq) {
+		for (auto &level : wheel)
+			for (std::vector<Timer> &slot : level)
+				slot.clear();
+
+		later.clear();
+		next = now + 1;
+		this->seq = seq;
+		count = 0;
+	}
+
+	/** Add timer that has been saved with each. */
+	void restore(uint64_t due, uint64_t seq, const T &data) {
+		insert(Timer{due, seq, data});
+		++count;
+	}
+
+	/** Process next tick and call \a fn for every timer that is due. \a fn may schedule new timers. */
+	template<typename F> void advance(F fn) {
+		uint64_t t = next;
+
+		for (unsigned l = 1; l < levels && !(t & ((UINT64_C(1) << (slot_bits * l)) - 1)); ++l)
+			cascade(wheel[l][(t >> (slot_bits * l)) & (slots - 1)]);
+
+		if (!(t & ((UINT64_C(1) << (slot_bits * levels)) - 1)))
+			cascade(later);
+
+		std::vector<Timer> &slot = wheel[0][t & (slots - 1)];
+		++next;
+
+		if (slot.empty())
+			return;
+
+		firing.swap(slot);
+		count -= firing.size();
+
+		std::sort(firing.begin(), firing.end(), [](const Timer &lhs, const Timer &rhs) { return lhs.seq < rhs.seq; });
+
+		for (const Timer &tm : firing)
+			fn(tm.data);
+
+		firing.clear();
+	}
+private:
+	void insert(const Timer &tm) {
+		uint64_t delta = tm.due - next;
+
+		for (unsigned l = 0; l < levels; ++l)
+			if (delta < UINT64_C(1) << (slot_bits * (l + 1))) {
+				wheel[l][(tm.due >> (slot_bits * l)) & (slots - 1)].push_back(tm);
+				return;
+			}
+
+		later.push_back(tm);
+	}
+
+	void cascade(std::vector<Timer> &list) {
+		std::vector<Timer> moved;
+		moved.swap(list);
+
+		for (const Timer &tm : moved)
+			insert(tm);
+	}
+};
+
+}
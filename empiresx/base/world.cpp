@@ -6,10 +6,14 @@
 #include "drs.hpp"
 #include "game.hpp"
 #include "random.hpp"
+#include "mapgen.hpp"
+#include "stats.hpp"
 
 #include <cmath>
 #include <inttypes.h>
 
+#include <chrono>
+
 namespace genie {
 
 namespace game {
@@ -31,222 +35,321 @@ GatherStatus Resource::gather(Resource &dest, unsigned amount) {
 
 unsigned particle_id_counter = 1;
 
-const unsigned res_hp[] = {
-	40,
-	1,
-	1,
-	1,
-};
-
-// FIXME verify these
-const unsigned res_size[] = {
-	14,
-	16,
-	40,
-	40,
-};
-
-const unsigned res_anim[] = {
-	463,
-	240,
-	481,
-	622,
-};
-
-// FIXME verify these
-const unsigned res_amount[] = {
-	40,
-	150,
-	400,
-	250,
-};
-
-StaticResource::StaticResource(Map &map, const Box2<float> &pos, ResourceType type, unsigned res_anim, unsigned image)
+StaticResource::StaticResource(Map &map, const Box2x &pos, ResourceType type, unsigned res_anim, unsigned image)
 	: Particle(map, pos, res_anim, image)
-	, Resource(type, res_amount[(unsigned)type]) {}
+	, Resource(type, stats::resource_defs[(unsigned)type].amount)
+{
+	map.block((int)pos.left, (int)pos.top, 1, 1);
+}
+
+/** Ticks between animation frames. */
+static constexpr unsigned anim_ticks = 6;
 
-World::World(LCG &lcg, const StartMatch &settings, bool host)
-	: map(lcg, settings), lcg(lcg), host(host)
-	, static_res()
+World::World(LCG &lcg, const StartMatch &settings, bool host, Arena &arena)
+	: arena(arena), map(lcg, settings), lcg(lcg), host(host), paths(map), flows(map), grid(), fog(map.w, map.h), timers(), combat(), economy(), revision(0)
+	, static_res(&arena), buildings(&arena), units(&arena), entities(&arena), active(&arena), woken(&arena), crowded(&arena), moved(&arena), dead(&arena), freed(&arena), steps(&arena), profile(nullptr)
 	//, tiled_objects(Vector2<int>(ispow2(settings.map_w) ? settings.map_w : nextpow2(settings.map_w), ispow2(settings.map_h) ? settings.map_h : nextpow2(settings.map_h)))
 	//, movable_objects(Vector2<float>(static_cast<float>(settings.map_w), static_cast<float>(settings.map_h)))
 {
+	schedule(anim_ticks, TimerType::anim);
 }
 
 #pragma warning(push)
 #pragma warning(disable: 4244)
 
 void World::populate(unsigned players) {
-	size_t tiles = static_cast<size_t>(map.w) * map.h;
-	size_t trees = static_cast<size_t>(round(pow(static_cast<double>(tiles), 0.6)));
-	size_t goldstone = players + static_cast<size_t>(round(pow(static_cast<double>(tiles), 0.23))) - 2;
-	size_t bushes = players + static_cast<size_t>(round(pow(static_cast<double>(tiles), 0.25))) - 1;
+	// separate stream, so objects do not depend on how the terrain has been generated
+	uint32_t seed = (uint32_t)lcg.next() << 15;
+	seed |= (uint32_t)lcg.next();
 
-	// TODO rewrite generation algorithm
-	// FIXME ensure there are no static nor dynamic objects placed on top of each other
-
-	printf("create %llu trees\n", (long long unsigned)trees);
-
-	for (size_t i = 0; i < trees; ++i) {
-		Box2<float> pos(
-			static_cast<uint16_t>(lcg.next(10, map.w - 1)),
-			static_cast<uint16_t>(lcg.next(map.h - 1))
-		);
-		static_res.emplace_back(new StaticResource(map, pos, ResourceType::wood, (unsigned)DrsId::desert_tree + lcg.next() % 4));
-	}
+	MapGenerator gen(map.w, map.h, seed);
 
-	printf("create %llu bushes\n", (long long unsigned)5 * bushes);
+	// keep trees and mines away from the town center, barracks and starting units
+	for (unsigned i = 0; i < players; ++i)
+		gen.reserve(0, (int)((i + 1) * map.h / (players + 1)) - 8, 16, 20);
 
-	for (size_t i = 0; i < bushes; ++i) {
-		Box2<float> pos(
-			static_cast<uint16_t>(lcg.next(12, map.w - 4 - 1)),
-			static_cast<uint16_t>(lcg.next(4, map.h - 4 - 1))
-		);
-		static_res.emplace_back(new StaticResource(map, pos, ResourceType::food, 240));
-		pos.left += 1;
-		static_res.emplace_back(new StaticResource(map, pos, ResourceType::food, 240));
-		pos.top -= 1;
-		static_res.emplace_back(new StaticResource(map, pos, ResourceType::food, 240));
-		pos.left -= 1;
-		static_res.emplace_back(new StaticResource(map, pos, ResourceType::food, 240));
-		pos.left -= 1;
-		static_res.emplace_back(new StaticResource(map, pos, ResourceType::food, 240));
-	}
+	MapGenerator::Stats stats;
+	auto start = std::chrono::steady_clock::now();
+	std::vector<MapObject> objects(gen.generate(players, scheduler(), &stats));
 
-	printf("create %llu goldstone\n", (long long unsigned)4 * goldstone);
+	printf("generate %zu regions in %.1f ms\n", stats.regions, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+	printf("create %zu trees\n", stats.placed[(unsigned)ResourceType::wood]);
+	printf("create %zu bushes\n", stats.placed[(unsigned)ResourceType::food]);
+	printf("create %zu goldstone\n", stats.placed[(unsigned)ResourceType::gold] + stats.placed[(unsigned)ResourceType::stone]);
 
-	for (size_t i = 0; i < goldstone; ++i) {
-		Box2<float> pos(
-			static_cast<uint16_t>(lcg.next(10, map.w - 10 - 1)),
-			static_cast<uint16_t>(lcg.next(2, map.h - 2 - 1))
-		);
-		static_res.emplace_back(new StaticResource(map, pos, ResourceType::gold, 481, lcg.next(6)));
-		pos.left -= 2;
-		static_res.emplace_back(new StaticResource(map, pos, ResourceType::gold, 481, lcg.next(6)));
-		pos.left += 3;
-		static_res.emplace_back(new StaticResource(map, pos, ResourceType::gold, 481, lcg.next(6)));
-		pos.top += 1;
-		static_res.emplace_back(new StaticResource(map, pos, ResourceType::gold, 481, lcg.next(6)));
+	static_res.reserve(static_res.size() + objects.size());
 
-		pos.left = static_cast<uint16_t>(lcg.next(10, map.w - 10 - 1));
-		pos.top = static_cast<uint16_t>(lcg.next(2, map.h - 2 - 1));
+	for (const MapObject &o : objects) {
+		Box2x pos(o.x, o.y);
 
-		static_res.emplace_back(new StaticResource(map, pos, ResourceType::stone, 622, lcg.next(6)));
-		pos.left -= 2;
-		static_res.emplace_back(new StaticResource(map, pos, ResourceType::stone, 622, lcg.next(6)));
-		pos.left += 3;
-		static_res.emplace_back(new StaticResource(map, pos, ResourceType::stone, 622, lcg.next(6)));
-		pos.top += 1;
-		static_res.emplace_back(new StaticResource(map, pos, ResourceType::stone, 622, lcg.next(6)));
+		if (o.type == ResourceType::wood)
+			add(static_res, arena.make<StaticResource>(map, pos, o.type, stats::resource_defs[(unsigned)o.type].anim + o.variant));
+		else
+			add(static_res, arena.make<StaticResource>(map, pos, o.type, stats::resource_defs[(unsigned)o.type].anim, o.variant));
 	}
 
 	printf("create %u players and 3 villagers and 2 clubman\n", players);
 
 	for (unsigned i = 0; i < players; ++i) {
-		Box2<float> pos(
-			5, (static_cast<float>(i + 1) / (players + 1)) * map.h
+		Box2x pos(
+			5, Fixed((i + 1) * map.h) / (players + 1)
 		);
-		buildings.emplace_back(new Building(map, pos, BuildingType::town_center, i));
+		build(pos, BuildingType::town_center, i);
 		pos.top += 4;
-		buildings.emplace_back(new Building(map, pos, BuildingType::barracks, i));
+		build(pos, BuildingType::barracks, i);
 		pos.top += 3;
 		pos.left += 1;
-		units.emplace_back(new Unit(map, pos, UnitType::clubman, i));
+		spawn(pos, UnitType::clubman, i);
 		pos.left += 1;
-		units.emplace_back(new Unit(map, pos, UnitType::clubman, i));
+		spawn(pos, UnitType::clubman, i);
 		pos.top -= 3;
 		pos.left -= 2;
 
 		pos.top -= 4 + 3;
-		units.emplace_back(new Villager(map, pos, i));
+		spawn(pos, UnitType::villager, i);
 		pos.left += 1;
-		units.emplace_back(new Villager(map, pos, i));
+		spawn(pos, UnitType::villager, i);
 		pos.left += 2;
-		units.emplace_back(new Villager(map, pos, i));
+		spawn(pos, UnitType::villager, i);
 	}
 }
 
 #pragma warning(pop)
 
-static const DrsId build_anim_base[] = {
-	DrsId::barracks_base,
-	DrsId::town_center_base,
-};
-
-static const DrsId build_anim_player[] = {
-	DrsId::empty3x3,
-	DrsId::town_center_player,
-};
-
-static const unsigned build_hp[] = {
-	350, // barracks
-	600, // town center
-};
-
-Building::Building(Map &map, const Box2<float> &pos, BuildingType type, unsigned player)
-	: Particle(map, pos, (unsigned)build_anim_base[(unsigned)type], 0, player)
-	, Alive(build_hp[(unsigned)type])
-	, anim_player((unsigned)build_anim_player[(unsigned)type]), player(player), prod(), type(type) {}
-
-void Building::tick(World &world) {
-	auto &next = prod.front();
-}
-
-static const DrsId unit_anim[] = {
-	DrsId::villager_idle,
-	DrsId::clubman_stand,
-};
-
-static const unsigned unit_hp[] = {
-	25,
-	25,
-};
-
-static const unsigned unit_dir_images[] = {
-	6,
-	6,
-};
-
-static const float unit_movespeed[] = {
-	0.5f,
-	0.4f,
-};
-
-Unit::Unit(Map &map, const Box2<float> &pos, UnitType type, unsigned player)
-	: Particle(map, pos, (unsigned)unit_anim[(unsigned)type], 0, player)
-	, Alive(unit_hp[(unsigned)type])
-	, type(type), dir((UnitDirection)(rand() % 8)), dir_images(unit_dir_images[(unsigned)type])
-	, target(pos.left, pos.top)
+Building::Building(Map &map, const Box2x &pos, BuildingType type, unsigned player, std::pmr::memory_resource *mem)
+	: Particle(map, pos, (unsigned)stats::building_anim_base[(unsigned)type], 0, player)
+	, Alive(stats::building_hp[(unsigned)type])
+	, anim_player((unsigned)stats::building_anim_player[(unsigned)type]), player(player), prod(mem), type(type)
+{
+	unsigned size = stats::building_size[(unsigned)type];
+	map.block((int)pos.left, (int)pos.top, size, size);
+}
+
+unsigned Building::size() const noexcept {
+	return stats::building_size[(unsigned)type];
+}
+
+unsigned Building::los() const noexcept {
+	return stats::building_los[(unsigned)type];
+}
+
+Building &World::build(const Box2x &pos, BuildingType type, unsigned player) {
+	Building &b = add(buildings, arena.make<Building>(map, pos, type, player, &arena));
+	economy.join(player);
+
+	paths.invalidate((int)pos.left, (int)pos.top, b.size(), b.size());
+	flows.invalidate((int)pos.left, (int)pos.top, b.size(), b.size());
+
+	int half = (int)b.size() / 2;
+	fog.see(b.handle, player, pos.left.floor() + half, pos.top.floor() + half, b.los());
+
+	return b;
+}
+
+Production::Production(UnitType what) : what(what), ticks(stats::unit_train_ticks[(unsigned)what]) {}
+
+void Building::train(World &world, UnitType what) {
+	prod.emplace_back(what);
+
+	if (prod.size() == 1)
+		world.schedule(prod.front().ticks, TimerType::produce, handle);
+}
+
+void Building::produced(World &world) {
+	assert(!prod.empty());
+	Production done(prod.front());
+	prod.pop_front();
+
+	// FIXME find a free tile around the building
+	unsigned size = stats::building_size[(unsigned)type];
+	world.spawn(Box2x(pos.left + size, pos.top + size), done.what, player);
+
+	if (!prod.empty())
+		world.schedule(prod.front().ticks, TimerType::produce, handle);
+}
+
+void Building::tick(World&) {}
+
+Unit::Unit(Map &map, const Box2x &pos, UnitType type, unsigned player)
+	: Particle(map, pos, (unsigned)stats::unit_anim[(unsigned)type], 0, player)
+	, Alive(stats::unit_hp[(unsigned)type])
+	, type(type), player(player), dir((UnitDirection)(rand() % 8)), dir_images(stats::unit_dir_images[(unsigned)type])
+	, movespeed(stats::unit_movespeed[(unsigned)type]), target(pos.left, pos.top), path(), flow(), dest((int)pos.left, (int)pos.top)
+	, awake(false), waiting(false), victim(), reloading(false), job(), carry(ResourceType::food, 0)
 {
 	hflip = dir >= UnitDirection::top_right;
 }
 
+void Unit::move(World &world, const Vector2x &to) {
+	path.clear();
+	flow.reset();
+	dest = Vector2<int>((int)to.x, (int)to.y);
+	waiting = true;
+	world.wake(*this);
+	world.paths.request(*this, Vector2<int>((int)pos.left, (int)pos.top), Vector2<int>((int)to.x, (int)to.y));
+}
+
+void Unit::follow(const TilePath &path) {
+	this->path = path;
+	waiting = false;
+	// finish the current step first, so we stay aligned with the tiles
+	if (this->path.empty())
+		target = pos.topleft();
+}
+
+void Unit::follow(const std::shared_ptr<FlowField> &flow) {
+	path.clear();
+	this->flow = flow;
+	waiting = false;
+	dest = flow->dest;
+}
+
+Fixed Unit::radius() const noexcept {
+	return stats::unit_radius[(unsigned)type];
+}
+
+unsigned Unit::los() const noexcept {
+	return stats::unit_los[(unsigned)type];
+}
+
 void Unit::imgtick() {
 	image_index = (image_index + 1) % dir_images;
 }
 
-static constexpr float move_threshold = 0.5f / tw; // half a horizontal pixel should be close enough
+/** Minimum group size for which one shared flow field is cheaper than a path per unit. */
+static constexpr size_t group_flow_min = 16;
+/** Units per job in World::tick. Smaller worlds are not worth splitting up. */
+static constexpr size_t unit_grain = 256;
+/** Maximum number of units to look at for separation, so crowds cost linear time. */
+static constexpr unsigned max_neighbours = 32;
 
-void Unit::tick(World &world) {
-	float dx = target.x - pos.left, dy = target.y - pos.top;
+void Unit::sense(const World&, UnitStep &step) const {
+	step.target = target;
+	step.pos = pos.topleft();
+	step.next = step.stop = step.arrive = step.crowded = false;
+
+	// decide never overshoots, so the target is reached exactly
+	if (step.pos != target)
+		return;
+
+	Vector2<int> next;
+
+	if (flow) {
+		if (!flow->next(next, Vector2<int>((int)pos.left, (int)pos.top))) {
+			step.stop = true;
+			return;
+		}
+	} else if (!path.empty()) {
+		next = path.back();
+		step.next = true;
+	} else {
+		step.stop = true;
+		return;
+	}
+
+	step.target = Vector2x(next.x, next.y);
+}
+
+void Unit::decide(const World &world, UnitStep &step) const {
+	bool reached = !step.stop && step_towards(step.pos, step.target, movespeed);
+
+	// separation: move away from anything we overlap with, based on where everyone was at the start of the tick
+	Vector2x here(pos.topleft()), push;
+	Fixed r = radius();
 
-	if (abs(dx) < move_threshold && abs(dy) < move_threshold)
+	world.grid.query(here, r * 2, max_neighbours, [&](const UnitGrid::Entry &e) {
+		if (e.who == this)
+			return;
+
+		Fixed range = r + e.radius;
+		Vector2x d(here - e.pos);
+		int64_t d2 = (int64_t)d.x.raw * d.x.raw + (int64_t)d.y.raw * d.y.raw;
+
+		if (d2 >= (int64_t)range.raw * range.raw)
+			return;
+
+		// sleeping units do not push themselves away until they are woken up
+		if (!e.who->awake)
+			step.crowded = true;
+
+		// the group has arrived already, so do not push our way in
+		if (!step.stop && e.who->dest == dest && e.who->idle())
+			step.arrive = true;
+
+		if (!d2) {
+			// exactly on top of each other: pick a direction that only depends on both handles, and take opposite sides
+			uint32_t lo = std::min(handle.index, e.who->handle.index), hi = std::max(handle.index, e.who->handle.index);
+			uint16_t a = (uint16_t)(lo * 40503u + hi * 9973u);
+
+			if (handle.index > e.who->handle.index)
+				a += (uint16_t)(angle_full / 2);
+
+			push += Vector2x(fcos(a), fsin(a)) * (range / 2);
+			return;
+		}
+
+		// both units move away half of the overlap
+		Fixed dist = length(d);
+		push += d * ((range - dist) / 2) / dist;
+	});
+
+	if (push != Vector2x()) {
+		// never push more than we can walk
+		Fixed len = length(push);
+		if (len > movespeed)
+			push = push * movespeed / len;
+
+		Vector2x next(step.pos + push);
+
+		if (world.map.passable(next.x.floor(), next.y.floor()))
+			step.pos = next;
+	}
+
+	// the waypoint counts as reached even if we have been pushed away from it, so crowds do not keep shuffling around it
+	if (reached || step.arrive)
+		step.target = step.pos;
+}
+
+void Unit::commit(World &world, const UnitStep &step) {
+	if (step.stop) {
+		flow.reset();
+
+		// idle units stay wherever they have been pushed to
+		if (step.pos == pos.topleft())
+			return;
+
+		target = step.pos;
+		pos.left = step.pos.x;
+		pos.top = step.pos.y;
+		scr = world.map.tile_to_scr(pos.topleft(), hotspot_x, hotspot_y, anim_index, image_index);
 		return;
+	}
+
+	if (step.next)
+		path.pop_back();
+
+	if (step.arrive) {
+		path.clear();
+		flow.reset();
+	}
 
-	float angle = atan2(dy, dx);
-	pos.left += cos(angle) * movespeed;
-	pos.top += sin(angle) * movespeed;
+	Vector2x delta(step.target - pos.topleft());
 
-	// FIXME update unit direction
-	// -angle + 270
-	Vector2<float> scr_target;
-	genie::tile_to_scr(scr_target.x, scr_target.y, target.x, target.y);
-	float scr_dx = scr_target.x - scr.left, scr_dy = scr_target.y;
-	// force scr_angle to be positive in range [0,360)
-	double scr_angle = fmod(2 * M_PI + -atan2(scr_dy, scr_dx) + 1.5 * M_PI, 2 * M_PI);
+	target = step.target;
+	pos.left = step.pos.x;
+	pos.top = step.pos.y;
 
-	unsigned norm_dir = static_cast<unsigned>(8 + round(scr_angle / (2 * M_PI / 8))) % 8;
-	dir = (UnitDirection)(norm_dir);
+	// face the direction we are walking to on screen
+	if (delta != Vector2x()) {
+		Vector2x scr_delta;
+		genie::tile_to_scr(scr_delta.x, scr_delta.y, delta.x, delta.y);
+
+		// directions start facing down and go clockwise on screen
+		uint16_t scr_angle = (uint16_t)(angle(scr_delta) - angle_quarter + angle_eighth / 2);
+		dir = (UnitDirection)(scr_angle / angle_eighth);
+	}
+
+	unsigned norm_dir = (unsigned)dir;
 
 	hflip = norm_dir >= (unsigned)UnitDirection::top_right;
 
@@ -261,12 +364,20 @@ void Unit::tick(World &world) {
 	scr = world.map.tile_to_scr(pos.topleft(), hotspot_x, hotspot_y, anim_index, image_index);
 }
 
+void Unit::tick(World &world) {
+	UnitStep step;
+
+	sense(world, step);
+	decide(world, step);
+	commit(world, step);
+}
+
 void Unit::draw(int offx, int offy) const {
 	int index = (unsigned)dir * dir_images + image_index;
 	Particle::draw(offx, offy, index);
 }
 
-Villager::Villager(Map &map, const Box2<float> &pos, unsigned player)
+Villager::Villager(Map &map, const Box2x &pos, unsigned player)
 	: Unit(map, pos, UnitType::villager, player) {}
 
 void World::imgtick() {
@@ -274,25 +385,445 @@ void World::imgtick() {
 		x->imgtick();
 }
 
-void World::tick() {
-	for (auto& x : units)
-		x->tick(*this);
+void World::move(const std::vector<Handle> &group, const Vector2x &to) {
+	std::vector<Unit*> alive;
+
+	// ignore anything that is gone or cannot move
+	for (Handle h : group) {
+		Unit *u = dynamic_cast<Unit*>(get(h));
+		if (u) {
+			u->victim = u->job = Handle();
+			alive.push_back(u);
+		}
+	}
+
+	std::shared_ptr<FlowField> field;
+
+	if (alive.size() >= group_flow_min) {
+		int left = (int)alive[0]->pos.left, top = (int)alive[0]->pos.top, right = left + 1, bottom = top + 1;
+
+		for (Unit *u : alive) {
+			left = std::min(left, (int)u->pos.left);
+			top = std::min(top, (int)u->pos.top);
+			right = std::max(right, (int)u->pos.left + 1);
+			bottom = std::max(bottom, (int)u->pos.top + 1);
+		}
+
+		field = flows.get(Vector2<int>((int)to.x, (int)to.y), Box2<int>(left, top, right - left, bottom - top));
+	}
+
+	// small or spread out groups get a path for every unit, and so does anyone that
+	// can only get there by leaving the field
+	for (Unit *u : alive) {
+		if (!field || !field->reaches(Vector2<int>((int)u->pos.left, (int)u->pos.top))) {
+			u->move(*this, to);
+			continue;
+		}
+
+		paths.cancel(*u);
+		u->follow(field);
+		wake(*u);
+	}
 }
 
-void World::query_static(std::vector<Particle*> &list, const Box2<float> &bounds) {
-	for (auto &x : static_res)
-		if (bounds.intersects(x->scr))
-			list.push_back(x.get());
+void World::attack(const std::vector<Handle> &group, Handle target) {
+	for (Handle h : group) {
+		Unit *u = dynamic_cast<Unit*>(get(h));
 
-	for (auto &x : buildings)
-		if (bounds.intersects(x->scr))
-			list.push_back(x.get());
+		if (u && h != target) {
+			u->victim = target;
+			u->job = Handle();
+			wake(*u);
+		}
+	}
 }
 
-void World::query_dynamic(std::vector<Particle*> &list, const Box2<float> &bounds) {
-	for (auto &x : units)
-		if (bounds.intersects(x->scr))
-			list.push_back(x.get());
+void World::gather(const std::vector<Handle> &group, Handle res) {
+	if (!dynamic_cast<StaticResource*>(get(res)))
+		return;
+
+	for (Handle h : group) {
+		Unit *u = dynamic_cast<Unit*>(get(h));
+
+		if (u && u->type == UnitType::villager) {
+			u->victim = Handle();
+			u->job = res;
+			wake(*u);
+		}
+	}
+}
+
+/** Point of the square at \a left, \a top with size \a s that is closest to \a p. */
+static Vector2x closest(const Vector2x &p, Fixed left, Fixed top, Fixed s) {
+	return Vector2x(std::min(std::max(p.x, left), left + s), std::min(std::max(p.y, top), top + s));
+}
+
+/**
+ * Distance from \a p to the square at \a left, \a top with size \a s. Units stand at the
+ * top left corner of their tile, so anything that stands on the tiles around the square touches it.
+ */
+static Fixed gap(const Vector2x &p, Fixed left, Fixed top, unsigned s) {
+	return distance(p, closest(p, left - 1, top - 1, Fixed(s + 1)));
+}
+
+/** Free tile around the square at \a left, \a top with size \a s that is closest to \a p. */
+static Vector2x beside(const Map &map, const Vector2x &p, int left, int top, int s) {
+	Vector2x best(closest(p, Fixed(left - 1), Fixed(top - 1), Fixed(s + 1)));
+
+	if (map.passable((int)best.x, (int)best.y))
+		return best;
+
+	Fixed best_d;
+	bool found = false;
+
+	// walk around the border, since the tile in front may be occupied by e.g. another tree
+	for (int y = top - 1; y <= top + s; ++y)
+		for (int x = left - 1; x <= left + s; x += y == top - 1 || y == top + s ? 1 : s + 1) {
+			Fixed d(distance(p, Vector2x(x, y)));
+
+			if (!map.passable(x, y) || (found && d >= best_d))
+				continue;
+
+			best = Vector2x(x, y);
+			best_d = d;
+			found = true;
+		}
+
+	// if everything around is blocked, get as close as possible
+	return best;
+}
+
+void World::halt(Unit &u) {
+	if (u.idle() && !u.waiting)
+		return;
+
+	paths.cancel(u);
+	u.path.clear();
+	u.flow.reset();
+	u.target = u.pos.topleft();
+	u.waiting = false;
+}
+
+void World::engage(Unit &u) {
+	Particle *p = get(u.victim);
+	Alive *a = dynamic_cast<Alive*>(p);
+
+	// the victim is gone or is about to be buried
+	if (!a || !a->hp) {
+		u.victim = Handle();
+		return;
+	}
+
+	Vector2x here(u.pos.topleft()), chase;
+	Fixed d;
+	unsigned defender;
+
+	if (Unit *v = dynamic_cast<Unit*>(p)) {
+		chase = v->pos.topleft();
+		d = distance(here, chase) - v->radius();
+		defender = Combat::defender(v->type);
+	} else {
+		Building &b = dynamic_cast<Building&>(*p);
+
+		chase = beside(map, here, (int)b.pos.left, (int)b.pos.top, b.size());
+		d = gap(here, b.pos.left, b.pos.top, b.size());
+		defender = Combat::defender(b.type);
+	}
+
+	if (d - u.radius() > Combat::range(u.type)) {
+		// keep going to wherever we were walking before looking again
+		if (!u.waiting && u.idle())
+			u.move(*this, chase);
+
+		return;
+	}
+
+	halt(u);
+
+	if (u.reloading)
+		return;
+
+	combat.queue(u.handle, u.type, u.victim, defender);
+	u.reloading = true;
+	schedule(Combat::reload(u.type), TimerType::reload, u.handle);
+}
+
+/** Villagers drop off or gather anything that is at most this far away, so it still works after being pushed a bit. */
+static constexpr Fixed work_reach = Fixed::from(0.5);
+
+Building *World::drop_site(const Unit &u) const {
+	Vector2x here(u.pos.topleft());
+	Building *best = nullptr;
+	Fixed best_d;
+
+	for (const ArenaPtr<Building> &b : buildings) {
+		if (b->type != BuildingType::town_center || b->owner() != u.player || !b->hp)
+			continue;
+
+		Fixed d(gap(here, b->pos.left, b->pos.top, b->size()));
+
+		if (!best || d < best_d) {
+			best = b.get();
+			best_d = d;
+		}
+	}
+
+	return best;
+}
+
+void World::work(Unit &u) {
+	Vector2x here(u.pos.topleft());
+	StaticResource *r = dynamic_cast<StaticResource*>(get(u.job));
+
+	// the resource is gone or is about to be removed
+	if (!r || !r->left()) {
+		u.job = Handle();
+		r = nullptr;
+	}
+
+	if (u.carry.left() && (!r || u.carry.left() >= Economy::capacity || u.carry.what() != r->what())) {
+		Building *b = drop_site(u);
+
+		// nowhere to bring it to, so just stand around
+		if (!b)
+			return;
+
+		if (gap(here, b->pos.left, b->pos.top, b->size()) > work_reach) {
+			if (!u.waiting && u.idle())
+				u.move(*this, beside(map, here, (int)b->pos.left, (int)b->pos.top, b->size()));
+
+			return;
+		}
+
+		halt(u);
+		economy.drop(u.handle, u.player, u.carry.what(), u.carry.left());
+		u.carry = Resource(u.carry.what(), 0);
+	}
+
+	if (!r)
+		return;
+
+	if (gap(here, r->pos.left, r->pos.top, 1) > work_reach) {
+		if (!u.waiting && u.idle())
+			u.move(*this, beside(map, here, (int)r->pos.left, (int)r->pos.top, 1));
+
+		return;
+	}
+
+	halt(u);
+
+	if (u.reloading)
+		return;
+
+	if (u.carry.what() != r->what())
+		u.carry = Resource(r->what(), 0);
+
+	if (r->gather(u.carry) == GatherStatus::depleted)
+		economy.deplete(u.job);
+
+	u.reloading = true;
+	schedule(Economy::gather_ticks(r->what()), TimerType::gather, u.handle);
+}
+
+void World::bury() {
+	for (Handle h : dead) {
+		Particle *p = get(h);
+
+		// killed twice in the same tick
+		if (!p)
+			continue;
+
+		fog.forget(h);
+
+		if (Unit *u = dynamic_cast<Unit*>(p)) {
+			paths.cancel(*u);
+			grid.remove(*u);
+		} else if (Building *b = dynamic_cast<Building*>(p)) {
+			map.block((int)b->pos.left, (int)b->pos.top, b->size(), b->size(), false);
+			freed.emplace_back((int)b->pos.left, (int)b->pos.top, (int)b->size(), (int)b->size());
+		} else if (StaticResource *r = dynamic_cast<StaticResource*>(p)) {
+			map.block((int)r->pos.left, (int)r->pos.top, 1, 1, false);
+			freed.emplace_back((int)r->pos.left, (int)r->pos.top, 1, 1);
+		}
+
+		entities.remove(h);
+	}
+
+	dead.clear();
+
+	// many resources may run out in the same tick, so check every flow field only once
+	if (!freed.empty()) {
+		for (const Box2<int> &b : freed)
+			paths.invalidate(b.left, b.top, (unsigned)b.w, (unsigned)b.h);
+
+		flows.invalidate(freed.data(), freed.size());
+		freed.clear();
+	}
+
+	// forget about units before they are freed
+	auto gone = [](const Unit *u) { return !u->hp; };
+	active.erase(std::remove_if(active.begin(), active.end(), gone), active.end());
+	woken.erase(std::remove_if(woken.begin(), woken.end(), gone), woken.end());
+
+	units.erase(std::remove_if(units.begin(), units.end(), [](const ArenaPtr<Unit> &u) { return !u->hp; }), units.end());
+	buildings.erase(std::remove_if(buildings.begin(), buildings.end(), [](const ArenaPtr<Building> &b) { return !b->hp; }), buildings.end());
+	static_res.erase(std::remove_if(static_res.begin(), static_res.end(), [](const ArenaPtr<StaticResource> &r) { return !r->left(); }), static_res.end());
+	++revision;
+}
+
+Unit &World::spawn(const Box2x &pos, UnitType type, unsigned player) {
+	economy.join(player);
+
+	if (type == UnitType::villager)
+		return add(units, arena.make<Villager>(map, pos, player));
+
+	return add(units, arena.make<Unit>(map, pos, type, player));
+}
+
+void World::wake(Unit &u) {
+	if (u.awake)
+		return;
+
+	u.awake = true;
+	woken.push_back(&u);
+}
+
+void World::schedule(unsigned delay, TimerType type, Handle who) {
+	timers.schedule(delay, TimerEvent{type, who});
+}
+
+void World::fire(const TimerEvent &ev) {
+	switch (ev.type) {
+	case TimerType::anim:
+		imgtick();
+		schedule(anim_ticks, TimerType::anim);
+		break;
+	case TimerType::produce:
+		// the building may be gone by now
+		if (Building *b = dynamic_cast<Building*>(get(ev.who)))
+			b->produced(*this);
+		break;
+	case TimerType::reload:
+	case TimerType::gather:
+		if (Unit *u = dynamic_cast<Unit*>(get(ev.who))) {
+			u->reloading = false;
+			wake(*u);
+		}
+		break;
+	}
+}
+
+void World::tick() {
+	typedef std::chrono::steady_clock clk;
+	clk::time_point last(profile ? clk::now() : clk::time_point());
+
+	auto lap = [&](TickPhase phase) {
+		if (!profile)
+			return;
+
+		clk::time_point now(clk::now());
+		profile->ns[(unsigned)phase] += (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(now - last).count();
+		last = now;
+	};
+
+	timers.advance([this](const TimerEvent &ev) { fire(ev); });
+	lap(TickPhase::timers);
+
+	if (!woken.empty()) {
+		active.insert(active.end(), woken.begin(), woken.end());
+		woken.clear();
+		std::sort(active.begin(), active.end(), [](const Unit *lhs, const Unit *rhs) { return lhs->handle.index < rhs->handle.index; });
+	}
+
+	steps.resize(active.size());
+
+	// sense and decide: units only read the world and write their own step
+	scheduler().parallel_for(active.size(), unit_grain, [this](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; ++i)
+			active[i]->sense(*this, steps[i]);
+	}, "unit sense");
+	lap(TickPhase::sense);
+
+	scheduler().parallel_for(active.size(), unit_grain, [this](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; ++i)
+			active[i]->decide(*this, steps[i]);
+	}, "unit decide");
+	lap(TickPhase::decide);
+
+	// move: commit in handle order, so the outcome does not depend on the number of threads
+	crowded.clear();
+	moved.clear();
+	size_t n = 0;
+
+	for (size_t i = 0; i < active.size(); ++i) {
+		Unit &u = *active[i];
+		const UnitStep &step = steps[i];
+		bool pushed = step.pos != u.pos.topleft();
+		Vector2x from(u.pos.topleft());
+
+		u.commit(*this, step);
+
+		if (u.pos.topleft() != from)
+			moved.push_back(&u);
+
+		if (u.victim)
+			engage(u);
+		else if (u.job || u.carry.left())
+			work(u);
+
+		if (step.crowded)
+			crowded.push_back(&u);
+
+		// only units that have entered another tile change what their player can see
+		fog.see(u.handle, u.owner(), u.pos.left.floor(), u.pos.top.floor(), u.los());
+
+		if (step.stop && !pushed && !u.waiting)
+			u.awake = false;
+		else
+			active[n++] = &u;
+	}
+
+	active.resize(n);
+
+	// wake up sleeping units that others overlap with, so they move out of the way as well
+	for (const Unit *u : crowded) {
+		Vector2x here(u->pos.topleft());
+		Fixed r = u->radius();
+
+		grid.query(here, r * 2, max_neighbours, [&](const UnitGrid::Entry &e) {
+			Fixed range = r + e.radius;
+			Vector2x d(here - e.pos);
+
+			if ((int64_t)d.x.raw * d.x.raw + (int64_t)d.y.raw * d.y.raw < (int64_t)range.raw * range.raw)
+				wake(*e.who);
+		});
+	}
+
+	// the grid has to keep the positions from the start of the tick until now
+	for (const Unit *u : moved)
+		grid.move(*u);
+
+	lap(TickPhase::move);
+
+	// combat: everything that has been attacked this tick takes damage at once
+	combat.resolve(*this, dead);
+	// economy: add everything that has been dropped off and get rid of depleted resources
+	economy.settle(timers.now(), dead);
+
+	if (!dead.empty())
+		bury();
+
+	lap(TickPhase::resolve);
+	fog.update();
+	lap(TickPhase::fog);
+
+	// orders: compute the flow fields and paths that have been requested during this tick
+	flows.update();
+	paths.step();
+	lap(TickPhase::orders);
+
+	if (profile)
+		++profile->ticks;
 }
 
 }
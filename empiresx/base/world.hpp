@@ -3,9 +3,19 @@
 #pragma once
 
 #include "types.hpp"
+#include "arena.hpp"
 #include "random.hpp"
 #include "math.hpp"
 #include "geom.hpp"
+#include "path.hpp"
+#include "flow.hpp"
+#include "handle.hpp"
+#include "grid.hpp"
+#include "fog.hpp"
+#include "timer.hpp"
+#include "combat.hpp"
+#include "economy.hpp"
+#include "job.hpp"
 
 #include <cassert>
 
@@ -15,6 +25,8 @@
 #include <set>
 #include <algorithm>
 #include <deque>
+#include <memory_resource>
+#include <type_traits>
 
 namespace genie {
 
@@ -53,61 +65,88 @@ enum class TileId {
 	TILE_MAX
 };
 
-enum class Quadrant {
-	tr = 0,
-	tl = 1,
-	bl = 2,
-	br = 3,
-	bad = 4,
-};
+using genie::Quadrant;
+using genie::Box2;
+
+extern void img_dim(Box2<float> &dim, int &hotspot_x, int &hotspot_y, unsigned res, unsigned image);
 
-template<typename T> class Box2 {
+/** Values of one kind for all tiles in a chunk. Nothing is allocated as long as all values are the same. */
+class ChunkLayer final {
+	std::unique_ptr<uint8_t[]> data; /**< y,x order. nullptr if all values are equal to fill */
+	uint8_t fill;
 public:
-	T left, top, w, h; /**< width and height must be positive. */
+	static constexpr unsigned count = 64 * 64;
 
-	constexpr Box2(T left=0, T top=0, T w=0, T h=0) noexcept
-		: left(left), top(top), w(w), h(h) { assert(w >= 0 && h >= 0); }
+	ChunkLayer(uint8_t fill=0) : data(), fill(fill) {}
 
-	constexpr Box2(const Vector2<T> &pos, const Vector2<T> &size) noexcept
-		: left(pos.x), top(pos.y), w(size.x), h(size.y) { assert(size.x >= 0 && size.y >= 0); }
+	uint8_t get(unsigned i) const noexcept { return data ? data[i] : fill; }
+	/** All values or nullptr if the layer is uniform. */
+	const uint8_t *values() const noexcept { return data.get(); }
+	/** Return modifiable value. This allocates the layer if it is still uniform. */
+	uint8_t &at(unsigned i);
+	/** Free memory if all values have become the same. */
+	void compact();
+	/** Overwrite all values with \a v, or with \a fill if \a v is nullptr. */
+	void assign(const uint8_t *v, uint8_t fill=0);
 
-	constexpr T right() const noexcept { return left + w; }
-	constexpr T bottom() const noexcept { return top + h; }
-	constexpr Vector2<T> topleft() const noexcept { return Vector2<T>(left, top); }
-	constexpr Vector2<T> rightbottom() const noexcept { return Vector2<T>(right(), bottom()); }
-	constexpr Vector2<T> center() const noexcept { return Vector2<T>(left + w / 2, top + h / 2); }
+	bool uniform() const noexcept { return !data; }
+};
 
-	constexpr bool contains(const Box2<T> &box) const noexcept {
-		return left <= box.left && top <= box.top && right() <= box.right() && bottom() <= box.bottom();
-	}
+class MapChunk final {
+public:
+	ChunkLayer tiles, heights;
+	ChunkLayer blocked; /**< number of static objects on each tile */
+	bool generated; /**< whether tiles contains the terrain yet */
+	uint32_t revision; /**< bumped whenever heights or blocked change, so saves only copy chunks that have changed */
 
-	constexpr bool contains(const Vector2<T> &pt) const noexcept {
-		return pt.x >= left && pt.y >= top && pt.x < right() && pt.y < bottom();
-	}
+	MapChunk() : tiles(), heights(), blocked(), generated(false), revision(0) {}
+};
 
-	constexpr bool intersects(const Box2<T> &box) const noexcept {
-		return !(left >= box.right() || top >= box.bottom() || right() <= box.left || bottom() <= box.top);
-	}
+/**
+ * Tile grid of the world. The map is split in chunks that are allocated once they are
+ * modified and whose terrain is generated once it is looked at. Every chunk has its
+ * own random stream, so the terrain does not depend on which chunks are touched first.
+ */
+class Map final {
+public:
+	static constexpr unsigned chunk_bits = 6;
+	static constexpr unsigned chunk_size = 1u << chunk_bits;
 
-	constexpr Quadrant quadrant(const Vector2<T> &pt) const noexcept {
-		if (!contains(pt))
-			return Quadrant::bad;
+	unsigned w, h;
+private:
+	unsigned cw, ch; /**< number of chunks in both directions */
+	uint32_t seed;
+	std::vector<std::unique_ptr<MapChunk>> chunks; /**< y,x order. nullptr if untouched */
 
-		if (pt.y < center().y)
-			return pt.x < center().x ? Quadrant::tl : Quadrant::tr;
+	friend class World;
+public:
+	Map(LCG &lcg, const StartMatch &settings);
 
-		return pt.x < center().x ? Quadrant::bl : Quadrant::br;
+	bool passable(int x, int y) const noexcept {
+		if (x < 0 || y < 0 || (unsigned)x >= w || (unsigned)y >= h)
+			return false;
+
+		const MapChunk *c = chunks[(y >> chunk_bits) * cw + (x >> chunk_bits)].get();
+		return !c || !c->blocked.get(offset(x, y));
 	}
-};
 
-extern void img_dim(Box2<float> &dim, int &hotspot_x, int &hotspot_y, unsigned res, unsigned image);
+	/** Mark tiles as (un)occupied by a static object. Tiles outside the map are ignored. */
+	void block(int left, int top, unsigned w, unsigned h, bool occupy=true);
 
-class Map final {
-public:
-	unsigned w, h;
-	std::unique_ptr<uint8_t[]> tiles, heights; // y,x order
+	/** Terrain at specified tile. This may generate the chunk, so it must not be used concurrently. */
+	uint8_t tile(unsigned x, unsigned y);
+	uint8_t height(unsigned x, unsigned y) const noexcept;
 
-	Map(LCG &lcg, const StartMatch &settings);
+	/** Revision of the chunk that contains tile (\a x, \a y), which is zero if it is untouched. */
+	uint32_t revision(unsigned x, unsigned y) const noexcept {
+		const MapChunk *c = chunks[(y >> chunk_bits) * cw + (x >> chunk_bits)].get();
+		return c ? c->revision : 0;
+	}
+
+	/** Number of chunks that have been allocated. */
+	size_t allocated() const noexcept;
+	/** Number of bytes in use by all allocated chunks. */
+	size_t memory() const noexcept;
 
 	Box2<float> tile_to_scr(const Vector2<float> &pos, int &hotspot_x, int &hotspot_y, unsigned res, unsigned image) {
 		Box2<float> scr;
@@ -117,6 +156,18 @@ public:
 
 		return scr;
 	}
+
+	/** Same as above, but for simulation state. */
+	Box2<float> tile_to_scr(const Vector2x &pos, int &hotspot_x, int &hotspot_y, unsigned res, unsigned image) {
+		return tile_to_scr(Vector2<float>((float)pos.x, (float)pos.y), hotspot_x, hotspot_y, res, image);
+	}
+private:
+	MapChunk &chunk(unsigned x, unsigned y);
+	void generate(MapChunk &c, unsigned cx, unsigned cy);
+
+	static constexpr unsigned offset(int x, int y) noexcept {
+		return ((unsigned)y & (chunk_size - 1)) * chunk_size + ((unsigned)x & (chunk_size - 1));
+	}
 };
 
 enum class ResourceType {
@@ -139,6 +190,9 @@ protected:
 public:
 	Resource(ResourceType type, unsigned amount) : type(type), amount(amount) {}
 
+	ResourceType what() const noexcept { return type; }
+	unsigned left() const noexcept { return amount; }
+
 	GatherStatus gather(Resource &dest, unsigned amount=1);
 };
 
@@ -150,28 +204,32 @@ extern uint32_t particle_id_counter;
  */
 class Particle {
 public:
-	Box2<float> pos, scr;
+	Box2x pos; /**< tile position. this is simulation state and must only be changed deterministically */
+	Box2<float> scr;
 	int hotspot_x, hotspot_y;
 protected:
 	unsigned anim_index;
 	unsigned image_index;
 	unsigned color;
 	uint32_t id;
+	Handle handle; /**< assigned by the world once the particle has been added to it */
 	bool hflip;
 
+	friend class World;
+
 	// special ctor for e.g. effects that do not care about the tile position \a pos
 	Particle(const Box2<float> &scr, unsigned anim_index, unsigned image_index=0, unsigned color=0, bool hflip=false)
 		: pos(), scr(scr), anim_index(anim_index), image_index(image_index), color(color)
-		, id(particle_id_counter), hflip(hflip)
+		, id(particle_id_counter), handle(), hflip(hflip)
 	{
 		// disallow particle_id_counter to be zero
 		particle_id_counter = particle_id_counter == UINT32_MAX ? 1 : particle_id_counter + 1;
 	}
 
 	// default ctor for anything that is not a graphical effect
-	Particle(Map &map, const Box2<float> &pos, unsigned anim_index, unsigned image_index=0, unsigned color=0, bool hflip=false)
+	Particle(Map &map, const Box2x &pos, unsigned anim_index, unsigned image_index=0, unsigned color=0, bool hflip=false)
 		: pos(pos), scr(map.tile_to_scr(pos.topleft(), hotspot_x, hotspot_y, anim_index, image_index)), anim_index(anim_index), image_index(image_index), color(color)
-		, id(particle_id_counter), hflip(hflip)
+		, id(particle_id_counter), handle(), hflip(hflip)
 	{
 		// disallow particle_id_counter to be zero
 		particle_id_counter = particle_id_counter == UINT32_MAX ? 1 : particle_id_counter + 1;
@@ -183,6 +241,10 @@ public:
 		return id;
 	}
 
+	constexpr Handle gethandle() const noexcept {
+		return handle;
+	}
+
 protected:
 	void draw(int offx, int offy, unsigned index) const;
 public:
@@ -220,7 +282,7 @@ enum class EffectType {
 /** Special foreground graphical effect */
 class Effect final : public Particle, public Active {
 public:
-	Effect(Map &map, const Box2<float> &pos, EffectType type);
+	Effect(Map &map, const Box2x &pos, EffectType type);
 };
 
 #undef min
@@ -248,14 +310,13 @@ enum class UnitType {
 	clubman,
 };
 
+/** Unit that is queued in a building. Only the first one in the queue is being made. */
 class Production final {
 public:
 	UnitType what;
-	unsigned ticks, total;
-
-	Production(UnitType what, unsigned ticks);
+	unsigned ticks; /**< time it takes to make the unit */
 
-	bool tick();
+	Production(UnitType what);
 };
 
 enum class BuildingType {
@@ -266,20 +327,34 @@ enum class BuildingType {
 class Building final : public Particle, public Alive {
 	unsigned anim_player;
 	unsigned player;
-	std::deque<Production> prod;
+	std::pmr::deque<Production> prod;
+
+	friend class World;
 
 public:
 	const BuildingType type;
 
-	Building(Map &map, const Box2<float> &pos, BuildingType type, unsigned player=0);
+	Building(Map &map, const Box2x &pos, BuildingType type, unsigned player=0, std::pmr::memory_resource *mem=std::pmr::get_default_resource());
+
+	/** Number of tiles the building occupies in both directions. */
+	unsigned size() const noexcept;
+	/** Line of sight in tiles. */
+	unsigned los() const noexcept;
+	unsigned owner() const noexcept { return player; }
 
+	/** Queue unit to be made. It is created once all units before it are done. */
+	void train(World &world, UnitType what);
+	/** Finish the unit in front of the queue and start the next one. This is called by the world when it is done. */
+	void produced(World &world);
+
+	/** Buildings only act on timers, so this does nothing. */
 	void tick(World &world) override;
 	void draw(int offx, int offy) const override;
 };
 
 class StaticResource final : public Particle, public Resource {
 public:
-	StaticResource(Map &map, const Box2<float> &pos, ResourceType type, unsigned res_anim, unsigned image=0);
+	StaticResource(Map &map, const Box2x &pos, ResourceType type, unsigned res_anim, unsigned image=0);
 };
 
 enum class UnitDirection {
@@ -294,42 +369,176 @@ enum class UnitDirection {
 	down_right
 };
 
+/** Outcome of the sense and decide phases for a unit. It is committed in the move phase. */
+struct UnitStep final {
+	Vector2x target, pos; /**< waypoint to walk to and where the unit ends up this tick */
+	bool next; /**< target is taken from the path and has to be removed from it */
+	bool stop; /**< nothing to do, because the unit has arrived or cannot get any further */
+	bool arrive; /**< ran into a unit that has already arrived at the same destination, so stop here */
+	bool crowded; /**< overlaps sleeping units, which have to be woken up */
+};
+
 class Unit : public Particle, public Alive {
 	UnitType type;
+	unsigned player;
 	UnitDirection dir; /**< indicates which direction the unit is facing */
 	unsigned dir_images;
-	float movespeed;
-	Vector2<float> target; /**< map pos target. this never represents a screen position! */
+	Fixed movespeed; /**< tiles per tick */
+	Vector2x target; /**< map pos target. this never represents a screen position! */
+	TilePath path; /**< remaining tiles to walk after target has been reached */
+	std::shared_ptr<FlowField> flow; /**< shared field to follow instead of path, if any */
+	Vector2<int> dest; /**< tile the unit has last been ordered to */
+	bool awake; /**< whether World::tick looks at the unit at all */
+	bool waiting; /**< path has been requested, but it has not been computed yet */
+	Handle victim; /**< what to attack, if anything */
+	bool reloading; /**< attacked or gathered recently, so wait before doing so again */
+	Handle job; /**< resource to gather, if any */
+	Resource carry; /**< what has been gathered, but not dropped off yet */
+
+	friend class World;
 public:
-	Unit(Map &map, const Box2<float> &pos, UnitType type, unsigned player);
+	Unit(Map &map, const Box2x &pos, UnitType type, unsigned player);
 	virtual ~Unit() {}
 
+	/** Order unit to walk to \a to. The path is computed in one of the next world ticks. */
+	void move(World &world, const Vector2x &to);
+	/** Walk along \a path. This is called by the path finder when the requested path is ready. */
+	void follow(const TilePath &path);
+	/** Walk to the destination of \a flow. This is used for large groups that are ordered to the same spot. */
+	void follow(const std::shared_ptr<FlowField> &flow);
+
+	/** Size of the unit in tiles. Other units are pushed away if they get any closer. */
+	Fixed radius() const noexcept;
+	/** Line of sight in tiles. */
+	unsigned los() const noexcept;
+	unsigned owner() const noexcept { return player; }
+	UnitType gettype() const noexcept { return type; }
+
+	/** Whether the unit has nowhere to go. */
+	bool idle() const noexcept { return !flow && path.empty() && pos.topleft() == target; }
+
 	virtual void imgtick();
+
+	/*
+	 * World::tick runs these for all units at once. sense and decide must not modify
+	 * anything but \a step, so they can run in parallel with other units.
+	 */
+
+	/** Determine which waypoint to walk to. */
+	void sense(const World &world, UnitStep &step) const;
+	/** Determine where the unit ends up this tick, while keeping some distance to other units. */
+	void decide(const World &world, UnitStep &step) const;
+	/** Apply \a step to the unit. */
+	void commit(World &world, const UnitStep &step);
+
+	/** Run all phases for just this unit. */
 	virtual void tick(World &world) override;
 	virtual void draw(int offx, int offy) const override;
 };
 
 class Villager final : public Unit {
 public:
-	Villager(Map &map, const Box2<float> &pos, unsigned player);
+	Villager(Map &map, const Box2x &pos, unsigned player);
+};
+
+enum class TimerType {
+	anim,
+	produce,
+	reload,
+	gather,
+};
+
+struct TimerEvent final {
+	TimerType type;
+	Handle who; /**< entity the timer belongs to, if any */
+};
+
+/** Phases of World::tick in the order they run. */
+enum class TickPhase {
+	timers,
+	sense,
+	decide,
+	move, /**< includes updating the unit grid */
+	resolve, /**< combat, economy and removing whatever is gone */
+	fog,
+	orders, /**< flow fields and paths */
+	count,
+};
+
+/** Time spent in each phase of World::tick, summed over all ticks since it has been installed. */
+struct TickProfile final {
+	uint64_t ns[(unsigned)TickPhase::count]; /**< indexed by TickPhase */
+	uint64_t ticks;
 };
 
+class SaveWriter;
+class SaveFile;
+class AiView;
+
 /** Container for all particles, entities, etc. */
 class World final {
 public:
+	static constexpr unsigned ticks_per_second = 50;
+
+	Arena &arena; /**< where all entities and their containers are allocated */
 	Map map;
 	LCG &lcg;
 	bool host;
+	PathFinder paths;
+	FlowFieldCache flows;
+	UnitGrid grid; /**< unit positions at the start of the decide phase */
+	FogOfWar fog;
+	TimerWheel<TimerEvent> timers; /**< everything that has to happen in some future tick */
+	Combat combat;
+	Economy economy;
+	/** Bumped whenever anything is added or removed. */
+	uint32_t revision;
 
 private:
-	std::vector<std::unique_ptr<StaticResource>> static_res;
-	std::vector<std::unique_ptr<Building>> buildings;
-	std::vector<std::unique_ptr<Unit>> units;
-
+	friend class DrawList;
+
+	std::pmr::vector<ArenaPtr<StaticResource>> static_res;
+	std::pmr::vector<ArenaPtr<Building>> buildings;
+	std::pmr::vector<ArenaPtr<Unit>> units;
+	HandleTable<Particle> entities;
+
+	std::pmr::vector<Unit*> active; /**< awake units ordered by handle */
+	std::pmr::vector<Unit*> woken; /**< units that have been woken up during this tick */
+	std::pmr::vector<Unit*> crowded; /**< scratch for tick */
+	std::pmr::vector<const Unit*> moved; /**< units that have to be updated in grid. scratch for tick */
+	std::pmr::vector<Handle> dead; /**< everything that has died during this tick */
+	std::pmr::vector<Box2<int>> freed; /**< tiles that have been freed in bury. scratch for tick */
+	std::pmr::vector<UnitStep> steps; /**< per unit step for this tick. indices match with active */
+	TickProfile *profile; /**< where to add the time of each phase, if anywhere */
 public:
-	World(LCG &lcg, const StartMatch &settings, bool host);
+	/** Create world for one match. \a arena must outlive the world. */
+	World(LCG &lcg, const StartMatch &settings, bool host, Arena &arena);
 
 	void populate(unsigned players);
+
+	/** Add everything that is needed to continue the game to \a w. */
+	void save(SaveWriter &w) const;
+	/** Replace everything with the snapshot in \a f. Throws std::runtime_error if it is invalid or for another map size. */
+	void load(const SaveFile &f);
+	/** Copy what computer players need to know to \a v. */
+	void view(AiView &v) const;
+
+	/** Return the particle that \a h refers to or nullptr if it is gone. */
+	Particle *get(Handle h) const noexcept { return entities.get(h); }
+
+	/** Create a new unit at \a pos for \a player. */
+	Unit &spawn(const Box2x &pos, UnitType type, unsigned player);
+	/** Place new building and update anything that depends on which tiles are occupied. */
+	Building &build(const Box2x &pos, BuildingType type, unsigned player);
+	/**
+	 * Order \a group to walk to \a to. Large groups share one flow field, while
+	 * small groups get a path for every unit.
+	 */
+	void move(const std::vector<Handle> &group, const Vector2x &to);
+	/** Order \a group to attack \a target. Units walk up to the target until they are in range. */
+	void attack(const std::vector<Handle> &group, Handle target);
+	/** Order the villagers in \a group to gather \a res and bring it to the closest town center. */
+	void gather(const std::vector<Handle> &group, Handle res);
 	/**
 	 * Animate all dynamic particles. This is not synchronized with the server whatsoever,
 	 * since there is no need to (well, it should be in sync automatigcally... but we have
@@ -339,12 +548,68 @@ public:
 	/**
 	 * Compute the next simulation step and use the mp for any events that are generated.
 	 * If the world is created as host, this will also send messages to other clients.
+	 *
+	 * The step is split in phases: sense and decide only read the world and run in
+	 * parallel, while move and resolve commit the results in a fixed order. This makes
+	 * the outcome independent of the number of threads.
+	 *
+	 * Only due timers and awake units are looked at. Units fall asleep once they have
+	 * nothing to do, and wake up when they get an order or when someone bumps into
+	 * them, so the cost of a tick does not depend on the number of idle units.
 	 */
 	void tick();
 
-	void query_static(std::vector<Particle*> &list, const Box2<float> &bounds);
-	// FIXME change type to Unit*
-	void query_dynamic(std::vector<Particle*> &list, const Box2<float> &bounds);
+	/** Measure how long each phase of World::tick takes and add it to \a p. Use nullptr to stop measuring. */
+	void trace(TickProfile *p) noexcept { profile = p; }
+
+	/** Number of units that World::tick looks at. */
+	size_t awake() const noexcept { return active.size() + woken.size(); }
+	/** Make sure World::tick looks at \a u from the next tick on. */
+	void wake(Unit &u);
+	/** Fire timer \a type for \a who in \a delay ticks. */
+	void schedule(unsigned delay, TimerType type, Handle who=Handle());
+private:
+	/** Take ownership of \a obj and make it reachable through its handle. */
+	template<typename T, typename U> U &add(std::pmr::vector<ArenaPtr<T>> &list, ArenaPtr<U> ptr) {
+		U *obj = ptr.get();
+		list.emplace_back(std::move(ptr));
+		obj->handle = entities.add(*obj);
+
+		if constexpr (std::is_base_of<Unit, U>::value) {
+			grid.insert(*obj);
+			wake(*obj);
+		}
+
+		++revision;
+
+		return *obj;
+	}
+
+	/** Same as add, but with the handle that \a obj had when it has been saved. */
+	template<typename T, typename U> U &adopt(std::pmr::vector<ArenaPtr<T>> &list, ArenaPtr<U> ptr, Handle h) {
+		U *obj = ptr.get();
+		list.emplace_back(std::move(ptr));
+		entities.put(h, *obj);
+		obj->handle = h;
+
+		if constexpr (std::is_base_of<Unit, U>::value)
+			grid.insert(*obj);
+
+		++revision;
+		return *obj;
+	}
+
+	void fire(const TimerEvent &ev);
+	/** Attack or chase the victim of \a u, if it has any. */
+	void engage(Unit &u);
+	/** Stop walking, because \a u has come close enough to what it is after. */
+	void halt(Unit &u);
+	/** Gather or drop off resources for \a u. */
+	void work(Unit &u);
+	/** Closest town center of the owner of \a u or nullptr if there is none. */
+	Building *drop_site(const Unit &u) const;
+	/** Remove everything that has died or has run out. */
+	void bury();
 };
 
 }
@@ -0,0 +1,137 @@
+/* Copyright 2016-2020 the Age of Empires Free Software Remake authors. See LEGAL for legal info */
+
+/*
+Benchmark for packing animation frames into atlas pages like ImageCache does. A set of
+made up animations with sizes like those of units, buildings and resources is loaded
+one after another. The frames of each animation and player color are packed from tall
+to short into the first page that has room for all of them. Then a scene of random
+sprites from a few of the animations and two players is "drawn" and the number of
+texture switches is counted, once with a texture per frame and once with atlas pages.
+Consecutive sprites from the same page end up in one SDL_RenderGeometry call, so
+switches are draw calls.
+
+Results are printed as one JSON object per line. Packed rectangles must lie within
+their page and must not overlap, otherwise the program fails.
+
+usage: bench_atlas [animations [page_size [sprites [on_screen [players]]]]]
+
+Configure with -DCMAKE_BUILD_TYPE=Release for meaningful timings.
+*/
+
+#include <cstdio>
+#include <cstdlib>
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+#include "../base/atlas.hpp"
+#include "../base/random.hpp"
+
+using namespace genie;
+
+typedef std::chrono::steady_clock clk;
+
+static bool failed = false;
+
+static void bench(unsigned anims, int size, unsigned sprites, unsigned on_screen, unsigned players) {
+	LCG rng(0x1234567);
+	std::vector<AtlasRect> frames;
+	std::vector<unsigned> first; /**< first frame of every animation and player color */
+	std::vector<unsigned> groups; /**< first entry in first of every animation */
+
+	for (unsigned a = 0; a < anims; ++a) {
+		// units have many small frames and player colors, buildings and resources a few big ones
+		bool unit = rng.below(4) != 0;
+		int w = unit ? 24 + (int)rng.below(80) : 64 + (int)rng.below(192), h = unit ? 32 + (int)rng.below(64) : 48 + (int)rng.below(160);
+		unsigned n = unit ? 5 * (5 + (unsigned)rng.below(11)) : 1 + (unsigned)rng.below(4);
+		unsigned players = rng.below(2) ? 9 : 1;
+
+		groups.push_back((unsigned)first.size());
+
+		for (unsigned p = 0; p < players; ++p) {
+			first.push_back((unsigned)frames.size());
+
+			for (unsigned i = 0; i < n; ++i)
+				frames.push_back(AtlasRect{w - (int)rng.below(8), h - (int)rng.below(8), AtlasRect::none, 0, 0});
+		}
+	}
+
+	groups.push_back((unsigned)first.size());
+	first.push_back((unsigned)frames.size());
+
+	auto start = clk::now();
+	AtlasPages pages(size, size);
+
+	// only the colors of the players in the match are packed, just like ImageCache does
+	for (unsigned a = 0; a < anims; ++a)
+		for (unsigned g = groups[a]; g < groups[a + 1] && g < groups[a] + players; ++g)
+			pages.pack(frames.data() + first[g], first[g + 1] - first[g]);
+
+	double ms_pack = std::chrono::duration<double, std::milli>(clk::now() - start).count();
+
+	// every pixel may only be covered once
+	std::vector<std::vector<uint8_t>> covered(pages.size(), std::vector<uint8_t>((size_t)size * size));
+
+	for (const AtlasRect &f : frames) {
+		if (f.page == AtlasRect::none)
+			continue;
+
+		if (f.x < 0 || f.y < 0 || f.x + f.w > size || f.y + f.h > size) {
+			failed = true;
+			continue;
+		}
+
+		for (int y = f.y; y < f.y + f.h; ++y)
+			for (int x = f.x; x < f.x + f.w; ++x)
+				if (covered[f.page][(size_t)y * size + x]++)
+					failed = true;
+	}
+
+	/*
+	 * scene in drawing order: every sprite is a random frame of one of the animations on
+	 * screen in a random player color. animations are loaded once they are drawn for the
+	 * first time, so what is on screen together has mostly been loaded together.
+	 */
+	unsigned window = (unsigned)rng.below(anims - std::min(anims, on_screen) + 1);
+	std::vector<unsigned> shown;
+
+	for (unsigned i = 0; i < on_screen; ++i)
+		shown.push_back((window + i) % anims);
+
+	unsigned switches_single = 0, switches_atlas = 0, last_frame = ~0u, last_page = ~0u;
+
+	for (unsigned s = 0; s < sprites; ++s) {
+		unsigned a = shown[(size_t)rng.below(shown.size())];
+		unsigned g = groups[a] + (unsigned)rng.below(std::min(players, groups[a + 1] - groups[a]));
+		unsigned i = first[g] + (unsigned)rng.below(first[g + 1] - first[g]);
+
+		switches_single += i != last_frame;
+		switches_atlas += frames[i].page != last_page;
+		last_frame = i;
+		last_page = frames[i].page;
+	}
+
+	printf("{\"bench\": \"atlas\", \"animations\": %u, \"frames\": %zu, \"page\": %d, \"pages\": %zu, \"occupancy\": %.3f, \"ms_pack\": %.3f, "
+		"\"sprites\": %u, \"on_screen\": %u, \"players\": %u, \"calls_single\": %u, \"calls_atlas\": %u, \"valid\": %s}\n",
+		anims, frames.size(), size, pages.size(), pages.occupancy(), ms_pack,
+		sprites, on_screen, players, switches_single, switches_atlas, failed ? "false" : "true");
+	fflush(stdout);
+}
+
+int main(int argc, char **argv) {
+	unsigned anims = argc > 1 ? (unsigned)strtoul(argv[1], NULL, 10) : 0;
+	int size = argc > 2 ? atoi(argv[2]) : 4096;
+	unsigned sprites = argc > 3 ? (unsigned)strtoul(argv[3], NULL, 10) : 2000;
+	unsigned on_screen = argc > 4 ? (unsigned)strtoul(argv[4], NULL, 10) : 8;
+	unsigned players = argc > 5 ? (unsigned)strtoul(argv[5], NULL, 10) : 2;
+
+	if (anims) {
+		bench(anims, size, sprites, on_screen, players);
+	} else {
+		for (unsigned n : {10, 30, 60})
+			bench(n, size, sprites, on_screen, players);
+	}
+
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,215 @@
+/* Copyright 2016-2020 the Age of Empires Free Software Remake authors. See LEGAL for legal info */
+
+/*
+Benchmark for the game event queue. Frames full of orders are pushed, swapped and
+visited, once on a single thread and once with a second thread that pushes while the
+game thread swaps and drains. Results are printed as one JSON object per line with
+the events per second and the number of allocations per frame once the queue has
+warmed up, which should be zero.
+
+The program fails if any event is lost or seen twice.
+
+usage: bench_events [frames [events]]
+*/
+
+#include <cstdio>
+#include <cstdlib>
+
+#include <atomic>
+#include <chrono>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../base/events.hpp"
+#include "../base/game.hpp"
+
+namespace genie {
+
+// dummy callbacks, see server/server.cpp
+void check_taunt(const std::string&) {}
+void menu_lobby_stop_game(MenuLobby*) {}
+
+namespace game {
+
+void Particle::draw(int, int, unsigned) const {}
+void Building::draw(int, int) const {}
+
+void img_dim(Box2<float> &dim, int&, int&, unsigned, unsigned) {
+	dim.w = dim.h = 10;
+}
+
+}
+
+}
+
+using namespace genie;
+using namespace genie::game;
+
+typedef std::chrono::steady_clock clk;
+
+static std::atomic<uint64_t> allocations(0);
+
+void *operator new(size_t size) {
+	allocations.fetch_add(1, std::memory_order_relaxed);
+
+	if (void *p = malloc(size ? size : 1))
+		return p;
+
+	throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept {
+	free(p);
+}
+
+void operator delete(void *p, size_t) noexcept {
+	free(p);
+}
+
+/** Units in each group order. */
+static constexpr unsigned group_size = 8;
+/** Frames that are not measured, so both batches can grow to their final size. */
+static constexpr unsigned warmup = 4;
+
+static bool failed = false;
+
+/** Sums everything it visits, so the events cannot be optimized away and lost events are noticed. */
+class Drain final {
+public:
+	uint64_t events, units, sum;
+
+	Drain() : events(0), units(0), sum(0) {}
+
+	void group(uint32_t count, const Handle *h) {
+		++events;
+		units += count;
+
+		for (uint32_t i = 0; i < count; ++i)
+			sum += h[i].index;
+	}
+
+	void operator()(const MoveEvent &e, const Handle *h) { group(e.count, h); }
+	void operator()(const AttackEvent &e, const Handle *h) { group(e.count, h); }
+	void operator()(const GatherEvent &e, const Handle *h) { group(e.count, h); }
+
+	void operator()(const TrainEvent &e) {
+		++events;
+		sum += e.building.index;
+	}
+};
+
+/** Push event \a i. Every fourth event is of the same type. */
+static void push(GameEvents &ev, const Handle *group, uint64_t i) {
+	switch (i % 4) {
+	case 0:
+		ev.move(group, group_size, Vector2x(Fixed((int)(i % 64)), Fixed(3)));
+		break;
+	case 1:
+		ev.attack(group, group_size, Handle((uint32_t)i, 1));
+		break;
+	case 2:
+		ev.gather(group, group_size, Handle((uint32_t)i, 1));
+		break;
+	default:
+		ev.train(Handle((uint32_t)i, 1), UnitType::villager);
+		break;
+	}
+}
+
+static void check(const char *name, const Drain &d, uint64_t events) {
+	uint64_t groups = events - events / 4;
+
+	if (d.events != events || d.units != groups * group_size) {
+		fprintf(stderr, "%s: expected %llu events, got %llu\n", name, (unsigned long long)events, (unsigned long long)d.events);
+		failed = true;
+	}
+}
+
+static void report(const char *name, unsigned frames, unsigned events, uint64_t total, double sec, uint64_t allocs) {
+	printf("{\"bench\": \"%s\", \"frames\": %u, \"events_per_frame\": %u, \"events_per_sec\": %.0f, \"ns_per_event\": %.1f, \"allocs_per_frame\": %.2f}\n",
+		name, frames, events, total / sec, sec * 1e9 / total, (double)allocs / frames);
+	fflush(stdout);
+}
+
+static void bench_single(unsigned frames, unsigned events) {
+	GameEvents ev;
+	Handle group[group_size];
+	Drain d;
+
+	for (unsigned i = 0; i < group_size; ++i)
+		group[i] = Handle(i, 1);
+
+	uint64_t allocs = 0;
+	auto start = clk::now();
+
+	for (unsigned f = 0; f < warmup + frames; ++f) {
+		if (f == warmup) {
+			d = Drain();
+			start = clk::now();
+		}
+
+		uint64_t before = allocations.load(std::memory_order_relaxed);
+
+		for (unsigned i = 0; i < events; ++i)
+			push(ev, group, i);
+
+		ev.dbuf();
+		ev.batch().each(d);
+
+		if (f >= warmup)
+			allocs += allocations.load(std::memory_order_relaxed) - before;
+	}
+
+	double sec = std::chrono::duration<double>(clk::now() - start).count();
+	check("single", d, (uint64_t)frames * events);
+	report("single", frames, events, (uint64_t)frames * events, sec, allocs);
+}
+
+/** The network thread pushes as fast as it can, while the game thread swaps and drains until it has seen everything. */
+static void bench_threaded(unsigned frames, unsigned events) {
+	GameEvents ev;
+	Drain d;
+	uint64_t total = (uint64_t)frames * events;
+	std::atomic<bool> go(false);
+
+	std::thread producer([&ev, &go, total]() {
+		Handle group[group_size];
+
+		for (unsigned i = 0; i < group_size; ++i)
+			group[i] = Handle(i, 1);
+
+		while (!go.load(std::memory_order_acquire))
+			std::this_thread::yield();
+
+		for (uint64_t i = 0; i < total; ++i)
+			push(ev, group, i);
+	});
+
+	unsigned swaps = 0;
+	auto start = clk::now();
+	go.store(true, std::memory_order_release);
+
+	while (d.events < total) {
+		ev.dbuf();
+		ev.batch().each(d);
+		++swaps;
+	}
+
+	double sec = std::chrono::duration<double>(clk::now() - start).count();
+	producer.join();
+
+	check("threaded", d, total);
+	report("threaded", swaps, (unsigned)(total / swaps), total, sec, 0);
+}
+
+int main(int argc, char **argv) {
+	unsigned frames = argc > 1 ? (unsigned)strtoul(argv[1], NULL, 10) : 1000;
+	unsigned events = argc > 2 ? (unsigned)strtoul(argv[2], NULL, 10) : 1000;
+
+	bench_single(frames, events);
+	bench_threaded(frames, events);
+
+	return failed ? 1 : 0;
+}
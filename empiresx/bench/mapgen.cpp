@@ -0,0 +1,107 @@
+/* Copyright 2016-2020 the Age of Empires Free Software Remake authors. See LEGAL for legal info */
+
+/*
+Benchmark for the random map generator. Every map size in map_sizes is generated
+once on a single thread and once on all threads. Results are printed as one JSON
+object per line with the time and the number of objects that have been placed.
+
+The program fails if the results differ between both runs or if any two objects
+have been placed on the same tile.
+
+usage: bench_mapgen [size...]
+
+Sizes on the command line are generated with eight players in addition to map_sizes.
+*/
+
+#include <cstdio>
+#include <cstdlib>
+
+#include <chrono>
+#include <vector>
+
+#include "../base/mapgen.hpp"
+#include "../base/net.hpp"
+
+using namespace genie;
+using namespace genie::game;
+
+typedef std::chrono::steady_clock clk;
+
+static const uint32_t seed = 0x1234567;
+
+static bool failed = false;
+
+static double since(clk::time_point start) {
+	return std::chrono::duration<double, std::milli>(clk::now() - start).count();
+}
+
+static uint64_t checksum(const std::vector<MapObject> &objects) {
+	uint64_t h = 0;
+
+	for (const MapObject &o : objects)
+		h = h * UINT64_C(1000003) + ((uint64_t)o.x << 24 | (uint64_t)o.y << 8 | (unsigned)o.type << 4 | o.variant);
+
+	return h;
+}
+
+static bool overlaps(unsigned size, const std::vector<MapObject> &objects) {
+	std::vector<bool> used((size_t)size * size);
+
+	for (const MapObject &o : objects) {
+		size_t i = (size_t)o.y * size + o.x;
+
+		if (o.x >= size || o.y >= size || used[i])
+			return true;
+
+		used[i] = true;
+	}
+
+	return false;
+}
+
+static void bench(Scheduler &serial, unsigned size, unsigned players) {
+	MapGenerator gen(size, size, seed);
+	MapGenerator::Stats stats;
+
+	auto start = clk::now();
+	std::vector<MapObject> a(gen.generate(players, serial, &stats));
+	double ms_serial = since(start);
+
+	start = clk::now();
+	std::vector<MapObject> b(gen.generate(players, scheduler()));
+	double ms = since(start);
+
+	uint64_t sum = checksum(a);
+
+	if (sum != checksum(b)) {
+		fprintf(stderr, "%ux%u: results depend on number of threads\n", size, size);
+		failed = true;
+	}
+
+	if (overlaps(size, a)) {
+		fprintf(stderr, "%ux%u: objects overlap\n", size, size);
+		failed = true;
+	}
+
+	printf("{\"bench\": \"mapgen\", \"size\": %u, \"players\": %u, \"regions\": %zu, \"threads\": %u, \"ms\": %.3f, \"ms_serial\": %.3f, "
+		"\"trees\": %zu, \"trees_wanted\": %zu, \"bushes\": %zu, \"bushes_wanted\": %zu, "
+		"\"gold\": %zu, \"gold_wanted\": %zu, \"stone\": %zu, \"stone_wanted\": %zu, \"checksum\": \"%016llx\"}\n",
+		size, players, stats.regions, scheduler().size(), ms, ms_serial,
+		stats.placed[(unsigned)ResourceType::wood], stats.wanted[(unsigned)ResourceType::wood],
+		stats.placed[(unsigned)ResourceType::food], stats.wanted[(unsigned)ResourceType::food],
+		stats.placed[(unsigned)ResourceType::gold], stats.wanted[(unsigned)ResourceType::gold],
+		stats.placed[(unsigned)ResourceType::stone], stats.wanted[(unsigned)ResourceType::stone],
+		(unsigned long long)sum);
+}
+
+int main(int argc, char **argv) {
+	Scheduler serial(1);
+
+	for (unsigned players = 0; players < sizeof map_sizes / sizeof map_sizes[0]; ++players)
+		bench(serial, map_sizes[players], players);
+
+	for (int i = 1; i < argc; ++i)
+		bench(serial, (unsigned)strtoul(argv[i], NULL, 10), 8);
+
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,265 @@
+/* Copyright 2016-2020 the Age of Empires Free Software Remake authors. See LEGAL for legal info */
+
+/*
+Microbenchmarks for the fixed-point math and the random generator that the simulation
+uses, compared to the float versions from libm. Results are printed as one JSON object
+per line.
+
+Every fixed-point run also prints a checksum of its results. These must be the same
+on every compiler and platform, otherwise lockstep breaks. The program fails if
+they differ from the reference values below, which only apply to the default count.
+
+usage: bench_math [count]
+
+Configure with -DCMAKE_BUILD_TYPE=Release for meaningful timings.
+*/
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+#include <chrono>
+#include <vector>
+
+#include "../base/geom.hpp"
+#include "../base/random.hpp"
+
+using namespace genie;
+
+typedef std::chrono::steady_clock clk;
+
+static const uint64_t ref_trig = UINT64_C(0xfed618ed4649466c), ref_atan = UINT64_C(0x18c4e70af5934b2b), ref_move = UINT64_C(0x0a66f8193494e5ac);
+static const uint64_t ref_lcg = UINT64_C(0x8a8c914e61097fd1), ref_below = UINT64_C(0xc1d7d952a97011aa), ref_discard = UINT64_C(0xde49e9b071923b65);
+
+static const unsigned long default_count = 1000000;
+
+static bool check = true, failed = false;
+
+static double since(clk::time_point start) {
+	return std::chrono::duration<double, std::nano>(clk::now() - start).count();
+}
+
+/** Cheap enough to not dominate the timings, but any difference still changes the result. */
+static uint64_t mix(uint64_t h, uint64_t v) {
+	return (h ^ v) * UINT64_C(0x100000001b3);
+}
+
+static void report(const char *name, unsigned long count, double ns) {
+	printf("{\"bench\": \"%s\", \"count\": %lu, \"ns_per_op\": %.2f}\n", name, count, ns / count);
+}
+
+static void report(const char *name, unsigned long count, double ns, uint64_t hash, uint64_t ref) {
+	bool ok = hash == ref;
+	printf("{\"bench\": \"%s\", \"count\": %lu, \"ns_per_op\": %.2f, \"checksum\": \"%016llx\", \"exact\": %s}\n",
+		name, count, ns / count, (unsigned long long)hash, !check ? "null" : ok ? "true" : "false");
+
+	if (check && !ok)
+		failed = true;
+}
+
+/** Random but reproducible input, so the checksums do not depend on the platform. */
+static uint32_t next(uint32_t &seed) {
+	seed = seed * 1103515245u + 12345u;
+	return seed >> 8;
+}
+
+/** Random tile. The order in which function arguments are evaluated is unspecified, so do not inline this. */
+static Vector2<int> tile(uint32_t &seed) {
+	int x = next(seed) % 256;
+	int y = next(seed) % 256;
+	return Vector2<int>(x, y);
+}
+
+static void bench_trig(unsigned long n) {
+	uint64_t hash = UINT64_C(0xcbf29ce484222325);
+	auto start = clk::now();
+
+	for (unsigned long i = 0; i < n; ++i) {
+		uint16_t a = (uint16_t)(i * 40503u);
+		hash = mix(hash, (uint32_t)fsin(a).raw ^ ((uint64_t)(uint32_t)fcos(a).raw << 32));
+	}
+
+	report("sincos_fixed", n, since(start), hash, ref_trig);
+
+	float sum = 0;
+	start = clk::now();
+
+	for (unsigned long i = 0; i < n; ++i) {
+		float a = (float)(uint16_t)(i * 40503u) * (float)(2 * M_PI / angle_full);
+		sum += sinf(a) + cosf(a);
+	}
+
+	report("sincos_float", n, since(start));
+
+	if (sum == 12345.0f)
+		puts("");
+}
+
+static void bench_atan(unsigned long n) {
+	uint64_t hash = UINT64_C(0xcbf29ce484222325);
+	uint32_t seed = 1;
+	std::vector<int32_t> v(2 * n);
+
+	for (auto &x : v)
+		x = (int32_t)(next(seed) % 2000001) - 1000000;
+
+	auto start = clk::now();
+
+	for (unsigned long i = 0; i < n; ++i)
+		hash = mix(hash, fatan2(v[2 * i], v[2 * i + 1]));
+
+	report("atan2_fixed", n, since(start), hash, ref_atan);
+
+	float sum = 0;
+	start = clk::now();
+
+	for (unsigned long i = 0; i < n; ++i)
+		sum += atan2f((float)v[2 * i], (float)v[2 * i + 1]);
+
+	report("atan2_float", n, since(start));
+
+	if (sum == 12345.0f)
+		puts("");
+}
+
+/** Walk units to random tiles, just like World::tick does. */
+static void bench_move(unsigned long n) {
+	const unsigned units = 1024;
+	uint64_t hash = UINT64_C(0xcbf29ce484222325);
+	uint32_t seed = 2;
+
+	std::vector<Vector2x> pos(units), to(units);
+
+	for (unsigned i = 0; i < units; ++i) {
+		Vector2<int> p = tile(seed), t = tile(seed);
+		pos[i] = Vector2x(p.x, p.y);
+		to[i] = Vector2x(t.x, t.y);
+	}
+
+	auto start = clk::now();
+
+	for (unsigned long i = 0; i < n; ++i) {
+		unsigned u = i % units;
+		if (step_towards(pos[u], to[u], Fixed::from(0.4))) {
+			Vector2<int> t = tile(seed);
+			to[u] = Vector2x(t.x, t.y);
+		}
+	}
+
+	double ns = since(start);
+
+	for (auto &p : pos)
+		hash = mix(hash, (uint32_t)p.x.raw ^ ((uint64_t)(uint32_t)p.y.raw << 32));
+
+	report("move_fixed", n, ns, hash, ref_move);
+
+	std::vector<Vector2<float>> fpos(units), fto(units);
+	seed = 2;
+
+	for (unsigned i = 0; i < units; ++i) {
+		Vector2<int> p = tile(seed), t = tile(seed);
+		fpos[i] = Vector2<float>((float)p.x, (float)p.y);
+		fto[i] = Vector2<float>((float)t.x, (float)t.y);
+	}
+
+	start = clk::now();
+
+	for (unsigned long i = 0; i < n; ++i) {
+		unsigned u = i % units;
+		float dx = fto[u].x - fpos[u].x, dy = fto[u].y - fpos[u].y;
+
+		if (dx * dx + dy * dy <= 0.4f * 0.4f) {
+			fpos[u] = fto[u];
+			Vector2<int> t = tile(seed);
+			fto[u] = Vector2<float>((float)t.x, (float)t.y);
+		} else {
+			float angle = atan2f(dy, dx);
+			fpos[u].x += cosf(angle) * 0.4f;
+			fpos[u].y += sinf(angle) * 0.4f;
+		}
+	}
+
+	report("move_float", n, since(start));
+}
+
+static void bench_lcg(unsigned long n) {
+	uint64_t hash = UINT64_C(0xcbf29ce484222325);
+	LCG lcg(42);
+	auto start = clk::now();
+
+	for (unsigned long i = 0; i < n; ++i)
+		hash = mix(hash, lcg.next());
+
+	report("lcg_next", n, since(start), hash, ref_lcg);
+
+	// must yield exactly the same sequence as next()
+	uint64_t batch = UINT64_C(0xcbf29ce484222325);
+	std::vector<uint32_t> v(n);
+	lcg.seed(42);
+	start = clk::now();
+
+	lcg.fill(v.data(), v.size());
+
+	double ns = since(start);
+
+	for (uint32_t x : v)
+		batch = mix(batch, x);
+
+	report("lcg_fill", n, ns, batch, hash);
+
+	if (batch != hash)
+		failed = true;
+
+	hash = UINT64_C(0xcbf29ce484222325);
+	lcg.seed(42);
+	start = clk::now();
+
+	for (unsigned long i = 0; i < n; ++i)
+		hash = mix(hash, lcg.next(i % 1000));
+
+	report("lcg_range", n, since(start), hash, ref_below);
+
+	uint64_t sum = 0;
+	lcg.seed(42);
+	start = clk::now();
+
+	// how LCG::next(low, high) used to work, which is slightly biased
+	for (unsigned long i = 0; i < n; ++i)
+		sum += (uint64_t)round((i % 1000) * (lcg.next() / (double)LCG::max()));
+
+	report("lcg_range_double", n, since(start));
+
+	if (sum == 12345)
+		puts("");
+
+	// jumping ahead must be the same as stepping
+	LCG a(7), b(7);
+
+	for (unsigned i = 0; i < 12345; ++i)
+		a.next();
+
+	b.discard(12345);
+
+	if (a.next() != b.next())
+		failed = true;
+
+	hash = UINT64_C(0xcbf29ce484222325);
+	start = clk::now();
+
+	for (unsigned long i = 0; i < n; ++i)
+		hash = mix(hash, lcg.substream(i, UINT64_C(1) << 20).next());
+
+	report("lcg_substream", n, since(start), hash, ref_discard);
+}
+
+int main(int argc, char **argv) {
+	unsigned long n = argc > 1 ? strtoul(argv[1], NULL, 10) : default_count;
+	check = n == default_count;
+
+	bench_trig(n);
+	bench_atan(n);
+	bench_move(n);
+	bench_lcg(n);
+
+	return failed ? 1 : 0;
+}
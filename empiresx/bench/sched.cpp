@@ -0,0 +1,128 @@
+/* Copyright 2016-2020 the Age of Empires Free Software Remake authors. See LEGAL for legal info */
+
+/*
+Microbenchmarks for the task scheduler: the overhead of spawning, stealing and
+splitting loops. Results are printed as one JSON object per line.
+
+usage: bench_sched [threads [tasks]]
+*/
+
+#include <cstdio>
+#include <cstdlib>
+
+#include <atomic>
+#include <chrono>
+#include <vector>
+
+#include "../base/job.hpp"
+
+using namespace genie;
+
+typedef std::chrono::steady_clock clk;
+
+class StealCounter final : public TaskTracer {
+public:
+	std::atomic<unsigned long> steals;
+
+	StealCounter() : steals(0) {}
+
+	void begin(unsigned, const char*) override {}
+	void end(unsigned, const char*) override {}
+	void steal(unsigned, unsigned) override { steals.fetch_add(1, std::memory_order_relaxed); }
+};
+
+static double since(clk::time_point start) {
+	return std::chrono::duration<double, std::nano>(clk::now() - start).count();
+}
+
+static void report(const char *name, const Scheduler &s, unsigned long count, double ns, unsigned long steals) {
+	printf("{\"bench\": \"%s\", \"threads\": %u, \"count\": %lu, \"ns_per_op\": %.1f, \"steals\": %lu}\n",
+		name, s.size(), count, ns / count, steals);
+}
+
+/** Spawn empty tasks from a thread outside the scheduler. */
+static void bench_external(Scheduler &s, StealCounter &c, unsigned long n) {
+	TaskGroup g;
+	c.steals.store(0);
+
+	auto start = clk::now();
+	for (unsigned long i = 0; i < n; ++i)
+		s.spawn(g, []{});
+	s.wait(g);
+
+	report("spawn_external", s, n, since(start), c.steals.load());
+}
+
+/** Spawn empty tasks from a worker, so other workers have to steal them. */
+static void bench_nested(Scheduler &s, StealCounter &c, unsigned long n) {
+	TaskGroup outer;
+	c.steals.store(0);
+
+	auto start = clk::now();
+	s.spawn(outer, [&]{
+		TaskGroup g;
+		for (unsigned long i = 0; i < n; ++i)
+			s.spawn(g, []{});
+		s.wait(g);
+	});
+	s.wait(outer);
+
+	report("spawn_nested", s, n, since(start), c.steals.load());
+}
+
+/** Binary fork-join tree, which is the worst case for the scheduler. */
+static void fork(Scheduler &s, unsigned depth) {
+	if (!depth)
+		return;
+
+	TaskGroup g;
+	s.spawn(g, [&s, depth]{ fork(s, depth - 1); });
+	fork(s, depth - 1);
+	s.wait(g);
+}
+
+static void bench_fork(Scheduler &s, StealCounter &c, unsigned depth) {
+	c.steals.store(0);
+
+	auto start = clk::now();
+	fork(s, depth);
+
+	report("fork_join", s, (1ul << depth) - 1, since(start), c.steals.load());
+}
+
+static void bench_parallel_for(Scheduler &s, StealCounter &c, size_t grain) {
+	std::vector<unsigned> v(1u << 22, 1);
+	std::atomic<unsigned long> sum(0);
+	c.steals.store(0);
+
+	auto start = clk::now();
+	s.parallel_for(v.size(), grain, [&](size_t begin, size_t end) {
+		unsigned long part = 0;
+		for (size_t i = begin; i < end; ++i)
+			part += v[i];
+		sum.fetch_add(part);
+	});
+	double ns = since(start);
+
+	if (sum.load() != v.size())
+		fprintf(stderr, "parallel_for: bad sum %lu\n", sum.load());
+
+	report(grain < 4096 ? "parallel_for_small" : "parallel_for_large", s, v.size(), ns, c.steals.load());
+}
+
+int main(int argc, char **argv) {
+	unsigned threads = argc > 1 ? (unsigned)atoi(argv[1]) : 0;
+	unsigned long n = argc > 2 ? strtoul(argv[2], NULL, 10) : 100000;
+
+	Scheduler s(threads);
+	StealCounter c;
+	s.trace(&c);
+
+	bench_external(s, c, n);
+	bench_nested(s, c, n);
+	bench_fork(s, c, 16);
+	bench_parallel_for(s, c, 1024);
+	bench_parallel_for(s, c, 65536);
+
+	return 0;
+}
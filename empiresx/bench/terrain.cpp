@@ -0,0 +1,157 @@
+/* Copyright 2016-2020 the Age of Empires Free Software Remake authors. See LEGAL for legal info */
+
+/*
+Benchmark for the terrain cache that MenuGame::paint_tiles uses. For every map size, a
+view is scrolled across the map while a scout explores the map along the way. Each
+frame the terrain is painted through TerrainCache with textures that just remember
+which tiles have been drawn into them.
+
+Results are printed as one JSON object per line with the number of tiles that would
+have been drawn without the cache, the number of textures that are drawn instead, how
+many textures had to be (re)built and how many tiles have been drawn into them, and the
+most memory the textures have used. Every frame the tiles that end up on screen are
+compared with the explored tiles that visible_tiles finds, so stale or missing blocks
+make the program fail.
+
+usage: bench_terrain [frames [width height [budget_mb]]]
+
+Configure with -DCMAKE_BUILD_TYPE=Release for meaningful timings.
+*/
+
+#include <cstdio>
+#include <cstdlib>
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "../base/game.hpp"
+#include "../base/terrain.hpp"
+
+namespace genie {
+
+// dummy callbacks, see server/server.cpp
+void check_taunt(const std::string&) {}
+void menu_lobby_stop_game(MenuLobby*) {}
+
+namespace game {
+
+void Particle::draw(int, int, unsigned) const {}
+void Building::draw(int, int) const {}
+
+void img_dim(Box2<float> &dim, int&, int&, unsigned, unsigned) {
+	dim.w = dim.h = 10;
+}
+
+}
+
+}
+
+using namespace genie;
+using namespace genie::game;
+
+typedef std::chrono::steady_clock clk;
+
+static bool failed = false;
+
+/** Stand-in for Texture. */
+struct Canvas final {
+	struct Tile final {
+		unsigned tx, ty;
+		uint8_t type;
+		int x, y;
+	};
+
+	std::vector<Tile> tiles;
+};
+
+typedef TerrainCache<Canvas> Cache;
+
+/** Order independent, so both methods can visit tiles in any order. */
+static uint64_t mix(unsigned tx, unsigned ty, uint8_t type) {
+	uint64_t v = ((uint64_t)tx << 40 | (uint64_t)ty << 8 | type) * UINT64_C(0x9e3779b97f4a7c15);
+	return v ^ (v >> 29);
+}
+
+static void bench(unsigned size, unsigned frames, int vw, int vh, size_t budget) {
+	LCG lcg(0x1234567);
+	StartMatch sm{};
+	sm.map_w = sm.map_h = (uint16_t)size;
+	sm.seed = 0x1234567;
+
+	Map map(lcg, sm);
+	FogOfWar fog(size, size);
+	Cache cache(map, budget);
+
+	uint64_t tiles = 0, blits = 0, drawn = 0;
+	size_t peak = 0;
+	double ns = 0;
+
+	for (unsigned f = 0; f < frames; ++f) {
+		// scroll from the left corner of the map to the right corner and back
+		int map_x, map_y, span = (int)size * tw;
+		tile_to_scr(map_x, map_y, (int)size / 2, (int)size / 2);
+		int pos = (int)(f * 97 % (unsigned)(2 * span));
+		int left = -(pos < span ? pos : 2 * span - pos) + vw / 2;
+		int top = -map_y + vh / 2 + (int)(f % 64) * 8 - 256;
+
+		// the scout walks along the middle of the view
+		int sx = (vw / 2 - left) / tw, sy = (vh / 2 - top) / th;
+		fog.see(Handle(0, 1), 0, sx + sy, sx - sy, 8);
+
+		uint64_t h0 = 0, h1 = 0;
+
+		visible_tiles((int)size, (int)size, -left - tw, -top - th, vw - left - 1, vh - top - 1, [&](int tx, int ty, int, int) {
+			if (fog.explored(0, tx, ty)) {
+				h0 += mix((unsigned)tx, (unsigned)ty, map.tile((unsigned)tx, (unsigned)ty));
+				++tiles;
+			}
+		});
+
+		auto start = clk::now();
+
+		cache.paint(map, fog, 0, left, top, 0, 0, vw, vh, [&](std::unique_ptr<Canvas> &c, unsigned bx, unsigned by) {
+			if (!c)
+				c.reset(new Canvas());
+
+			c->tiles.clear();
+
+			Cache::tiles(map, bx, by, [&](unsigned tx, unsigned ty, int x, int y) {
+				if (fog.explored(0, (int)tx, (int)ty)) {
+					c->tiles.push_back(Canvas::Tile{tx, ty, map.tile(tx, ty), x, y});
+					++drawn;
+				}
+			});
+		}, [&](Canvas &c, int x, int y) {
+			++blits;
+
+			for (const Canvas::Tile &t : c.tiles)
+				if (x + t.x >= -tw && x + t.x < vw && y + t.y >= -th && y + t.y < vh)
+					h1 += mix(t.tx, t.ty, t.type);
+		});
+
+		ns += std::chrono::duration<double, std::nano>(clk::now() - start).count();
+		peak = std::max(peak, cache.memory());
+
+		if (h0 != h1)
+			failed = true;
+	}
+
+	printf("{\"bench\": \"terrain\", \"size\": %u, \"view\": \"%dx%d\", \"frames\": %u, \"tiles_per_frame\": %.1f, \"blits_per_frame\": %.1f, "
+		"\"builds\": %zu, \"built_tiles_per_frame\": %.1f, \"drops\": %zu, \"peak_mb\": %.1f, \"us_per_frame\": %.3f, \"exact\": %s}\n",
+		size, vw, vh, frames, (double)tiles / frames, (double)blits / frames,
+		cache.builds(), (double)drawn / frames, cache.drops(), peak / 1048576.0, ns / 1e3 / frames, failed ? "false" : "true");
+	fflush(stdout);
+}
+
+int main(int argc, char **argv) {
+	unsigned frames = argc > 1 ? (unsigned)strtoul(argv[1], NULL, 10) : 1000;
+	int vw = argc > 3 ? atoi(argv[2]) : 1024, vh = argc > 3 ? atoi(argv[3]) : 768;
+	size_t budget = argc > 4 ? (size_t)strtoul(argv[4], NULL, 10) << 20 : Cache::default_budget;
+
+	for (unsigned size : {64, 168, 256, 512, 1024})
+		bench(size, frames, vw, vh, budget);
+
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,94 @@
+/* Copyright 2016-2020 the Age of Empires Free Software Remake authors. See LEGAL for legal info */
+
+/*
+Benchmark for finding the tiles that MenuGame::paint_tiles draws. For every map size, a
+view is scrolled across the map and each frame the visible tiles are collected twice:
+once by testing every tile on the map like paint_tiles used to do and once with
+visible_tiles. Results are printed as one JSON object per line.
+
+The time per frame of visible_tiles should only depend on the size of the view, not on
+the size of the map. Both must find the same tiles, otherwise the program fails.
+
+usage: bench_tiles [frames [width height]]
+
+Configure with -DCMAKE_BUILD_TYPE=Release for meaningful timings.
+*/
+
+#include <cstdio>
+#include <cstdlib>
+
+#include <chrono>
+
+#include "../base/math.hpp"
+
+using namespace genie;
+
+typedef std::chrono::steady_clock clk;
+
+static bool failed = false;
+
+/** Order independent, so both methods can visit tiles in any order. */
+static uint64_t mix(int tx, int ty) {
+	uint64_t v = ((uint64_t)(uint32_t)tx << 32 | (uint32_t)ty) * UINT64_C(0x9e3779b97f4a7c15);
+	return v ^ (v >> 29);
+}
+
+static void bench(int size, unsigned frames, int vw, int vh) {
+	double ns_all = 0, ns_visible = 0;
+	uint64_t tiles = 0;
+
+	for (unsigned f = 0; f < frames; ++f) {
+		// scroll from the left corner of the map to the right corner and back
+		int map_x, map_y, span = size * tw;
+		tile_to_scr(map_x, map_y, size / 2, size / 2);
+		int pos = (int)(f * 97 % (unsigned)(2 * span));
+		int left = -(pos < span ? pos : 2 * span - pos) + vw / 2;
+		int top = -map_y + vh / 2 + (int)(f % 64) * 8 - 256;
+
+		uint64_t h0 = 0, h1 = 0;
+		unsigned n0 = 0, n1 = 0;
+
+		auto start = clk::now();
+
+		for (int ty = 0; ty < size; ++ty)
+			for (int tx = 0; tx < size; ++tx) {
+				int x, y;
+				tile_to_scr(x, y, tx, ty);
+
+				if (left + x + tw >= 0 && left + x < vw && top + y + th >= 0 && top + y < vh) {
+					h0 += mix(tx, ty);
+					++n0;
+				}
+			}
+
+		auto mid = clk::now();
+
+		visible_tiles(size, size, -left - tw, -top - th, vw - left - 1, vh - top - 1, [&](int tx, int ty, int, int) {
+			h1 += mix(tx, ty);
+			++n1;
+		});
+
+		auto end = clk::now();
+
+		ns_all += std::chrono::duration<double, std::nano>(mid - start).count();
+		ns_visible += std::chrono::duration<double, std::nano>(end - mid).count();
+		tiles += n1;
+
+		if (h0 != h1 || n0 != n1)
+			failed = true;
+	}
+
+	printf("{\"bench\": \"tiles\", \"size\": %d, \"view\": \"%dx%d\", \"frames\": %u, \"tiles_per_frame\": %.1f, \"us_all\": %.3f, \"us_visible\": %.3f, \"exact\": %s}\n",
+		size, vw, vh, frames, (double)tiles / frames, ns_all / 1e3 / frames, ns_visible / 1e3 / frames, failed ? "false" : "true");
+	fflush(stdout);
+}
+
+int main(int argc, char **argv) {
+	unsigned frames = argc > 1 ? (unsigned)strtoul(argv[1], NULL, 10) : 200;
+	int vw = argc > 3 ? atoi(argv[2]) : 1024, vh = argc > 3 ? atoi(argv[3]) : 768;
+
+	for (int size : {64, 168, 256, 512, 1024})
+		bench(size, frames, vw, vh);
+
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,351 @@
+/* Copyright 2016-2020 the Age of Empires Free Software Remake authors. See LEGAL for legal info */
+
+/*
+Headless benchmark for the simulation. For every configuration a random map is
+populated with two players and the requested number of units, which are then
+ordered around by a fixed script: every second one small group walks along
+paths and one large group follows a shared flow field.
+
+Results are printed as one JSON object per line with the ticks per second, the
+time spent in each phase of World::tick, the average number of allocations per
+tick that do not come from the match arena, the largest amount of memory the arena
+has handed out and the peak resident set size of the process so far. The world also logs
+what it creates, so skip any lines that do not start with '{'.
+
+The checksum covers the position of every unit at the end, so it must be the same
+for every thread count.
+
+With --ai, that many computer players are added, which take part in the game like
+they would in a real one. Units are spread over all of them. ai_us is the time per
+tick that the game thread spends on publishing views and applying orders. Since
+computers react whenever their thread gets to it, the checksum is only repeatable
+without computers.
+
+With --roundtrip, every configuration is played for ticks, saved and loaded into a
+fresh Game, which is saved again. Both snapshots must be byte for byte the same.
+Then both games get the same orders for another ticks and must end up with the same
+checksum, otherwise the program fails.
+
+usage: bench_world [--ai count | --roundtrip] [ticks [size units]...]
+
+Without sizes, a couple of configurations from small to large are run.
+Configure with -DCMAKE_BUILD_TYPE=Release for meaningful timings.
+*/
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <new>
+#include <string>
+#include <vector>
+
+#if _WIN32
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#else
+#include <sys/resource.h>
+#endif
+
+#include "../base/game.hpp"
+
+namespace genie {
+
+// dummy callbacks, see server/server.cpp
+void check_taunt(const std::string&) {}
+void menu_lobby_stop_game(MenuLobby*) {}
+
+namespace game {
+
+void Particle::draw(int, int, unsigned) const {}
+void Building::draw(int, int) const {}
+
+void img_dim(Box2<float> &dim, int&, int&, unsigned, unsigned) {
+	dim.w = dim.h = 10;
+}
+
+}
+
+}
+
+using namespace genie;
+using namespace genie::game;
+
+typedef std::chrono::steady_clock clk;
+
+static std::atomic<uint64_t> allocations(0);
+
+void *operator new(size_t size) {
+	allocations.fetch_add(1, std::memory_order_relaxed);
+
+	if (void *p = malloc(size ? size : 1))
+		return p;
+
+	throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept {
+	free(p);
+}
+
+void operator delete(void *p, size_t) noexcept {
+	free(p);
+}
+
+static const uint32_t seed = 0x1234567;
+
+static bool failed = false;
+
+/** Ticks between scripted orders. */
+static constexpr unsigned order_ticks = World::ticks_per_second;
+/** Units in the groups that are ordered around. The large one gets a flow field. */
+static constexpr unsigned small_group = 8, large_group = 64;
+
+static const char *const phase_names[] = {
+	"timers",
+	"sense",
+	"decide",
+	"move",
+	"resolve",
+	"fog",
+	"orders",
+};
+
+static_assert(sizeof phase_names / sizeof phase_names[0] == (unsigned)TickPhase::count, "phase names out of sync");
+
+/** Peak resident set size of this process in KiB. */
+static unsigned long peak_rss() {
+#if _WIN32
+	PROCESS_MEMORY_COUNTERS pmc;
+	return GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof pmc) ? (unsigned long)(pmc.PeakWorkingSetSize / 1024) : 0;
+#else
+	struct rusage ru;
+	if (getrusage(RUSAGE_SELF, &ru))
+		return 0;
+#if __APPLE__
+	return (unsigned long)ru.ru_maxrss / 1024;
+#else
+	return (unsigned long)ru.ru_maxrss;
+#endif
+#endif
+}
+
+/** Random passable tile. */
+static Vector2<int> pick(const World &world, LCG &rng) {
+	for (;;) {
+		int x = (int)rng.below(world.map.w);
+		int y = (int)rng.below(world.map.h);
+
+		if (world.map.passable(x, y))
+			return Vector2<int>(x, y);
+	}
+}
+
+/** Order \a n units starting at a random one in \a all to a random tile. */
+static void order(World &world, LCG &rng, const std::vector<Handle> &all, unsigned n) {
+	std::vector<Handle> group;
+	size_t start = (size_t)rng.below(all.size());
+
+	for (unsigned i = 0; i < n && i < all.size(); ++i)
+		group.push_back(all[(start + i) % all.size()]);
+
+	Vector2<int> to(pick(world, rng));
+	world.move(group, Vector2x(to.x, to.y));
+}
+
+/** Hash of the position of all units in \a all. */
+static uint64_t checksum(World &world, const std::vector<Handle> &all) {
+	uint64_t sum = 0;
+
+	for (Handle h : all) {
+		const Particle *p = world.get(h);
+		sum = sum * UINT64_C(1000003) + ((uint64_t)(uint32_t)p->pos.left.raw << 32 | (uint32_t)p->pos.top.raw);
+	}
+
+	return sum;
+}
+
+/** Spawn \a count units spread over \a players on random tiles. */
+static std::vector<Handle> spawn(World &world, LCG &rng, unsigned count, unsigned players) {
+	std::vector<Handle> all;
+	all.reserve(count);
+
+	for (unsigned i = 0; i < count; ++i) {
+		Vector2<int> at(pick(world, rng));
+		all.push_back(world.spawn(Box2x(at.x, at.y), i % 3 ? UnitType::clubman : UnitType::villager, i % players).gethandle());
+	}
+
+	return all;
+}
+
+/** Run \a ticks scripted ticks, starting at tick \a t0. */
+static void play(World &world, LCG &rng, const std::vector<Handle> &all, unsigned t0, unsigned ticks) {
+	for (unsigned t = t0; t < t0 + ticks; ++t) {
+		if (t % order_ticks == 0) {
+			order(world, rng, all, small_group);
+			order(world, rng, all, large_group);
+		}
+
+		world.tick();
+	}
+}
+
+static void roundtrip(unsigned size, unsigned count, unsigned ticks) {
+	LCG rng(seed);
+	StartMatch sm{};
+	sm.map_w = sm.map_h = (uint16_t)size;
+	sm.seed = seed;
+
+	Game a(GameMode::single_player, nullptr, nullptr, sm);
+	a.world.populate(2);
+
+	std::vector<Handle> all(spawn(a.world, rng, count, 2));
+	play(a.world, rng, all, 0, ticks);
+
+	auto start = clk::now();
+	const SaveWriter &sa = a.snapshot();
+	std::vector<uint8_t> saved(sa.data(), sa.data() + sa.size());
+	double ms_save = std::chrono::duration<double, std::milli>(clk::now() - start).count();
+
+	Game b(GameMode::single_player, nullptr, nullptr, sm);
+	start = clk::now();
+	b.load(SaveFile(saved.data(), saved.size()));
+	double ms_load = std::chrono::duration<double, std::milli>(clk::now() - start).count();
+
+	const SaveWriter &sb = b.snapshot();
+	bool same = sb.size() == saved.size() && !memcmp(sb.data(), saved.data(), saved.size());
+
+	// both games get the same orders
+	LCG rng_b(rng);
+	play(a.world, rng, all, ticks, ticks);
+	play(b.world, rng_b, all, ticks, ticks);
+
+	uint64_t sum_a = checksum(a.world, all), sum_b = checksum(b.world, all);
+
+	if (!same || sum_a != sum_b)
+		failed = true;
+
+	printf("{\"bench\": \"roundtrip\", \"size\": %u, \"units\": %u, \"ticks\": %u, \"bytes\": %zu, \"ms_save\": %.3f, \"ms_load\": %.3f, "
+		"\"snapshots_equal\": %s, \"checksum\": \"%016llx\", \"checksum_loaded\": \"%016llx\"}\n",
+		size, count, ticks, saved.size(), ms_save, ms_load,
+		same ? "true" : "false", (unsigned long long)sum_a, (unsigned long long)sum_b);
+	fflush(stdout);
+}
+
+static void bench(unsigned size, unsigned count, unsigned ticks, unsigned ais) {
+	LCG lcg(seed), rng(seed);
+	StartMatch sm{};
+	sm.map_w = sm.map_h = (uint16_t)size;
+	sm.seed = seed;
+
+	auto start = clk::now();
+
+	Arena arena;
+	World world(lcg, sm, true, arena);
+	GameEvents events;
+	AiPool computers(events);
+	unsigned players = std::max(2u, ais);
+
+	world.populate(players);
+
+	for (unsigned i = 0; i < ais; ++i)
+		computers.add(i);
+
+	std::vector<Handle> all(spawn(world, rng, count, players));
+
+	double ms_setup = std::chrono::duration<double, std::milli>(clk::now() - start).count();
+
+	TickProfile profile{};
+	uint64_t awake = 0, allocs = 0;
+	clk::duration ai_time(0);
+
+	world.trace(&profile);
+	start = clk::now();
+
+	for (unsigned t = 0; t < ticks; ++t) {
+		if (t % order_ticks == 0) {
+			order(world, rng, all, small_group);
+			order(world, rng, all, large_group);
+		}
+
+		uint64_t before = allocations.load(std::memory_order_relaxed);
+
+		if (ais) {
+			auto ai_start = clk::now();
+			events.idle(world);
+			ai_time += clk::now() - ai_start;
+		}
+
+		world.tick();
+
+		if (ais) {
+			auto ai_start = clk::now();
+			computers.publish(world);
+			ai_time += clk::now() - ai_start;
+		}
+
+		allocs += allocations.load(std::memory_order_relaxed) - before;
+		awake += world.awake();
+	}
+
+	double sec = std::chrono::duration<double>(clk::now() - start).count();
+	world.trace(nullptr);
+
+	uint64_t sum = checksum(world, all);
+
+	printf("{\"bench\": \"world\", \"size\": %u, \"units\": %u, \"ticks\": %u, \"threads\": %u, \"ms_setup\": %.3f, "
+		"\"ticks_per_sec\": %.1f, \"us_per_tick\": %.3f, \"awake_per_tick\": %.1f, \"allocs_per_tick\": %.2f, \"phases_us\": {",
+		size, count, ticks, scheduler().size(), ms_setup,
+		ticks / sec, sec * 1e6 / ticks, (double)awake / ticks, (double)allocs / ticks);
+
+	for (unsigned i = 0; i < (unsigned)TickPhase::count; ++i)
+		printf("%s\"%s\": %.3f", i ? ", " : "", phase_names[i], profile.ns[i] / 1e3 / ticks);
+
+	AiStats ai = computers.stats();
+
+	printf("}, \"ais\": %u, \"ai_us\": %.3f, \"ai_views\": %llu, \"ai_skipped\": %llu, \"ai_plans\": %llu, \"ai_overruns\": %llu, \"ai_orders\": %llu",
+		ais, std::chrono::duration<double, std::micro>(ai_time).count() / ticks,
+		(unsigned long long)ai.views, (unsigned long long)ai.skipped, (unsigned long long)ai.plans, (unsigned long long)ai.overruns, (unsigned long long)ai.orders);
+	printf(", \"arena_kb\": %zu, \"peak_rss_kb\": %lu, \"checksum\": \"%016llx\"}\n", arena.max_size() / 1024, peak_rss(), (unsigned long long)sum);
+	fflush(stdout);
+}
+
+int main(int argc, char **argv) {
+	unsigned ais = 0;
+	bool check = false;
+
+	if (argc > 2 && !strcmp(argv[1], "--ai")) {
+		ais = (unsigned)strtoul(argv[2], NULL, 10);
+		argc -= 2;
+		argv += 2;
+	} else if (argc > 1 && !strcmp(argv[1], "--roundtrip")) {
+		check = true;
+		--argc;
+		++argv;
+	}
+
+	unsigned ticks = argc > 1 ? (unsigned)strtoul(argv[1], NULL, 10) : 1000;
+
+	auto run = [&](unsigned size, unsigned count) {
+		if (check)
+			roundtrip(size, count, ticks);
+		else
+			bench(size, count, ticks, ais);
+	};
+
+	if (argc > 3) {
+		for (int i = 2; i + 1 < argc; i += 2)
+			run((unsigned)strtoul(argv[i], NULL, 10), (unsigned)strtoul(argv[i + 1], NULL, 10));
+	} else {
+		run(64, 100);
+		run(128, 1000);
+		run(256, 5000);
+		run(512, 20000);
+	}
+
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,84 @@
+# Turn doc/reverse_engineering/unit_stats_aoe.csv into rows for base/stats.hpp.
+# usage: cmake -DCSV=unit_stats_aoe.csv -DOUT=unit_stats.inc -P stats.cmake
+#
+# Every row becomes one STATS_UNIT(name, age, hp, attack, attack type, reload in ms,
+# melee armor, pierce armor, los, range, accuracy, speed, train time in seconds,
+# food, wood, stone, gold). The remarks in the last column are dropped.
+
+cmake_minimum_required(VERSION 3.7)
+
+if(NOT CSV OR NOT OUT)
+	message(FATAL_ERROR "usage: cmake -DCSV=<csv> -DOUT=<inc> -P stats.cmake")
+endif()
+
+file(READ ${CSV} csv)
+# remarks may contain semicolons, which would split the lines below
+string(REPLACE ";" "," csv "${csv}")
+string(REPLACE "\r" "" csv "${csv}")
+string(REPLACE "\n" ";" lines "${csv}")
+list(REMOVE_AT lines 0)
+
+set(rows "/* Generated from unit_stats_aoe.csv by cmake/stats.cmake. Do not edit. */\n")
+
+foreach(line IN LISTS lines)
+	if(line STREQUAL "")
+		continue()
+	endif()
+
+	set(rest "${line},")
+
+	foreach(i RANGE 16)
+		if(NOT rest MATCHES "^([^,]*),(.*)$")
+			message(FATAL_ERROR "${CSV}: missing columns: ${line}")
+		endif()
+
+		string(STRIP "${CMAKE_MATCH_1}" f${i})
+		set(rest "${CMAKE_MATCH_2}")
+	endforeach()
+
+	foreach(i 2 3 6 7 8 9 10 12 13 14 15 16)
+		if(NOT f${i} MATCHES "^[0-9]+$")
+			message(FATAL_ERROR "${CSV}: ${f0}: column ${i} is not a number: ${f${i}}")
+		endif()
+	endforeach()
+
+	if(f1 STREQUAL "I")
+		set(age 1)
+	elseif(f1 STREQUAL "II")
+		set(age 2)
+	elseif(f1 STREQUAL "III")
+		set(age 3)
+	elseif(f1 STREQUAL "IV")
+		set(age 4)
+	else()
+		message(FATAL_ERROR "${CSV}: ${f0}: bad age: ${f1}")
+	endif()
+
+	# reload time in seconds to milliseconds, e.g. 1.5 to 1500
+	if(NOT f5 MATCHES "^([0-9]+)(\\.([0-9]*))?$")
+		message(FATAL_ERROR "${CSV}: ${f0}: bad reload time: ${f5}")
+	endif()
+
+	set(whole ${CMAKE_MATCH_1})
+	string(SUBSTRING "${CMAKE_MATCH_3}000" 0 3 frac)
+	math(EXPR reload "${whole} * 1000 + 1${frac} - 1000")
+
+	if(NOT f4 MATCHES "^[MP]?$" OR NOT f11 MATCHES "^[SMF]$")
+		message(FATAL_ERROR "${CSV}: ${f0}: bad attack type or speed: ${f4} ${f11}")
+	endif()
+
+	if(f4 STREQUAL "")
+		set(f4 " ")
+	endif()
+
+	string(APPEND rows "STATS_UNIT(\"${f0}\", ${age}, ${f2}, ${f3}, '${f4}', ${reload}, ${f6}, ${f7}, ${f8}, ${f9}, ${f10}, '${f11}', ${f12}, ${f13}, ${f14}, ${f15}, ${f16})\n")
+endforeach()
+
+# only touch the output if it changes, so nothing is rebuilt for nothing
+if(EXISTS ${OUT})
+	file(READ ${OUT} old)
+endif()
+
+if(NOT old STREQUAL rows)
+	file(WRITE ${OUT} "${rows}")
+endif()
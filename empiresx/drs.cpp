@@ -8,10 +8,14 @@
 #include <cstdint>
 #include <cstring>
 
+#include <algorithm>
 #include <stdexcept>
+#include <vector>
 
 #include <SDL2/SDL_surface.h>
 
+#include "base/job.hpp"
+
 namespace genie {
 
 /** Array of resource items. */
@@ -341,10 +345,15 @@ bool slp_read(SDL_Surface *surface, const Palette &p, const Slp &slp, unsigned i
 	return dynamic;
 }
 
-Image::Image() : surface((SDL_Surface*)NULL), texture(0, 0, NULL), hotspot_x(0), hotspot_y(0) {}
+Image::Image() : surface((SDL_Surface*)NULL), texture(0, 0, NULL), hotspot_x(0), hotspot_y(0), page(NULL), page_x(0), page_y(0) {}
 
 bool Image::load(SimpleRender &r, const Palette &pal, const Slp &slp, unsigned index, unsigned player) {
-	bool dynamic = false;
+	bool dynamic = decode(pal, slp, index, player);
+	upload(r);
+	return dynamic;
+}
+
+bool Image::decode(const Palette &pal, const Slp &slp, unsigned index, unsigned player) {
 	const io::SlpFrameInfo *info = &slp.info[index];
 
 	hotspot_x = info->hotspot_x;
@@ -354,16 +363,42 @@ bool Image::load(SimpleRender &r, const Palette &pal, const Slp &slp, unsigned i
 	if (!surface.data())
 		throw std::runtime_error(std::string("Could not create Slp surface: ") + SDL_GetError());
 
-	dynamic = slp_read(surface.data(), pal, slp, index, player);
-	texture.reset(r, surface.data());
+	return slp_read(surface.data(), pal, slp, index, player);
+}
 
-	return dynamic;
+void Image::upload(SimpleRender &r) {
+	texture.reset(r, surface.data());
 }
 
 void Image::draw(SimpleRender &r, int x, int y, int w, int h, int sx, int sy, bool hflip) {
-	if (!w) w = surface.data()->w;
-	if (!h) h = surface.data()->h;
-	texture.paint(r, x, y, w, h, sx, sy, hflip);
+	if (!w) w = texture.width;
+	if (!h) h = texture.height;
+
+	if (!page) {
+		// whatever has been batched so far is below this image
+		r.sprites.flush(r);
+		texture.paint(r, x, y, w, h, sx, sy, hflip);
+		return;
+	}
+
+	// same as Texture::paint, but the source must not leave this image on its page
+	SDL_Rect src, dest;
+
+	for (src.y = sy, dest.y = y; dest.y < y + h; src.y = 0, dest.y += dest.h) {
+		src.h = dest.h = std::min(texture.height - src.y, y + h - dest.y);
+
+		if (src.h <= 0)
+			return;
+
+		for (src.x = sx, dest.x = x; dest.x < x + w; src.x = 0, dest.x += dest.w) {
+			src.w = dest.w = std::min(texture.width - src.x, x + w - dest.x);
+
+			if (src.w <= 0)
+				break;
+
+			r.sprites.copy(r, *page, SDL_Rect{page_x + src.x, page_y + src.y, src.w, src.h}, dest, hflip);
+		}
+	}
 }
 
 void Image::draw(SimpleRender &r, const SDL_Rect &bnds) {
@@ -371,36 +406,140 @@ void Image::draw(SimpleRender &r, const SDL_Rect &bnds) {
 }
 
 void Image::draw_stretch(SimpleRender &r, const SDL_Rect &to) {
-	texture.paint_stretch(r, to);
+	if (!page) {
+		r.sprites.flush(r);
+		texture.paint_stretch(r, to);
+		return;
+	}
+
+	draw_stretch(r, SDL_Rect{0, 0, texture.width, texture.height}, to);
 }
 
 void Image::draw_stretch(SimpleRender &r, const SDL_Rect &from, const SDL_Rect &to) {
-	texture.paint_stretch(r, from, to);
+	if (!page) {
+		r.sprites.flush(r);
+		texture.paint_stretch(r, from, to);
+		return;
+	}
+
+	// same as Texture::paint_stretch
+	SDL_Rect dst(to);
+	dst.x = r.offset.x;
+	dst.y = r.offset.y;
+	r.sprites.copy(r, *page, SDL_Rect{page_x + from.x, page_y + from.y, from.w, from.h}, dst);
 }
 
-Animation::Animation(SimpleRender &r, const Palette &pal, const Slp &slp, res_id id) : slp(slp), images(), id(id), image_count(0), dynamic(false) {
+static int atlas_page_size(SimpleRender &r) {
+	SDL_RendererInfo info;
+	int size = Atlas::max_page_size;
+
+	// zero means there is no limit
+	if (!SDL_GetRendererInfo(r.canvas(), &info)) {
+		if (info.max_texture_width)
+			size = std::min(size, info.max_texture_width);
+		if (info.max_texture_height)
+			size = std::min(size, info.max_texture_height);
+	}
+
+	return size;
+}
+
+Atlas::Atlas(SimpleRender &r) : page_size(atlas_page_size(r)), layout(page_size, page_size), pages(), rects() {}
+
+void Atlas::clear() {
+	pages.clear();
+	layout.clear();
+}
+
+void Atlas::add(SimpleRender &r, Image *images, unsigned count) {
+	rects.clear();
+
+	for (unsigned i = 0; i < count; ++i)
+		rects.push_back(AtlasRect{images[i].surface.data()->w, images[i].surface.data()->h, AtlasRect::none, 0, 0});
+
+	layout.pack(rects.data(), rects.size());
+
+	while (pages.size() < layout.size()) {
+		pages.emplace_back(new Texture(r, page_size, page_size, SDL_TEXTUREACCESS_STATIC));
+
+		// the initial contents are undefined
+		std::vector<Uint32> blank((size_t)page_size * 64);
+
+		for (int y = 0; y < page_size; y += 64) {
+			SDL_Rect strip{0, y, page_size, std::min(64, page_size - y)};
+			SDL_UpdateTexture(pages.back()->data(), &strip, blank.data(), page_size * (int)sizeof(Uint32));
+		}
+	}
+
+	for (unsigned i = 0; i < count; ++i) {
+		Image &img = images[i];
+		const AtlasRect &rect = rects[i];
+
+		if (rect.page == AtlasRect::none) {
+			img.upload(r);
+			continue;
+		}
+
+		// blit onto a transparent surface in the format of the page, which turns the color key into alpha
+		Surface rgba(SDL_CreateRGBSurfaceWithFormat(0, rect.w, rect.h, 32, SDL_PIXELFORMAT_RGBA8888));
+		if (!rgba.data())
+			throw std::runtime_error(std::string("Could not create atlas surface: ") + SDL_GetError());
+
+		SDL_BlitSurface(img.surface.data(), NULL, rgba.data(), NULL);
+
+		SDL_Rect dst{rect.x, rect.y, rect.w, rect.h};
+		if (SDL_UpdateTexture(pages[rect.page]->data(), &dst, rgba.data()->pixels, rgba.data()->pitch))
+			throw std::runtime_error(std::string("Could not update atlas: ") + SDL_GetError());
+
+		img.page = pages[rect.page].get();
+		img.page_x = rect.x;
+		img.page_y = rect.y;
+		img.texture.width = rect.w;
+		img.texture.height = rect.h;
+	}
+}
+
+Animation::Animation(SimpleRender &r, const Palette &pal, const Slp &slp, res_id id, Atlas *atlas, unsigned players) : slp(slp), images(), id(id), image_count(0), dynamic(false) {
 	if (memcmp(slp.hdr->version, "2.0N", 4))
 		throw std::runtime_error("Could not load animation: bad header");
 
 	images.reset(new Image[image_count = slp.hdr->frame_count]);
 
 	for (unsigned i = 0, n = slp.hdr->frame_count; i < n; ++i)
-		if (images[i].load(r, pal, slp, i)) {
+		if (images[i].decode(pal, slp, i)) {
 			dynamic = true;
 			break;
 		}
 
 	// use custom parsing if dynamic
-	if (!dynamic)
+	if (!dynamic) {
+		if (atlas) {
+			atlas->add(r, images.get(), image_count);
+		} else {
+			for (unsigned i = 0; i < image_count; ++i)
+				images[i].upload(r);
+		}
 		return;
+	}
 
-	images.reset(new Image[slp.hdr->frame_count * io::max_players]);
-
-	for (unsigned p = 0; p < io::max_players; ++p)
-		for (unsigned i = 0, n = slp.hdr->frame_count; i < n; ++i) {
-			const io::SlpFrameInfo *info = &slp.info[i];
-			images[p * n + i].load(r, pal, slp, i, p);
+	unsigned n = slp.hdr->frame_count, total = n * io::max_players;
+	images.reset(new Image[total]);
+
+	// decoding all player colors is expensive, so do it in parallel and just upload on this thread
+	scheduler().parallel_for(total, 4, [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; ++i)
+			images[i].decode(pal, slp, (unsigned)(i % n), (unsigned)(i / n));
+	}, "slp decode");
+
+	// the frames of one player color are drawn together, so they should share a page
+	for (unsigned p = 0; p < io::max_players; ++p) {
+		if (atlas && p < players) {
+			atlas->add(r, images.get() + p * n, n);
+		} else {
+			for (unsigned i = 0; i < n; ++i)
+				images[p * n + i].upload(r);
 		}
+	}
 }
 
 Image &Animation::subimage(unsigned index, unsigned player) {
@@ -8,11 +8,13 @@
 #include <limits.h>
 
 #include <string>
+#include <vector>
 
 #include <SDL2/SDL_pixels.h>
 #include <SDL2/SDL_surface.h>
 #include <SDL2/SDL_render.h>
 
+#include "base/atlas.hpp"
 #include "base/drs.hpp"
 #include "render.hpp"
 
@@ -95,18 +97,46 @@ struct Palette final {
 class Image final {
 public:
 	Surface surface;
-	Texture texture;
+	Texture texture; /**< only the size is set if this image is in an atlas page */
 	int hotspot_x, hotspot_y;
+	Texture *page; /**< atlas page that has this image, nullptr if it has its own texture */
+	int page_x, page_y;
 
 	Image();
 
 	bool load(SimpleRender &r, const Palette &pal, const Slp &slp, unsigned index, unsigned player=0);
+	/** Convert slp frame to a surface. This does not touch the renderer, so it may run on any thread. */
+	bool decode(const Palette &pal, const Slp &slp, unsigned index, unsigned player=0);
+	/** Create texture from the decoded surface. This must be called from the main thread. */
+	void upload(SimpleRender &r);
 	void draw(SimpleRender &r, int x, int y, int w=0, int h=0, int sx=0, int sy=0, bool hflip=false);
 	void draw(SimpleRender &r, const SDL_Rect &bnds);
 	void draw_stretch(SimpleRender &r, const SDL_Rect &to);
 	void draw_stretch(SimpleRender &r, const SDL_Rect &from, const SDL_Rect &to);
 };
 
+/** Atlas pages for images that are drawn together, see base/atlas.hpp. */
+class Atlas final {
+	int page_size;
+	AtlasPages layout;
+	std::vector<std::unique_ptr<Texture>> pages;
+	std::vector<AtlasRect> rects; /**< scratch for add */
+public:
+	static constexpr int max_page_size = 4096;
+
+	Atlas(SimpleRender &r);
+
+	/**
+	 * Put \a count decoded \a images in the same page if possible. Images that are
+	 * larger than a page get their own texture.
+	 */
+	void add(SimpleRender &r, Image *images, unsigned count);
+	/** Drop all pages. This invalidates all images that have been added. */
+	void clear();
+
+	size_t size() const noexcept { return pages.size(); }
+};
+
 class Animation final {
 	const Slp slp;
 public:
@@ -115,7 +145,11 @@ public:
 	unsigned image_count;
 	bool dynamic;
 
-	Animation(SimpleRender &r, const Palette &pal, const Slp &slp, res_id id);
+	/**
+	 * Load all images of \a slp. If \a atlas is specified, the images of the first \a
+	 * players player colors are packed into it, so they can be batched.
+	 */
+	Animation(SimpleRender &r, const Palette &pal, const Slp &slp, res_id id, Atlas *atlas=nullptr, unsigned players=io::max_players);
 
 	Image &subimage(unsigned index, unsigned player=0);
 
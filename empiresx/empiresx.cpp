@@ -34,6 +34,9 @@
 #include "os_macros.hpp"
 #include "os.hpp"
 #include "base/net.hpp"
+#include "base/events.hpp"
+#include "base/drawlist.hpp"
+#include "base/terrain.hpp"
 #include "engine.hpp"
 #include "font.hpp"
 #include "menu.hpp"
@@ -311,7 +314,10 @@ class Viewport final {
 public:
 	game::Box2<float> bounds;
 
-	std::vector<game::Particle*> particles;
+	/** Visible particles in drawing order. Handles are used, since particles may be gone before the next update. */
+	std::vector<game::Handle> particles;
+	/** Everything on the map in drawing order. Only what has changed is updated. */
+	game::DrawList drawlist;
 	unsigned invalidate;
 
 	static constexpr unsigned invalidate_particles = 0x01;
@@ -320,28 +326,33 @@ public:
 	float move_speed = 0.5f; // TODO playtest movement speed factor
 	ConfigScreenMode mode;
 	game::World &world;
-	uint32_t selected = 0;
+	game::Handle selected;
+	unsigned player = game::FogOfWar::spectator; /**< whose fog of war to show. everything until we know which player we are */
 
 	Cursor cursor; // TODO move this to game eventually
 
 	Viewport(game::World &world)
-		: bounds(), particles(), invalidate(invalidate_all)
-		, mode(eng->w->render().mode), world(world), cursor(CursorId::game_default) {}
+		: bounds(), particles(), drawlist(world.map), invalidate(invalidate_all)
+		, mode(eng->w->render().mode), world(world), selected(), cursor(CursorId::game_default) {}
 
 private:
+	/** Static stuff stays on the map once it has been explored, but units are hidden by the fog of war. */
+	bool shown(const game::DrawList::Entry &e) const noexcept {
+		return e.dynamic ? world.fog.visible(player, e.x, e.y) : world.fog.explored(player, e.x, e.y);
+	}
+
 	/** Ensure that the visual state is consistent with the associated world. */
 	void update() {
 		if (!invalidate)
 			return;
 
 		if (invalidate & invalidate_particles) {
+			drawlist.sync(world);
 			particles.clear();
-			world.query_static(particles, bounds);
-			world.query_dynamic(particles, bounds);
 
-			// maintain z-order by sorting all selected objects such that the upper units are drawn first
-			std::sort(particles.begin(), particles.end(), [](game::Particle *lhs, game::Particle *rhs) {
-				return lhs->scr.top + lhs->hotspot_y < rhs->scr.top + rhs->hotspot_y;
+			drawlist.query(bounds, [this](const game::DrawList::Entry &e) {
+				if (shown(e))
+					particles.push_back(e.handle);
 			});
 		}
 
@@ -366,6 +377,9 @@ public:
 			mode = next_mode;
 		}
 
+		// units move all the time and only what has changed is updated, so refresh every frame
+		invalidate |= invalidate_particles;
+
 		if (!dx && !dy) {
 			update();
 			return;
@@ -394,19 +408,19 @@ public:
 			case SDL_BUTTON_LEFT:
 			{
 				game::Box2<float> area(bounds.left + static_cast<float>(ev.x), bounds.top + static_cast<float>(ev.y));
-				std::vector<game::Particle*> selected;
-
-				world.query_static(selected, area);
-				world.query_dynamic(selected, area);
+				game::Handle top;
 
-				std::sort(selected.begin(), selected.end(), [](game::Particle *lhs, game::Particle *rhs) {
-					return lhs->scr.top + lhs->hotspot_y > rhs->scr.top + rhs->hotspot_y;
+				// whatever is drawn last is on top. anything that is not drawn cannot be selected either
+				drawlist.sync(world);
+				drawlist.query(area, [&](const game::DrawList::Entry &e) {
+					if (shown(e))
+						top = e.handle;
 				});
 
-				this->selected = selected.empty() ? 0 : selected[0]->getid();
+				this->selected = top;
 
 				if (this->selected) {
-					game::Particle *p = selected[0];
+					game::Particle *p = world.get(top);
 					game::Villager *v = dynamic_cast<game::Villager*>(p);
 
 					if (v) {
@@ -456,43 +470,19 @@ public:
 	}
 
 	void paint() {
-		for (auto &x : particles)
-			x->draw(static_cast<int>(-bounds.left), static_cast<int>(-bounds.top));
-	}
-};
+		SimpleRender &r = (SimpleRender&)eng->w->render();
 
-class GameEvent {
-public:
-	GameEvent();
-	virtual ~GameEvent() {}
+		// particles are drawn from a few atlas pages, so most of them end up in the same draw call
+		r.sprites.begin();
 
-	virtual void apply(game::World &world) = 0;
-};
+		for (game::Handle h : particles) {
+			game::Particle *p = world.get(h);
 
-class GameEvents final {
-	std::recursive_mutex mut;
-	std::deque<std::unique_ptr<GameEvent>> events_now, events_next;
-public:
-	void dbuf() {
-		std::lock_guard<std::recursive_mutex> lock(mut);
-		events_now.swap(events_next);
-	}
-
-	void apply(game::World &world) {
-		for (auto &e : events_now)
-			e->apply(world);
-
-		events_now.clear();
-	}
-
-	void idle(game::World &world) {
-		dbuf();
-		apply(world);
-	}
+			if (p)
+				p->draw(static_cast<int>(-bounds.left), static_cast<int>(-bounds.top));
+		}
 
-	void push(GameEvent *e) {
-		std::lock_guard<std::recursive_mutex> lock(mut);
-		events_next.emplace_back(e);
+		r.sprites.end(r);
 	}
 };
 
@@ -509,19 +499,19 @@ class MenuGame final : public Menu, public ui::InteractableCallback, ui::InputCa
 
 	unsigned key_state;
 
-	// lock to ensure access variables below are thread-safe
-	std::recursive_mutex mut;
+	// only the thread that draws uses the variables below. the network thread queues commands in the inbox and playerstate has its own lock
 	UIPlayerState *playerstate;
 	Viewport view;
-	GameEvents events;
+	/** Explored terrain, drawn in blocks. */
+	game::TerrainCache<Texture> terrain;
 public:
 	MenuGame(MenuLobby *lobby, SimpleRender &r, Multiplayer *mp, UIPlayerState *state, bool host, const StartMatch &settings)
 		: Menu(MenuId::selectnav, r, eng->assets->fnt_title, "Game", SDL_Color{0xff, 0xff, 0xff}, true), Game(host ? game::GameMode::multiplayer_host : game::GameMode::multiplayer_client, lobby, mp, settings)
-		, img(), host(host), started(false)
+		, img(std::max(1u, (unsigned)settings.slave_count)), host(host), started(false)
 		, f_chat(nullptr), key_state(0)
-		, mut()
 		, playerstate(state) // copy state_now and state_next and txtchat from menulobby
-		, view(world), events()
+		, view(world)
+		, terrain(world.map)
 	{
 		cache = &img;
 		world.populate(settings.slave_count);
@@ -553,17 +543,32 @@ private:
 		view.idle(this->world, dx, dy, ms);
 	}
 public:
+	void reset(bool device) override {
+		// terrain blocks are render targets, so they have to be drawn again
+		terrain.clear();
+
+		// atlas pages and all other textures are gone as well. animations are loaded again once they are drawn
+		if (device)
+			img.clear();
+	}
+
 	void idle(Uint32 ms) override {
-		std::lock_guard<std::recursive_mutex> lock(mut);
 		playerstate->dbuf(r);
 
 		if (host && !started)
 			started = ((MultiplayerHost*)mp)->try_start();
 
-		if (started) {
+		// only the host steps, but clients have to learn about players as well
+		if (started)
 			Game::step(ms);
-			events.idle(world);
-		}
+		else
+			drain();
+
+		// the host assigns every user to a player before it tells everyone to start
+		player_id pid;
+		bool known = find_player(host ? 0 : mp->self, pid);
+		assert(known || state != game::GameState::running);
+		view.player = known ? pid : game::FogOfWar::spectator;
 
 		update_viewport(ms);
 	}
@@ -631,8 +636,6 @@ public:
 	}
 
 	bool input(unsigned id, ui::InputField &field) override {
-		std::lock_guard<std::recursive_mutex> lock(mut);
-
 		auto s = field.text();
 		if (!s.empty()) {
 			if (s == "/clear")
@@ -651,18 +654,32 @@ private:
 		auto &rel_bnds = eng->w->render().dim.rel_bnds;
 		auto bnds_left = rel_bnds.x, bnds_right = rel_bnds.x + rel_bnds.w, bnds_top = rel_bnds.y, bnds_bottom = rel_bnds.y + rel_bnds.h;
 
-		for (unsigned ty = 0; ty < world.map.h; ++ty) {
-			for (unsigned tx = 0; tx < world.map.w; ++tx) {
-				int x, y;
-				tile_to_scr(x, y, static_cast<int>(tx), static_cast<int>(ty));
+		// blocks are only redrawn once their terrain or what has been explored has changed
+		terrain.paint(world.map, world.fog, view.player, left, top, bnds_left, bnds_top, bnds_right, bnds_bottom, [&](std::unique_ptr<Texture> &tex, unsigned bx, unsigned by) {
+			SDL_Renderer *canvas = r.canvas();
 
-				unsigned tile = world.map.tiles[ty * world.map.w + tx];
+			if (!tex)
+				tex.reset(new Texture(r, terrain.block_w, terrain.block_h));
 
-				// quick and dirty check to see if tile should be drawn
-				if (left + x + tw >= bnds_left && left + x < bnds_right && top + y + th >= bnds_top && top + y < bnds_bottom)
-					desert_tiles.subimage(tile).draw(r, left + x, top + y);
-			}
-		}
+			SDL_Texture *target = SDL_GetRenderTarget(canvas);
+			SDL_SetRenderTarget(canvas, tex->data());
+
+			Uint8 cr, cg, cb, ca;
+			SDL_GetRenderDrawColor(canvas, &cr, &cg, &cb, &ca);
+			SDL_SetRenderDrawColor(canvas, 0, 0, 0, SDL_ALPHA_TRANSPARENT);
+			SDL_RenderClear(canvas);
+			SDL_SetRenderDrawColor(canvas, cr, cg, cb, ca);
+
+			// look at the tile only if it has been explored, since that may generate it
+			terrain.tiles(world.map, bx, by, [&](unsigned tx, unsigned ty, int x, int y) {
+				if (world.fog.explored(view.player, (int)tx, (int)ty))
+					desert_tiles.subimage(world.map.tile(tx, ty)).draw(r, x, y);
+			});
+
+			SDL_SetRenderTarget(canvas, target);
+		}, [&](Texture &tex, int x, int y) {
+			tex.paint(r, x, y, tex.width, tex.height);
+		});
 	}
 
 	void paint_hud_borders() {
@@ -710,23 +727,6 @@ private:
 	}
 
 public:
-	void new_player(const CreatePlayer &create) override {
-		std::lock_guard<std::recursive_mutex> lock(mut);
-		players.emplace(create.id, create.str());
-	}
-
-	void assign_player(const AssignSlave &assign) override {
-		std::lock_guard<std::recursive_mutex> lock(mut);
-
-		assert(players.find(assign.to) != players.end());
-		usertbl.emplace(assign.from, assign.to);
-	}
-
-	void change_state(const game::GameState &state) override {
-		std::lock_guard<std::recursive_mutex> lock(mut);
-		this->state = state;
-	}
-
 	void paint() override {
 		r.color({0, 0, 0, SDL_ALPHA_OPAQUE});
 		r.clear();
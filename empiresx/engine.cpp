@@ -186,11 +186,11 @@ BackgroundSettings Assets::open_bkg(res_id id) {
 	return drs_ui.open_bkg(id);
 }
 
-Animation Assets::open_slp(const Palette &pal, res_id id) {
+Animation Assets::open_slp(const Palette &pal, res_id id, Atlas *atlas, unsigned players) {
 	Slp slp;
 
 	if (drs_border.open_slp(slp, id) || drs_gfx.open_slp(slp, id) || drs_ui.open_slp(slp, id) || drs_terrain.open_slp(slp, id))
-		return Animation((SimpleRender&)eng->w->render(), pal, slp, id);
+		return Animation((SimpleRender&)eng->w->render(), pal, slp, id, atlas, players);
 
 	throw std::runtime_error(std::string("Could not load animation ") + std::to_string(id) + ": bad id");
 }
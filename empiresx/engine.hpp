@@ -79,7 +79,7 @@ public:
 
 	Palette open_pal(res_id id);
 	BackgroundSettings open_bkg(res_id id);
-	Animation open_slp(const Palette &pal, res_id id);
+	Animation open_slp(const Palette &pal, res_id id, Atlas *atlas=nullptr, unsigned players=io::max_players);
 	std::string open_str(LangId id);
 	void *open_wav(res_id id, size_t &count);
 };
@@ -11,10 +11,12 @@ namespace genie {
 
 ImageCache *cache;
 
-ImageCache::ImageCache() : pal(eng->assets->open_pal(ImageCache::default_palette)), cache() {}
+ImageCache::ImageCache(unsigned players)
+	: pal(eng->assets->open_pal(ImageCache::default_palette)), atlas((SimpleRender&)eng->w->render()), players(players), cache() {}
 
 void ImageCache::clear() {
 	cache.clear();
+	atlas.clear();
 }
 
 Animation &ImageCache::get(res_id id) {
@@ -24,7 +26,7 @@ Animation &ImageCache::get(res_id id) {
 		return const_cast<Animation&>(search->second);
 
 	// load into cache
-	cache.emplace(id, eng->assets->open_slp(pal, id));
+	cache.emplace(id, eng->assets->open_slp(pal, id, &atlas, players));
 	search = cache.find(id);
 	assert(search != cache.end());
 	return const_cast<Animation&>(search->second);
@@ -50,6 +52,7 @@ void Particle::draw(int offx, int offy, unsigned index) const {
 	Animation &anim = const_cast<Animation&>(cache->get(this->anim_index));
 	anim.subimage(index).draw(r, static_cast<int>(this->scr.left) + offx, static_cast<int>(this->scr.top) + offy, 0, 0, 0, 0, hflip);
 #if DEBUG
+	r.sprites.flush(r);
 	r.color(SDL_Color{0xff, 0, 0, SDL_ALPHA_OPAQUE});
 	SDL_Rect bnds{static_cast<int>(this->scr.left) + offx, static_cast<int>(this->scr.top) + offy, static_cast<int>(scr.w), static_cast<int>(scr.h)};
 	SDL_RenderDrawRect(r.canvas(), &bnds);
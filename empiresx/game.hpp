@@ -13,11 +13,16 @@ namespace genie {
 
 extern class ImageCache final {
 	Palette pal;
+	Atlas atlas; /**< all images in the cache that fit */
+	unsigned players; /**< player colors that are packed in the atlas */
 	std::map<res_id, Animation> cache;
 public:
 	static constexpr res_id default_palette = 50500;
-	/** Construct animation cache for in-game graphics that is frequently used. */
-	ImageCache();
+	/**
+	 * Construct animation cache for in-game graphics that is frequently used. Only the
+	 * colors of the first \a players players are drawn from the atlas.
+	 */
+	ImageCache(unsigned players=io::max_players);
 	/** Nuke saved animations. */
 	void clear();
 	/**
@@ -16,6 +16,7 @@ Linux specific socket I/O epoll API wrapper
 #include <netinet/tcp.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/eventfd.h>
 #include <unistd.h>
 
 #include "../endian.h"
@@ -70,6 +71,10 @@ void ServerSocket::close() {
 		::close(efd);
 		efd = -1;
 	}
+	if (wfd != -1) {
+		::close(wfd);
+		wfd = -1;
+	}
 	// TODO figure out if this may trigger UB and/or leak memory
 }
 
@@ -194,6 +199,13 @@ int ServerSocket::event_process(ServerCallback &cb, pollev &ev) {
 		return 0;
 	}
 
+	// just reset the counter, since flush is called on every round anyway
+	if (wfd == fd) {
+		eventfd_t v;
+		eventfd_read(wfd, &v);
+		return 0;
+	}
+
 	if (ev.events & EPOLLIN)
 		while (1) {
 			int err;
@@ -263,6 +275,8 @@ void ServerSocket::eventloop(ServerCallback &cb) {
 	while (activated.load()) {
 		int err, n;
 
+		cb.flush();
+
 		// wait for new events
 		if ((n = epoll_wait(efd, events, MAX_EVENTS, -1)) == -1) {
 			/*
@@ -292,6 +306,7 @@ void ServerSocket::eventloop(ServerCallback &cb) {
 ServerSocket::ServerSocket(uint16_t port)
 	: sock(port)
 	, efd(-1)
+	, wfd(-1)
 	, peers()
 	, rbuf(), wbuf(), activated(false)
 {
@@ -310,6 +325,20 @@ ServerSocket::ServerSocket(uint16_t port)
 
 	if (epoll_ctl(efd, EPOLL_CTL_ADD, sock.fd, &ev))
 		throw std::runtime_error(std::string("Could not activate epoll interface: ") + strerror(errno));
+
+	if ((wfd = eventfd(0, EFD_NONBLOCK)) == -1)
+		throw std::runtime_error(std::string("Could not create event loop wakeup: ") + strerror(errno));
+
+	ev.data.fd = wfd;
+	ev.events = EPOLLIN;
+
+	if (epoll_ctl(efd, EPOLL_CTL_ADD, wfd, &ev))
+		throw std::runtime_error(std::string("Could not activate event loop wakeup: ") + strerror(errno));
+}
+
+void ServerSocket::wake() {
+	if (wfd != -1)
+		eventfd_write(wfd, 1);
 }
 
 SSErr ServerSocket::push(sockfd fd, const Command &cmd, bool net_order) {
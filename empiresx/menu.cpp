@@ -194,6 +194,12 @@ void Navigator::mainloop() {
 			case SDL_MOUSEBUTTONUP:
 				top->mouseup(ev.button);
 				break;
+			case SDL_RENDER_TARGETS_RESET:
+				reset(false);
+				break;
+			case SDL_RENDER_DEVICE_RESET:
+				reset(true);
+				break;
 			}
 		}
 
@@ -215,6 +221,11 @@ void Navigator::resize(ConfigScreenMode old_mode, ConfigScreenMode mode) {
 		x->resize(old_mode, mode);
 }
 
+void Navigator::reset(bool device) {
+	for (auto &x : trace)
+		x->reset(device);
+}
+
 void Navigator::go_to(Menu *m) {
 	assert(m);
 	trace.emplace_back(top = m);
@@ -44,6 +44,8 @@ public:
 	void go_to(Menu *menu);
 
 	virtual void resize(ConfigScreenMode old_mode, ConfigScreenMode mode);
+	/** The renderer has lost what has been drawn into render targets or, if \a device is set, all textures. */
+	virtual void reset(bool /*device*/) {}
 
 	virtual void custom_mouseup(SDL_MouseButtonEvent&) {}
 
@@ -71,6 +73,7 @@ public:
 
 	void mainloop();
 	void resize(ConfigScreenMode old_mode, ConfigScreenMode mode);
+	void reset(bool device);
 	void go_to(Menu *m);
 	void quit(unsigned count = 0);
 };
@@ -6,6 +6,7 @@
 
 #include <stdexcept>
 #include <string>
+#include <utility>
 
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_opengl.h>
@@ -86,7 +87,78 @@ Render::Render(Window &w) : w(w), old_dim(), dim(), mode(w.mode()) {
 	dim.resize(bnds);
 }
 
-SimpleRender::SimpleRender(Window &w, Uint32 flags, int index) : Render(w), handle(NULL, &SDL_DestroyRenderer) {
+SpriteBatch::SpriteBatch() : texture(NULL), tex_w(1), tex_h(1)
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+	, vertices(), indices()
+#endif
+	, active(false), calls(0), sprites(0) {}
+
+void SpriteBatch::begin() {
+	active = true;
+	calls = sprites = 0;
+}
+
+void SpriteBatch::end(SimpleRender &r) {
+	flush(r);
+	active = false;
+}
+
+void SpriteBatch::copy(SimpleRender &r, Texture &tex, const SDL_Rect &src, const SDL_Rect &dst, bool hflip) {
+	++sprites;
+
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+	if (active) {
+		if (tex.data() != texture) {
+			flush(r);
+			texture = tex.data();
+			tex_w = (float)tex.width;
+			tex_h = (float)tex.height;
+		}
+
+		float u0 = src.x / tex_w, v0 = src.y / tex_h, u1 = (src.x + src.w) / tex_w, v1 = (src.y + src.h) / tex_h;
+		float x0 = (float)dst.x, y0 = (float)dst.y, x1 = (float)(dst.x + dst.w), y1 = (float)(dst.y + dst.h);
+		SDL_Color c{0xff, 0xff, 0xff, SDL_ALPHA_OPAQUE};
+
+		if (hflip)
+			std::swap(u0, u1);
+
+		int i = (int)vertices.size();
+
+		vertices.push_back(SDL_Vertex{{x0, y0}, c, {u0, v0}});
+		vertices.push_back(SDL_Vertex{{x1, y0}, c, {u1, v0}});
+		vertices.push_back(SDL_Vertex{{x1, y1}, c, {u1, v1}});
+		vertices.push_back(SDL_Vertex{{x0, y1}, c, {u0, v1}});
+
+		for (int j : {0, 1, 2, 0, 2, 3})
+			indices.push_back(i + j);
+
+		return;
+	}
+#endif
+	++calls;
+
+	if (!hflip)
+		SDL_RenderCopy(r.canvas(), tex.data(), &src, &dst);
+	else
+		SDL_RenderCopyEx(r.canvas(), tex.data(), &src, &dst, 0, NULL, SDL_FLIP_HORIZONTAL);
+}
+
+void SpriteBatch::flush(SimpleRender &r) {
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+	if (vertices.empty())
+		return;
+
+	SDL_RenderGeometry(r.canvas(), texture, vertices.data(), (int)vertices.size(), indices.data(), (int)indices.size());
+	++calls;
+
+	vertices.clear();
+	indices.clear();
+#else
+	(void)r;
+#endif
+}
+
+SimpleRender::SimpleRender(Window &w, Uint32 flags, int index) : Render(w), handle(NULL, &SDL_DestroyRenderer), sprites() {
 	SDL_Renderer *r;
 
 	if (!(r = SDL_CreateRenderer(w.data(), index, flags)))
@@ -253,6 +325,19 @@ Texture::Texture(SimpleRender &r, SDL_Surface *s, bool close) : handle(NULL, &SD
 
 Texture::Texture(int width, int height, SDL_Texture *handle) : handle(handle, &SDL_DestroyTexture), width(width), height(height) {}
 
+Texture::Texture(SimpleRender &r, int width, int height, int access) : handle(NULL, &SDL_DestroyTexture), width(width), height(height) {
+#if windows
+	assert(GetCurrentThreadId() == eng->sdl.id);
+#endif
+	SDL_Texture *tex;
+
+	if (!(tex = SDL_CreateTexture(r.canvas(), SDL_PIXELFORMAT_RGBA8888, access, width, height)))
+		throw std::runtime_error(std::string("Could not create blank texture: ") + SDL_GetError());
+
+	SDL_SetTextureBlendMode(tex, SDL_BLENDMODE_BLEND);
+	handle.reset(tex);
+}
+
 void Texture::reset(SimpleRender &r, SDL_Surface *surf) {
 #if windows
 	assert(GetCurrentThreadId() == eng->sdl.id);
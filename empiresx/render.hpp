@@ -5,12 +5,14 @@
 #include "cfg.hpp"
 
 #include <memory>
+#include <vector>
 
 struct SDL_Window;
 
 #include <SDL2/SDL_render.h>
 #include <SDL2/SDL_opengl.h>
 #include <SDL2/SDL_surface.h>
+#include <SDL2/SDL_version.h>
 #include <SDL2/SDL_video.h>
 
 namespace genie {
@@ -53,9 +55,42 @@ public:
 	virtual void paint() = 0;
 };
 
+class SimpleRender;
+class Texture;
+
+/**
+ * Sprites that are drawn between begin and end are collected and every run of sprites
+ * from the same texture is drawn with a single call. Sprites from atlas pages mostly
+ * share a texture, so a whole scene takes just a few calls. Outside begin and end,
+ * sprites are drawn right away.
+ */
+class SpriteBatch final {
+	SDL_Texture *texture; /**< of the sprites that have not been drawn yet */
+	float tex_w, tex_h;
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+	std::vector<SDL_Vertex> vertices;
+	std::vector<int> indices;
+#endif
+	bool active;
+public:
+	size_t calls, sprites; /**< since begin */
+
+	SpriteBatch();
+
+	void begin();
+	void end(SimpleRender &r);
+
+	/** Draw \a src from \a tex to \a dst. */
+	void copy(SimpleRender &r, Texture &tex, const SDL_Rect &src, const SDL_Rect &dst, bool hflip=false);
+	/** Draw all collected sprites, e.g. before drawing something that does not go through the batch. */
+	void flush(SimpleRender &r);
+};
+
 class SimpleRender final : public Render {
 	std::unique_ptr<SDL_Renderer, decltype(&SDL_DestroyRenderer)> handle;
 public:
+	SpriteBatch sprites;
+
 	SimpleRender(Window &w, Uint32 flags, int index = -1);
 
 	SDL_Renderer *canvas() { return handle.get(); }
@@ -116,6 +151,8 @@ public:
 
 	Texture(SimpleRender &r, SDL_Surface *s, bool close = false);
 	Texture(int width, int height, SDL_Texture *handle);
+	/** Create transparent texture that can be used as render target or that can be updated. */
+	Texture(SimpleRender &r, int width, int height, int access=SDL_TEXTUREACCESS_TARGET);
 
 	SDL_Texture *data() { return handle.get(); }
 
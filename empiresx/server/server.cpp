@@ -9,6 +9,7 @@ Age of Empires and Rise of Rome expansion
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <inttypes.h>
 
 #include <iostream>
 #include <string>
@@ -61,25 +62,6 @@ public:
 		running.store(false);
 		t_worker.join();
 	}
-
-	void new_player(const CreatePlayer &create) override {
-		std::lock_guard<std::recursive_mutex> lock(mut);
-		printf("new player %u: %s\n", create.id, create.str().c_str());
-		players.emplace(create.id, create.str());
-	}
-
-	void assign_player(const AssignSlave& assign) override {
-		std::lock_guard<std::recursive_mutex> lock(mut);
-		assert(players.find(assign.to) != players.end());
-		printf("assign user %u to %u: %s\n", assign.from, assign.to, players.find(assign.to)->name.c_str());
-		usertbl.emplace(assign.from, assign.to);
-	}
-
-	void change_state(const GameState &state) override {
-		std::lock_guard<std::recursive_mutex> lock(mut);
-		printf("change gamestate to %u\n", (unsigned)state);
-		this->state = state;
-	}
 };
 
 void worker_loop(DedicatedGame &game) {
@@ -116,6 +98,18 @@ public:
 	void start(const StartMatch &match) override {
 		game.reset(new game::DedicatedGame(match, mp));
 	}
+
+	void dump() {
+		mp.dump();
+
+		if (game) {
+			RingStats s = game->inbox_stats();
+			printf("inbox: %" PRIu64 " received, %" PRIu64 " full, depth %zu, max %zu\n", s.pushed, s.full, s.depth, s.max_depth);
+
+			game::AiStats ai = game->ai_stats();
+			printf("ai: %" PRIu64 " views, %" PRIu64 " skipped, %" PRIu64 " plans, %" PRIu64 " overruns, %" PRIu64 " orders\n", ai.views, ai.skipped, ai.plans, ai.overruns, ai.orders);
+		}
+	}
 };
 
 }
@@ -145,7 +139,7 @@ int main(int argc, char **argv) {
 			} else if (input == "q" || input == "quit") {
 				break;
 			} else if (input == "d") {
-				server.mp.dump();
+				server.dump();
 			} else if (starts_with(input, "say ")) {
 				server.mp.chat(input.substr(strlen("say ")));
 			} else if (input == "start") {
@@ -108,6 +108,8 @@ void ServerSocket::eventloop(ServerCallback &cb) {
 	while (activated.load()) {
 		int err, incoming = 0;
 
+		cb.flush();
+
 		// keep accepting any pending sockets
 		{
 			std::lock_guard<std::recursive_mutex> lock(mut);
@@ -274,6 +276,10 @@ void ServerSocket::eventloop(ServerCallback &cb) {
 #endif
 }
 
+void ServerSocket::wake() {
+	// WSAPoll gives up after a short while anyway, so the event loop flushes soon enough
+}
+
 void ServerSocket::close() {
 	if (activated.load()) {
 		activated.store(false);